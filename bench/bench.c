@@ -0,0 +1,487 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "cache.h"
+#include "grade.h"
+#include "interpreter.h"
+#include "sweep.h"
+#include "thumbnail.h"
+
+// kumar_bench [corpus dir] [--min-time <seconds>]
+//
+// Runs a fixed set of programs from the corpus on grids generated from
+// fixed seeds and prints one JSON object per measurement and line, so
+// two runs can be diffed or loaded into a script. Every measurement is
+// repeated until it took at least the minimum time and the mean is
+// reported. Keys and bench names only ever get added, never renamed.
+// Grid files are written to and removed from the current directory
+#ifndef KUMAR_BENCH_CORPUS
+#define KUMAR_BENCH_CORPUS "bench/corpus"
+#endif
+
+#define BENCH_MIN_SECONDS_DEFAULT 0.2
+#define BENCH_GENERATED_BLOCKS 30000
+#define BENCH_CONDITION_POSITIONS 4096
+#define BENCH_CONDITION_ROUNDS 1024
+#define BENCH_MAX_STEPS 100000000
+
+typedef struct BenchGrid {
+    const char *name;
+    int width;
+    int height;
+    size_t wallCount;  // random walls, none on the robot's cell (0, 0)
+    uint64_t seed;
+    Grid grid;
+} BenchGrid;
+
+typedef struct BenchProgram {
+    const char *name;
+    const char *filename;  // NULL for the generated program
+    char *source;
+    size_t lineCount;
+    Program program;
+} BenchProgram;
+
+typedef struct BenchCase {
+    const char *program;
+    const char *grid;
+} BenchCase;
+
+BenchGrid m_benchGrids[] = {
+    { .name = "small", .width = 15, .height = 15, .wallCount = 0, .seed = 1 },
+    { .name = "open", .width = 1000, .height = 1000, .wallCount = 0, .seed = 2 },
+    { .name = "walls", .width = 1000, .height = 1000, .wallCount = 50000, .seed = 3 },
+    { .name = "sparse", .width = 100000, .height = 100000, .wallCount = 2000, .seed = 4 },
+    { .name = "rooms", .width = 64, .height = 64, .wallCount = 800, .seed = 5 }
+};
+
+BenchProgram m_benchPrograms[] = {
+    { .name = "straight", .filename = "straight.kum" },
+    { .name = "nested", .filename = "nested.kum" },
+    { .name = "scan", .filename = "scan.kum" },
+    { .name = "generated", .filename = NULL }
+};
+
+BenchCase m_benchCases[] = {
+    { "straight", "small" },
+    { "nested", "small" },
+    { "nested", "open" },
+    { "scan", "walls" },
+    { "scan", "sparse" },
+    { "generated", "small" }
+};
+
+// Programs swept from every start cell, on grids within SWEEP_MAX_CELLS
+BenchCase m_benchSweeps[] = {
+    { "nested", "small" },
+    { "scan", "rooms" },
+    { "generated", "small" }
+};
+
+#define countof(array) (sizeof(array) / sizeof((array)[0]))
+
+uint64_t benchRandom(uint64_t *state) {
+    *state += 0x9E3779B97F4A7C15ull;
+    uint64_t z = *state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void generateBenchGrid(BenchGrid *bench) {
+    bench->grid = makeGrid();
+    bench->grid.width = bench->width;
+    bench->grid.height = bench->height;
+    generateGridData(&bench->grid);
+    uint64_t state = bench->seed;
+    for (size_t i = 0; i < bench->wallCount; i++) {
+        int x = benchRandom(&state) % bench->width;
+        int y = benchRandom(&state) % bench->height;
+        if (x != 0 || y != 0)
+            setGridCell(&bench->grid, x, y, GRID_CELL_WALL);
+    }
+}
+
+// A long program of small blocks that are safe anywhere on the field
+char *generateBenchSource(size_t blockCount) {
+    static const char *blocks[] = {
+        "если справа свободно то\n    вправо\nвсе\n",
+        "если слева свободно то\n    влево\nвсе\n",
+        "если снизу свободно то\n    вниз\nвсе\n",
+        "если сверху свободно то\n    вверх\nвсе\n",
+        "закрасить\n",
+        "нц пока справа свободно\n    вправо\nкц\n"
+    };
+    size_t capacity = blockCount * 64 + 1, length = 0;
+    char *source = nmallocT(char, capacity);
+    uint64_t state = 5;
+    for (size_t i = 0; i < blockCount; i++) {
+        const char *block = blocks[benchRandom(&state) % countof(blocks)];
+        size_t blockLength = strlen(block);
+        memcpy(source + length, block, blockLength);
+        length += blockLength;
+    }
+    source[length] = '\0';
+    return source;
+}
+
+char *readBenchFile(const char *dir, const char *filename) {
+    size_t pathLength = strlen(dir) + strlen(filename) + 2;
+    char *path = nmallocT(char, pathLength);
+    snprintf(path, pathLength, "%s/%s", dir, filename);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Failed to open %s\n", path);
+        free(path);
+        return NULL;
+    }
+    free(path);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *source = nmallocT(char, size + 1);
+    size_t read = fread(source, 1, size, file);
+    source[read] = '\0';
+    fclose(file);
+    return source;
+}
+
+size_t countLines(const char *source) {
+    size_t count = 0;
+    for (const char *c = source; *c != '\0'; c++) {
+        if (*c == '\n' || c[1] == '\0') count++;
+    }
+    return count;
+}
+
+BenchProgram *findBenchProgram(const char *name) {
+    for (size_t i = 0; i < countof(m_benchPrograms); i++) {
+        if (streq(m_benchPrograms[i].name, name))
+            return &m_benchPrograms[i];
+    }
+    return NULL;
+}
+
+BenchGrid *findBenchGrid(const char *name) {
+    for (size_t i = 0; i < countof(m_benchGrids); i++) {
+        if (streq(m_benchGrids[i].name, name))
+            return &m_benchGrids[i];
+    }
+    return NULL;
+}
+
+double m_benchMinSeconds = BENCH_MIN_SECONDS_DEFAULT;
+
+void benchCompile(BenchProgram *bench) {
+    size_t iterations = 0, lineNum;
+    double seconds = 0;
+    InterpreterExitCode code;
+    do {
+        Program program;
+        double start = getTimeSeconds();
+        code = compileProgramSource(bench->source, LANG_RU, &program, &lineNum);
+        seconds += getTimeSeconds() - start;
+        iterations++;
+        if (code == INTERPRETER_NORMAL) freeProgram(&program);
+    } while (code == INTERPRETER_NORMAL && seconds < m_benchMinSeconds);
+
+    seconds /= iterations;
+    printf("{\"bench\":\"compile\",\"program\":\"%s\",\"code\":\"%s\",\"lines\":%zu,\"iterations\":%zu,"
+           "\"seconds\":%.9f,\"ns_per_line\":%.3f,\"lines_per_sec\":%.0f}\n",
+           bench->name, getErrcodeName(code), bench->lineCount, iterations,
+           seconds, seconds * 1e9 / bench->lineCount, bench->lineCount / seconds);
+}
+
+// Stepped runs call stepInterpreter for one source instruction at a
+// time, like the viewer does, so they give the cost per instruction;
+// the others use runInterpreter with the fused instructions
+void benchRun(const BenchProgram *program, const BenchGrid *bench, bool stepped) {
+    InterpreterLimits limits = makeDefaultLimits();
+    limits.maxSteps = BENCH_MAX_STEPS;
+    size_t iterations = 0, instructions = 0;
+    double seconds = 0;
+    RunResult result;
+    Robot robot;
+    do {
+        Grid grid;
+        copyGrid(&grid, &bench->grid);
+        robot = makeRobot();
+        Interpreter interpreter;
+        initInterpreter(&interpreter, &program->program, &robot, &grid);
+        setInterpreterLimits(&interpreter, limits);
+        interpreter.stepFused = stepped;
+        double start = getTimeSeconds();
+        if (stepped) {
+            InterpreterExitCode code;
+            instructions = 0;
+            do {
+                code = stepInterpreter(&interpreter);
+                instructions++;
+            } while (code == INTERPRETER_NORMAL || code == INTERPRETER_SKIP_LINE);
+            result = (RunResult){ .code = code, .line = getInterpreterLine(&interpreter), .steps = interpreter.steps };
+        } else {
+            result = runInterpreter(&interpreter);
+        }
+        seconds += getTimeSeconds() - start;
+        iterations++;
+        freeInterpreter(&interpreter);
+        freeGrid(&grid);
+    } while (seconds < m_benchMinSeconds);
+
+    seconds /= iterations;
+    printf("{\"bench\":\"%s\",\"program\":\"%s\",\"grid\":\"%s\",\"code\":\"%s\",\"steps\":%zu,\"x\":%d,\"y\":%d,"
+           "\"iterations\":%zu,\"seconds\":%.9f,\"steps_per_sec\":%.0f,\"ns_per_step\":%.3f",
+           stepped ? "step" : "run", program->name, bench->name, getErrcodeName(result.code), result.steps,
+           robot.posX, robot.posY, iterations, seconds, result.steps / seconds, seconds * 1e9 / result.steps);
+    if (stepped)
+        printf(",\"instructions\":%zu,\"ns_per_instruction\":%.3f", instructions, seconds * 1e9 / instructions);
+    puts("}");
+}
+
+// Evaluates the conditions of a compiled program at random cells
+void benchConditions(const BenchProgram *program, const BenchGrid *bench) {
+    Condition conditions[16];
+    size_t conditionCount = 0;
+    for (size_t i = 0; i < program->program.size && conditionCount < countof(conditions); i++) {
+        const Instruction *instr = &program->program.code[i];
+        if ((instr->op == OP_IF || instr->op == OP_LOOP) && instr->condition != CONDITION_ALWAYS)
+            conditions[conditionCount++] = instr->condition;
+    }
+    if (conditionCount == 0) return;
+
+    Robot *robots = nmallocT(Robot, BENCH_CONDITION_POSITIONS);
+    uint64_t state = 6;
+    for (size_t i = 0; i < BENCH_CONDITION_POSITIONS; i++) {
+        robots[i] = makeRobot();
+        robots[i].posX = benchRandom(&state) % bench->width;
+        robots[i].posY = benchRandom(&state) % bench->height;
+    }
+
+    size_t iterations = 0, trueCount = 0;
+    double seconds = 0;
+    do {
+        double start = getTimeSeconds();
+        for (size_t round = 0; round < BENCH_CONDITION_ROUNDS; round++) {
+            Condition condition = conditions[round % conditionCount];
+            for (size_t i = 0; i < BENCH_CONDITION_POSITIONS; i++)
+                trueCount += _m_solveCondition(condition, &robots[i], &bench->grid);
+        }
+        seconds += getTimeSeconds() - start;
+        iterations++;
+    } while (seconds < m_benchMinSeconds);
+    free(robots);
+
+    size_t evaluations = iterations * BENCH_CONDITION_ROUNDS * BENCH_CONDITION_POSITIONS;
+    printf("{\"bench\":\"condition\",\"program\":\"%s\",\"grid\":\"%s\",\"conditions\":%zu,\"evaluations\":%zu,"
+           "\"true\":%zu,\"seconds\":%.9f,\"ns_per_condition\":%.3f}\n",
+           program->name, bench->name, conditionCount, evaluations, trueCount, seconds, seconds * 1e9 / evaluations);
+}
+
+long getFileSize(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+void benchGridFile(const BenchGrid *bench, const char *filename) {
+    size_t iterations = 0;
+    double dumpSeconds = 0, loadSeconds = 0;
+    bool valid = true;
+    do {
+        double start = getTimeSeconds();
+        valid = dumpGrid(&bench->grid, filename, 0, 0) == EXIT_SUCCESS;
+        dumpSeconds += getTimeSeconds() - start;
+
+        Grid grid = makeGrid();
+        int robotPosX, robotPosY;
+        start = getTimeSeconds();
+        valid = valid && loadGridFromFile(&grid, filename, &robotPosX, &robotPosY) == EXIT_SUCCESS;
+        loadSeconds += getTimeSeconds() - start;
+        if (valid) freeGrid(&grid);
+        iterations++;
+    } while (valid && dumpSeconds + loadSeconds < m_benchMinSeconds);
+
+    long bytes = getFileSize(filename);
+    remove(filename);
+    dumpSeconds /= iterations;
+    loadSeconds /= iterations;
+    double cells = (double)bench->width * bench->height;
+    printf("{\"bench\":\"grid_io\",\"grid\":\"%s\",\"ok\":%s,\"width\":%d,\"height\":%d,\"walls\":%zu,\"bytes\":%ld,\"iterations\":%zu,"
+           "\"dump_seconds\":%.9f,\"dump_mb_per_sec\":%.3f,\"load_seconds\":%.9f,\"load_mb_per_sec\":%.3f,\"load_cells_per_sec\":%.0f}\n",
+           bench->name, btos(valid), bench->width, bench->height, countGridCells(&bench->grid, GRID_CELL_WALL), bytes, iterations,
+           dumpSeconds, bytes / dumpSeconds / 1e6, loadSeconds, bytes / loadSeconds / 1e6, cells / loadSeconds);
+}
+
+// Drawing and encoding the PNG, both in memory
+void benchThumbnail(const BenchGrid *bench) {
+    Robot robot = makeRobot();
+    size_t iterations = 0, bytes = 0;
+    int width = 0, height = 0;
+    double start = getTimeSeconds(), seconds;
+    do {
+        Thumbnail thumbnail;
+        renderThumbnail(&thumbnail, &bench->grid, &robot, THUMBNAIL_DEFAULT_CELL_SIZE);
+        unsigned char *png = encodeThumbnail(&thumbnail, &bytes);
+        width = thumbnail.width;
+        height = thumbnail.height;
+        free(png);
+        freeThumbnail(&thumbnail);
+        iterations++;
+        seconds = getTimeSeconds() - start;
+    } while (seconds < m_benchMinSeconds);
+
+    seconds /= iterations;
+    printf("{\"bench\":\"thumbnail\",\"grid\":\"%s\",\"width\":%d,\"height\":%d,\"bytes\":%zu,\"iterations\":%zu,"
+           "\"seconds\":%.9f,\"thumbnails_per_sec\":%.1f,\"megapixels_per_sec\":%.3f}\n",
+           bench->name, width, height, bytes, iterations, seconds, 1 / seconds, (double)width * height / seconds / 1e6);
+}
+
+// Grading a finished run against a spec asking for no paint, so every
+// allocated tile has to be looked at
+void benchVerify(const BenchGrid *bench) {
+    GradeSpec spec = { .gridName = NULL, .checkPos = false, .cells = NULL, .cellCount = 0 };
+    GradeTarget target;
+    makeGradeTarget(&target, &spec, bench->width, bench->height);
+    Robot robot = makeRobot();
+    size_t iterations = 0;
+    bool passed = true;
+    double start = getTimeSeconds(), seconds;
+    do {
+        int mismatchX, mismatchY;
+        passed = passed && verifyOutcome(&spec, &target, INTERPRETER_FINISHED, &robot, &bench->grid, &mismatchX, &mismatchY) == GRADE_PASS;
+        iterations++;
+        seconds = getTimeSeconds() - start;
+    } while (seconds < m_benchMinSeconds);
+    freeGradeTarget(&target);
+
+    seconds /= iterations;
+    printf("{\"bench\":\"verify\",\"grid\":\"%s\",\"ok\":%s,\"tiles\":%zu,\"iterations\":%zu,\"seconds\":%.9f,\"ns_per_tile\":%.3f}\n",
+           bench->name, btos(passed), bench->grid.tileCount, iterations, seconds,
+           seconds * 1e9 / (bench->grid.tileCount > 0 ? bench->grid.tileCount : 1));
+}
+
+// One sweep against a run from every start cell one after another, each
+// on its own copy of the grid as check would do
+void benchSweep(const BenchProgram *program, const BenchGrid *bench) {
+    InterpreterLimits limits = makeDefaultLimits();
+    limits.maxSteps = BENCH_MAX_STEPS;
+    size_t iterations = 0, starts = 0;
+    double start = getTimeSeconds(), sweepSeconds;
+    do {
+        Sweep sweep;
+        sweepProgram(&sweep, &program->program, &bench->grid, NULL, limits);
+        starts = sweep.count;
+        freeSweep(&sweep);
+        iterations++;
+        sweepSeconds = getTimeSeconds() - start;
+    } while (sweepSeconds < m_benchMinSeconds);
+    sweepSeconds /= iterations;
+
+    size_t runIterations = 0;
+    double runSeconds;
+    start = getTimeSeconds();
+    do {
+        for (int y = 0; y < bench->height; y++) {
+            for (int x = 0; x < bench->width; x++) {
+                if (isGridCellWall(&bench->grid, x, y)) continue;
+                Grid grid;
+                copyGrid(&grid, &bench->grid);
+                Robot robot = { .posX = x, .posY = y };
+                Interpreter interpreter;
+                initInterpreter(&interpreter, &program->program, &robot, &grid);
+                setInterpreterLimits(&interpreter, limits);
+                runInterpreter(&interpreter);
+                freeInterpreter(&interpreter);
+                freeGrid(&grid);
+            }
+        }
+        runIterations++;
+        runSeconds = getTimeSeconds() - start;
+    } while (runSeconds < m_benchMinSeconds);
+    runSeconds /= runIterations;
+
+    printf("{\"bench\":\"sweep\",\"program\":\"%s\",\"grid\":\"%s\",\"starts\":%zu,\"iterations\":%zu,\"seconds\":%.9f,"
+           "\"run_seconds\":%.9f,\"ns_per_start\":%.3f,\"speedup\":%.2f}\n",
+           program->name, bench->name, starts, iterations, sweepSeconds, runSeconds,
+           sweepSeconds * 1e9 / (starts > 0 ? starts : 1), runSeconds / sweepSeconds);
+}
+
+// Peak resident set size of the whole bench in kilobytes, 0 if unknown
+long getPeakMemoryKb() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+int main(int argc, const char **argv) {
+    const char *corpus = KUMAR_BENCH_CORPUS;
+    for (int i = 1; i < argc; i++) {
+        if (streq(argv[i], "--min-time") && i + 1 < argc)
+            m_benchMinSeconds = atof(argv[++i]);
+        else
+            corpus = argv[i];
+    }
+
+    printf("{\"bench\":\"meta\",\"cache_version\":%d,\"min_seconds\":%.3f,\"corpus\":\"%s\"}\n",
+           KUMAR_CACHE_VERSION, m_benchMinSeconds, corpus);
+
+    for (size_t i = 0; i < countof(m_benchPrograms); i++) {
+        BenchProgram *bench = &m_benchPrograms[i];
+        bench->source = bench->filename != NULL ? readBenchFile(corpus, bench->filename) : generateBenchSource(BENCH_GENERATED_BLOCKS);
+        if (bench->source == NULL) return EXIT_FAILURE;
+        bench->lineCount = countLines(bench->source);
+        size_t lineNum;
+        InterpreterExitCode code = compileProgramSource(bench->source, LANG_RU, &bench->program, &lineNum);
+        if (code != INTERPRETER_NORMAL) {
+            printErrcode(code, lineNum);
+            return EXIT_FAILURE;
+        }
+        benchCompile(bench);
+    }
+
+    for (size_t i = 0; i < countof(m_benchGrids); i++) {
+        generateBenchGrid(&m_benchGrids[i]);
+        char filename[FILENAME_MAX_LENGTH];
+        snprintf(filename, sizeof(filename), "kumar_bench_%s." GRID_EXTENSION, m_benchGrids[i].name);
+        benchGridFile(&m_benchGrids[i], filename);
+        benchThumbnail(&m_benchGrids[i]);
+        benchVerify(&m_benchGrids[i]);
+    }
+
+    for (size_t i = 0; i < countof(m_benchCases); i++) {
+        const BenchProgram *program = findBenchProgram(m_benchCases[i].program);
+        const BenchGrid *grid = findBenchGrid(m_benchCases[i].grid);
+        benchRun(program, grid, false);
+        benchRun(program, grid, true);
+    }
+    benchConditions(findBenchProgram("nested"), findBenchGrid("walls"));
+    for (size_t i = 0; i < countof(m_benchSweeps); i++)
+        benchSweep(findBenchProgram(m_benchSweeps[i].program), findBenchGrid(m_benchSweeps[i].grid));
+
+    printf("{\"bench\":\"memory\",\"peak_rss_kb\":%ld}\n", getPeakMemoryKb());
+
+    for (size_t i = 0; i < countof(m_benchPrograms); i++) {
+        freeProgram(&m_benchPrograms[i].program);
+        free(m_benchPrograms[i].source);
+    }
+    for (size_t i = 0; i < countof(m_benchGrids); i++)
+        freeGrid(&m_benchGrids[i].grid);
+    return EXIT_SUCCESS;
+}
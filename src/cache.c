@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cache.h"
+
+
+static uint64_t _m_hashMix(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+    return hash ^ (hash >> 31);
+}
+
+static void _m_hashKeyValue(CacheKey *key, uint64_t value) {
+    key->hash[0] = _m_hashMix(key->hash[0], value);
+    key->hash[1] = _m_hashMix(key->hash[1], ~value);
+}
+
+CacheKey makeCacheKey() {
+    CacheKey key = { .hash = { 0x6B756D6172ull, 0x63616368ull } };
+    _m_hashKeyValue(&key, KUMAR_CACHE_VERSION);
+    return key;
+}
+
+void hashProgram(CacheKey *key, const Program *program) {
+    _m_hashKeyValue(key, program->size);
+    for (size_t i = 0; i < program->size; i++) {
+        const Instruction *instr = &program->code[i];
+        _m_hashKeyValue(key, instr->op);
+        _m_hashKeyValue(key, instr->target);
+        _m_hashKeyValue(key, instr->condition);
+        _m_hashKeyValue(key, ((uint64_t)(uint32_t)instr->x << 32) | (uint32_t)instr->y);
+    }
+}
+
+void hashGridContent(CacheKey *key, const Grid *grid, int robotPosX, int robotPosY) {
+    _m_hashKeyValue(key, ((uint64_t)(uint32_t)grid->width << 32) | (uint32_t)grid->height);
+    _m_hashKeyValue(key, ((uint64_t)(uint32_t)robotPosX << 32) | (uint32_t)robotPosY);
+    int x, y;
+    CellType type;
+    GridCellIterator it = makeGridCellIterator();
+    while (nextGridMarkedCell(grid, &it, &x, &y, &type))
+        _m_hashKeyValue(key, ((uint64_t)type << 62) | ((uint64_t)(uint32_t)y << 31) | (uint32_t)x);
+}
+
+void hashLimits(CacheKey *key, const InterpreterLimits *limits) {
+    _m_hashKeyValue(key, limits->maxSteps);
+    _m_hashKeyValue(key, limits->detectLoops);
+}
+
+CacheKey makeGridCacheKey(const Grid *grid, int robotPosX, int robotPosY) {
+    CacheKey key = makeCacheKey();
+    hashGridContent(&key, grid, robotPosX, robotPosY);
+    return key;
+}
+
+CacheKey makeRunCacheKey(const Program *program, const CacheKey *gridKey, const InterpreterLimits *limits) {
+    CacheKey key = makeCacheKey();
+    hashProgram(&key, program);
+    _m_hashKeyValue(&key, gridKey->hash[0]);
+    _m_hashKeyValue(&key, gridKey->hash[1]);
+    hashLimits(&key, limits);
+    return key;
+}
+
+static char *_m_getCachePath(const char *dir, const CacheKey *key) {
+    size_t length = strlen(dir) + 48;
+    char *path = nmallocT(char, length);
+    snprintf(path, length, "%s/%016llx%016llx." CACHE_FILE_EXTENSION, dir,
+             (unsigned long long)key->hash[0], (unsigned long long)key->hash[1]);
+    return path;
+}
+
+static bool _m_isCacheableResult(InterpreterExitCode code) {
+    return code != INTERPRETER_TIMEOUT && code != INTERPRETER_NORMAL && code != INTERPRETER_SKIP_LINE;
+}
+
+bool loadCachedRun(const char *dir, const CacheKey *key, const Program *program, Robot *robot, Grid *grid, RunResult *result) {
+    char *path = _m_getCachePath(dir, key);
+    FILE *file = fopen(path, "rb");
+    free(path);
+    if (file == NULL)
+        return false;
+
+    // Nothing in the file is trusted: the painted cells have to fill the
+    // rest of it exactly, and the robot and the cells have to be on free
+    // cells of this grid
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    CacheFileHeader header;
+    bool valid = fileSize >= (long)sizeof(header)
+        && fread(&header, sizeof(header), 1, file) == 1
+        && !memcmp(header.magic, CACHE_FILE_MAGIC, 4)
+        && header.version == KUMAR_CACHE_VERSION
+        && !memcmp(&header.key, key, sizeof(CacheKey))
+        && _m_isCacheableResult((InterpreterExitCode)header.code)
+        && header.code <= INTERPRETER_INFINITE_LOOP
+        && header.pc <= program->size
+        && header.paintedCount <= (uint64_t)grid->width * grid->height
+        && header.paintedCount == (uint64_t)(fileSize - sizeof(header)) / (sizeof(int32_t) * 2)
+        && (uint64_t)(fileSize - sizeof(header)) % (sizeof(int32_t) * 2) == 0
+        && !isGridCellWall(grid, header.robotPosX, header.robotPosY);
+    int32_t *cells = NULL;
+    if (valid) {
+        cells = nmallocT(int32_t, (header.paintedCount * 2 + 1));
+        valid = cells != NULL && fread(cells, sizeof(int32_t) * 2, header.paintedCount, file) == header.paintedCount;
+    }
+    fclose(file);
+    // isGridCellWall is also true off the field
+    for (uint64_t i = 0; valid && i < header.paintedCount; i++) {
+        if (isGridCellWall(grid, cells[i * 2], cells[i * 2 + 1]))
+            valid = false;
+    }
+    if (!valid) {
+        free(cells);
+        return false;
+    }
+
+    int x, y;
+    CellType type;
+    GridCellIterator it = makeGridCellIterator();
+    while (nextGridMarkedCell(grid, &it, &x, &y, &type)) {
+        if (type == GRID_CELL_FILLED)
+            setGridCell(grid, x, y, GRID_CELL_EMPTY);
+    }
+    for (uint64_t i = 0; i < header.paintedCount; i++)
+        setGridCell(grid, cells[i * 2], cells[i * 2 + 1], GRID_CELL_FILLED);
+    free(cells);
+
+    robot->posX = header.robotPosX;
+    robot->posY = header.robotPosY;
+    *result = (RunResult){
+        .code = (InterpreterExitCode)header.code,
+        .line = getInstructionLine(program, header.pc),
+        .steps = header.steps,
+        .pc = header.pc
+    };
+    return true;
+}
+
+static unsigned m_cacheTempCounter = 0;
+
+// The entry is written under a temporary name and renamed into place, so
+// concurrent runs never read a partially written file
+void storeCachedRun(const char *dir, const CacheKey *key, const Robot *robot, const Grid *grid, const RunResult *result) {
+    if (!_m_isCacheableResult(result->code))
+        return;
+#ifdef _WIN32
+    mkdir(dir);
+#else
+    mkdir(dir, 0777);
+#endif
+
+    CacheFileHeader header = {
+        .magic = CACHE_FILE_MAGIC,
+        .version = KUMAR_CACHE_VERSION,
+        .key = *key,
+        .code = result->code,
+        .robotPosX = robot->posX,
+        .robotPosY = robot->posY,
+        .reserved = 0,
+        .pc = result->pc,
+        .steps = result->steps,
+        .paintedCount = countGridCells(grid, GRID_CELL_FILLED)
+    };
+
+    char *path = _m_getCachePath(dir, key);
+    size_t tempLength = strlen(path) + 32;
+    char *tempPath = nmallocT(char, tempLength);
+    snprintf(tempPath, tempLength, "%s.%d.%u.tmp", path, (int)getpid(),
+             __atomic_fetch_add(&m_cacheTempCounter, 1, __ATOMIC_RELAXED));
+
+    FILE *file = fopen(tempPath, "wb");
+    if (file != NULL) {
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+        int x, y;
+        CellType type;
+        GridCellIterator it = makeGridCellIterator();
+        while (written && nextGridMarkedCell(grid, &it, &x, &y, &type)) {
+            if (type != GRID_CELL_FILLED) continue;
+            int32_t cell[2] = { x, y };
+            written = fwrite(cell, sizeof(cell), 1, file) == 1;
+        }
+        written = fclose(file) == 0 && written;
+        if (!written || rename(tempPath, path) != 0)
+            remove(tempPath);
+    }
+    free(tempPath);
+    free(path);
+}
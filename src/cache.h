@@ -0,0 +1,59 @@
+#include <stdint.h>
+
+#include "interpreter.h"
+
+#ifndef KUMIR_CACHE_H
+#define KUMIR_CACHE_H
+
+
+// Results of finished runs are kept in a directory, one file per
+// (program, grid, limits) key. The program is hashed after compilation,
+// so comments, blank lines, indentation and the keyword language do not
+// change the key, and the stored pc is mapped back to the line numbers
+// of whichever source hit the entry. Bump KUMAR_CACHE_VERSION whenever
+// the interpreter starts producing different results: old entries then
+// no longer match and are ignored
+#define KUMAR_CACHE_VERSION 1
+#define CACHE_FILE_MAGIC "KUMC"
+#define CACHE_FILE_EXTENSION "kum_cache"
+
+typedef struct CacheKey {
+    uint64_t hash[2];
+} CacheKey;
+
+CacheKey makeCacheKey(void);
+
+void hashProgram(CacheKey *key, const Program *program);
+
+// Only walls and painted cells are hashed, so the key does not depend
+// on which tiles happen to be allocated
+void hashGridContent(CacheKey *key, const Grid *grid, int robotPosX, int robotPosY);
+
+// The time limit is left out: timed out runs are never stored
+void hashLimits(CacheKey *key, const InterpreterLimits *limits);
+
+CacheKey makeGridCacheKey(const Grid *grid, int robotPosX, int robotPosY);
+
+CacheKey makeRunCacheKey(const Program *program, const CacheKey *gridKey, const InterpreterLimits *limits);
+
+typedef struct CacheFileHeader {
+    char magic[4];
+    uint32_t version;
+    CacheKey key;
+    uint32_t code;
+    int32_t robotPosX;
+    int32_t robotPosY;
+    uint32_t reserved;
+    uint64_t pc;
+    uint64_t steps;
+    uint64_t paintedCount;
+} CacheFileHeader;
+
+// On a hit the robot, the paint of the grid and the result are replaced
+// with the stored final state and true is returned
+bool loadCachedRun(const char *dir, const CacheKey *key, const Program *program, Robot *robot, Grid *grid, RunResult *result);
+
+void storeCachedRun(const char *dir, const CacheKey *key, const Robot *robot, const Grid *grid, const RunResult *result);
+
+
+#endif // !KUMIR_CACHE_H
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grade.h"
+
+
+const char *getGradeVerdictName(GradeVerdict verdict) {
+    switch (verdict) {
+    case GRADE_PASS: return "ok";
+    case GRADE_COMPILE_ERROR: return "compile_error";
+    case GRADE_LOAD_FAILED: return "load_failed";
+    case GRADE_RUNTIME_ERROR: return "runtime_error";
+    case GRADE_WRONG_POSITION: return "wrong_position";
+    case GRADE_WRONG_PAINT: return "wrong_paint";
+    case GRADE_NO_SPEC: return "no_spec";
+    default: return "unknown";
+    }
+}
+
+const char *getFileBasename(const char *path) {
+    const char *name = path;
+    for (const char *c = path; *c != '\0'; c++) {
+        if (*c == '/' || *c == '\\')
+            name = c + 1;
+    }
+    return name;
+}
+
+void freeGradeSpecs(GradeSpec *specs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(specs[i].gridName);
+        free(specs[i].cells);
+    }
+    free(specs);
+}
+
+int loadGradeSpecs(const char *filename, GradeSpec **specs, size_t *count) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        puts("Failed to open spec file");
+        return EXIT_FAILURE;
+    }
+
+    *specs = NULL;
+    *count = 0;
+    char line[GRADE_SPEC_MAX_LINE_LENGTH];
+    size_t lineNum = 0;
+    while (fgets(line, GRADE_SPEC_MAX_LINE_LENGTH, file) != NULL) {
+        lineNum++;
+        char *token = strtok(line, " \t\r\n");
+        if (token == NULL || token[0] == '#') continue;
+
+        GradeSpec spec = { .gridName = strdup(token), .checkPos = false, .cells = NULL, .cellCount = 0 };
+        char *xStr = strtok(NULL, " \t\r\n");
+        char *yStr = strtok(NULL, " \t\r\n");
+        bool valid = xStr != NULL && yStr != NULL;
+        if (valid && !(streq(xStr, "-") && streq(yStr, "-"))) {
+            spec.checkPos = true;
+            spec.posX = atoi(xStr);
+            spec.posY = atoi(yStr);
+        }
+        while (valid && (token = strtok(NULL, " \t\r\n")) != NULL) {
+            int x, y;
+            if (sscanf(token, "%d,%d", &x, &y) != 2) {
+                valid = false;
+                break;
+            }
+            spec.cells = (int *)realloc(spec.cells, (spec.cellCount + 1) * 2 * sizeof(int));
+            spec.cells[spec.cellCount * 2] = x;
+            spec.cells[spec.cellCount * 2 + 1] = y;
+            spec.cellCount++;
+        }
+        if (!valid) {
+            printf("Invalid spec at line %zu\n", lineNum);
+            free(spec.gridName);
+            free(spec.cells);
+            freeGradeSpecs(*specs, *count);
+            fclose(file);
+            return EXIT_FAILURE;
+        }
+
+        *specs = (GradeSpec *)realloc(*specs, (*count + 1) * sizeof(GradeSpec));
+        (*specs)[(*count)++] = spec;
+    }
+    fclose(file);
+    return EXIT_SUCCESS;
+}
+
+const GradeSpec *findGradeSpec(const GradeSpec *specs, size_t count, const char *gridFilename) {
+    const char *name = getFileBasename(gridFilename);
+    for (size_t i = 0; i < count; i++) {
+        if (streq(specs[i].gridName, name))
+            return &specs[i];
+    }
+    return NULL;
+}
+
+void makeGradeTarget(GradeTarget *target, const GradeSpec *spec, int width, int height) {
+    target->tilesX = (width + GRID_TILE_MASK) >> GRID_TILE_SHIFT;
+    target->tilesY = (height + GRID_TILE_MASK) >> GRID_TILE_SHIFT;
+    target->tiles = (uint64_t ***)calloc(target->tilesY, sizeof(uint64_t **));
+    target->cellCount = 0;
+    target->reachable = true;
+    for (size_t i = 0; i < spec->cellCount; i++) {
+        int x = spec->cells[i * 2], y = spec->cells[i * 2 + 1];
+        if (x < 0 || x >= width || y < 0 || y >= height) {
+            target->reachable = false;
+            continue;
+        }
+        uint64_t **tileRow = target->tiles[y >> GRID_TILE_SHIFT];
+        if (tileRow == NULL)
+            tileRow = target->tiles[y >> GRID_TILE_SHIFT] = (uint64_t **)calloc(target->tilesX, sizeof(uint64_t *));
+        uint64_t *rows = tileRow[x >> GRID_TILE_SHIFT];
+        if (rows == NULL)
+            rows = tileRow[x >> GRID_TILE_SHIFT] = (uint64_t *)calloc(GRID_TILE_SIZE, sizeof(uint64_t));
+        uint64_t bit = (uint64_t)1 << (x & GRID_TILE_MASK);
+        if (rows[y & GRID_TILE_MASK] & bit)
+            continue;
+        rows[y & GRID_TILE_MASK] |= bit;
+        target->cellCount++;
+    }
+}
+
+void freeGradeTarget(GradeTarget *target) {
+    for (int tileY = 0; tileY < target->tilesY; tileY++) {
+        if (target->tiles[tileY] == NULL) continue;
+        for (int tileX = 0; tileX < target->tilesX; tileX++)
+            free(target->tiles[tileY][tileX]);
+        free(target->tiles[tileY]);
+    }
+    free(target->tiles);
+    target->tiles = NULL;
+}
+
+static const uint64_t *_m_getGradeTargetTile(const GradeTarget *target, int tileX, int tileY) {
+    uint64_t **tileRow = target->tiles[tileY];
+    return tileRow == NULL ? NULL : tileRow[tileX];
+}
+
+static int _m_lowestBit(uint64_t word) {
+    int bit = 0;
+    while (!(word >> bit & 1))
+        bit++;
+    return bit;
+}
+
+// Compares every allocated tile with the target. Wanted cells in tiles
+// the grid never allocated are unpainted; they are found by counting how
+// many wanted cells the allocated tiles covered
+static bool _m_findPaintMismatch(const GradeTarget *target, const Grid *grid, int *mismatchX, int *mismatchY) {
+    size_t covered = 0;
+    for (int tileY = 0; tileY < grid->tilesY; tileY++) {
+        if (grid->tiles[tileY] == NULL) continue;
+        for (int tileX = 0; tileX < grid->tilesX; tileX++) {
+            const unsigned char *tile = getGridTile(grid, tileX, tileY);
+            if (tile == NULL) continue;
+            const uint64_t *wanted = _m_getGradeTargetTile(target, tileX, tileY);
+            for (int row = 0; row < GRID_TILE_SIZE; row++) {
+                uint64_t wantedRow = wanted != NULL ? wanted[row] : 0;
+                uint64_t diff = getGridTileRowMask(tile, row, GRID_CELL_FILLED) ^ wantedRow;
+                if (diff != 0) {
+                    *mismatchX = (tileX << GRID_TILE_SHIFT) + _m_lowestBit(diff);
+                    *mismatchY = (tileY << GRID_TILE_SHIFT) + row;
+                    return true;
+                }
+                covered += countWordBits(wantedRow);
+            }
+        }
+    }
+    if (covered == target->cellCount)
+        return false;
+
+    for (int tileY = 0; tileY < target->tilesY; tileY++) {
+        for (int tileX = 0; tileX < target->tilesX; tileX++) {
+            const uint64_t *wanted = _m_getGradeTargetTile(target, tileX, tileY);
+            if (wanted == NULL || getGridTile(grid, tileX, tileY) != NULL) continue;
+            for (int row = 0; row < GRID_TILE_SIZE; row++) {
+                if (wanted[row] == 0) continue;
+                *mismatchX = (tileX << GRID_TILE_SHIFT) + _m_lowestBit(wanted[row]);
+                *mismatchY = (tileY << GRID_TILE_SHIFT) + row;
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+GradeVerdict verifyOutcome(const GradeSpec *spec, const GradeTarget *target, InterpreterExitCode code, const Robot *robot, const Grid *grid,
+                           int *mismatchX, int *mismatchY) {
+    *mismatchX = -1;
+    *mismatchY = -1;
+    if (spec == NULL)
+        return GRADE_NO_SPEC;
+    if (code != INTERPRETER_FINISHED && code != INTERPRETER_FORCE_EXIT)
+        return GRADE_RUNTIME_ERROR;
+    if (spec->checkPos && (robot->posX != spec->posX || robot->posY != spec->posY))
+        return GRADE_WRONG_POSITION;
+    if (!target->reachable || target->tilesX != grid->tilesX || target->tilesY != grid->tilesY)
+        return GRADE_WRONG_PAINT;
+    if (_m_findPaintMismatch(target, grid, mismatchX, mismatchY))
+        return GRADE_WRONG_PAINT;
+    return GRADE_PASS;
+}
+
+static void _m_writeCsvField(FILE *file, const char *str) {
+    if (strpbrk(str, ",\"\n") == NULL) {
+        fputs(str, file);
+        return;
+    }
+    fputc('"', file);
+    for (const char *c = str; *c != '\0'; c++) {
+        if (*c == '"') fputc('"', file);
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void _m_writeJsonString(FILE *file, const char *str) {
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+void writeGradeCsv(FILE *file, const GradeResult *results, size_t count) {
+    fputs("submission,grid,result,reason,code,line,steps,x,y,time_ms\n", file);
+    for (size_t i = 0; i < count; i++) {
+        const GradeResult *result = &results[i];
+        _m_writeCsvField(file, result->submission);
+        fputc(',', file);
+        _m_writeCsvField(file, result->grid);
+        fprintf(file, ",%s,%s,%s,%zu,%zu,%d,%d,%.3f\n",
+                result->verdict == GRADE_PASS ? "pass" : "fail", getGradeVerdictName(result->verdict),
+                getErrcodeName(result->run.code), result->run.line, result->run.steps,
+                result->robotPosX, result->robotPosY, result->seconds * 1000);
+    }
+}
+
+void writeGradeJson(FILE *file, const GradeResult *results, size_t count) {
+    fputs("[\n", file);
+    for (size_t i = 0; i < count; i++) {
+        const GradeResult *result = &results[i];
+        fputs("  {\"submission\":", file);
+        _m_writeJsonString(file, result->submission);
+        fputs(",\"grid\":", file);
+        _m_writeJsonString(file, result->grid);
+        fprintf(file, ",\"pass\":%s,\"reason\":\"%s\",\"code\":\"%s\",\"line\":%zu,\"steps\":%zu,\"x\":%d,\"y\":%d,",
+                result->verdict == GRADE_PASS ? "true" : "false", getGradeVerdictName(result->verdict),
+                getErrcodeName(result->run.code), result->run.line, result->run.steps,
+                result->robotPosX, result->robotPosY);
+        if (result->mismatchX >= 0)
+            fprintf(file, "\"mismatch\":[%d,%d],", result->mismatchX, result->mismatchY);
+        fprintf(file, "\"time_ms\":%.3f}%s\n", result->seconds * 1000, i + 1 < count ? "," : "");
+    }
+    fputs("]\n", file);
+}
+
+int writeGradeReport(const char *filename, GradeReportWriter writer, const GradeResult *results, size_t count) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        puts("Failed to open report file");
+        return EXIT_FAILURE;
+    }
+    writer(file, results, count);
+    fclose(file);
+    return EXIT_SUCCESS;
+}
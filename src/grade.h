@@ -0,0 +1,91 @@
+#include <stdio.h>
+
+#include "interpreter.h"
+
+#ifndef KUMIR_GRADE_H
+#define KUMIR_GRADE_H
+
+
+// Expected outcome of a task on one grid. Spec files hold one line per
+// grid: the grid file name, the required final position ("-" for any)
+// and the cells that have to end up painted, e.g.
+//     task1.kum_grid  5 7  1,2 1,3 1,4
+// No other cell may be painted. Lines starting with '#' are comments
+typedef struct GradeSpec {
+    char *gridName;
+    bool checkPos;
+    int posX;
+    int posY;
+    int *cells;
+    size_t cellCount;
+} GradeSpec;
+
+typedef enum {
+    GRADE_PASS,
+    GRADE_COMPILE_ERROR,
+    GRADE_LOAD_FAILED,
+    GRADE_RUNTIME_ERROR,
+    GRADE_WRONG_POSITION,
+    GRADE_WRONG_PAINT,
+    GRADE_NO_SPEC  // the spec has no line for the grid, so nothing can pass on it
+} GradeVerdict;
+
+const char *getGradeVerdictName(GradeVerdict verdict);
+
+const char *getFileBasename(const char *path);
+
+void freeGradeSpecs(GradeSpec *specs, size_t count);
+
+#define GRADE_SPEC_MAX_LINE_LENGTH 4096
+
+int loadGradeSpecs(const char *filename, GradeSpec **specs, size_t *count);
+
+const GradeSpec *findGradeSpec(const GradeSpec *specs, size_t count, const char *gridFilename);
+
+// The cells a spec wants painted, laid out like the tiles of the grid it
+// is for: a tile with wanted cells gets a word per row and a bit per cell
+// (see getGridTileRowMask), so checking a run takes a compare per row of
+// every allocated tile, however large the field. Built once per grid. A
+// cell named twice counts once; a spec that names a cell outside the grid
+// can never be met
+typedef struct GradeTarget {
+    int tilesX;
+    int tilesY;
+    uint64_t ***tiles;
+    size_t cellCount;
+    bool reachable;
+} GradeTarget;
+
+void makeGradeTarget(GradeTarget *target, const GradeSpec *spec, int width, int height);
+
+void freeGradeTarget(GradeTarget *target);
+
+// A grid without a spec line is never a pass, so a misspelt grid name in
+// the spec can't wave every submission through. The target must be the
+// spec's. On wrong paint the first cell that differs,
+// in tile order, goes to mismatchX and mismatchY, which are -1 otherwise
+GradeVerdict verifyOutcome(const GradeSpec *spec, const GradeTarget *target, InterpreterExitCode code, const Robot *robot, const Grid *grid,
+                           int *mismatchX, int *mismatchY);
+
+typedef struct GradeResult {
+    const char *submission;
+    const char *grid;
+    GradeVerdict verdict;
+    RunResult run;
+    int robotPosX;
+    int robotPosY;
+    int mismatchX;
+    int mismatchY;
+    double seconds;
+} GradeResult;
+
+void writeGradeCsv(FILE *file, const GradeResult *results, size_t count);
+
+void writeGradeJson(FILE *file, const GradeResult *results, size_t count);
+
+typedef void (*GradeReportWriter)(FILE *file, const GradeResult *results, size_t count);
+
+int writeGradeReport(const char *filename, GradeReportWriter writer, const GradeResult *results, size_t count);
+
+
+#endif // !KUMIR_GRADE_H
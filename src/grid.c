@@ -0,0 +1,695 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "grid.h"
+
+
+// paintHash is the XOR of a fixed random key per painted cell (Zobrist
+// hashing), so painting or clearing a cell updates it in O(1)
+static uint64_t _m_getGridCellKey(int x, int y) {
+    uint64_t z = (((uint64_t)(uint32_t)y << 32) | (uint32_t)x) + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+Grid makeGrid() {
+    return (Grid){ .width = GRID_DEFAULT_SIZE, .height = GRID_DEFAULT_SIZE, .tiles = NULL, .changedTiles = NULL };
+}
+
+void generateGridData(Grid *grid) {
+    grid->tilesX = (grid->width + GRID_TILE_MASK) >> GRID_TILE_SHIFT;
+    grid->tilesY = (grid->height + GRID_TILE_MASK) >> GRID_TILE_SHIFT;
+    grid->tiles = (unsigned char ***)calloc(grid->tilesY, sizeof(unsigned char **));
+    grid->tileCount = 0;
+    grid->paintHash = 0;
+    grid->wallRows = (GridWallLine **)calloc(grid->tilesY, sizeof(GridWallLine *));
+    grid->wallColumns = (GridWallLine **)calloc(grid->tilesX, sizeof(GridWallLine *));
+}
+
+// Besides the tiles every row and column keeps the sorted list of its
+// wall cells, so the free run from a cell up to the next wall is one
+// binary search. Like the tiles, the lists are grouped by GRID_TILE_SIZE
+// rows (columns) and a group is only allocated once it holds a wall
+static void _m_freeGridWallLines(GridWallLine **groups, int groupCount) {
+    if (groups == NULL) return;
+    for (int group = 0; group < groupCount; group++) {
+        if (groups[group] == NULL) continue;
+        for (int i = 0; i < GRID_TILE_SIZE; i++)
+            free(groups[group][i].walls);
+        free(groups[group]);
+    }
+    free(groups);
+}
+
+static GridWallLine **_m_copyGridWallLines(GridWallLine *const *groups, int groupCount) {
+    GridWallLine **copy = (GridWallLine **)calloc(groupCount, sizeof(GridWallLine *));
+    for (int group = 0; group < groupCount; group++) {
+        if (groups[group] == NULL) continue;
+        copy[group] = (GridWallLine *)calloc(GRID_TILE_SIZE, sizeof(GridWallLine));
+        for (int i = 0; i < GRID_TILE_SIZE; i++) {
+            const GridWallLine *line = &groups[group][i];
+            if (line->count == 0) continue;
+            copy[group][i] = (GridWallLine){
+                .walls = nmallocT(int, line->count),
+                .count = line->count,
+                .capacity = line->count
+            };
+            memcpy(copy[group][i].walls, line->walls, line->count * sizeof(int));
+        }
+    }
+    return copy;
+}
+
+void freeGrid(Grid *grid) {
+    for (int tileY = 0; tileY < grid->tilesY; tileY++) {
+        if (grid->tiles[tileY] == NULL) continue;
+        for (int tileX = 0; tileX < grid->tilesX; tileX++)
+            free(grid->tiles[tileY][tileX]);
+        free(grid->tiles[tileY]);
+    }
+    free(grid->tiles);
+    grid->tiles = NULL;
+    grid->tileCount = 0;
+    _m_freeGridWallLines(grid->wallRows, grid->tilesY);
+    _m_freeGridWallLines(grid->wallColumns, grid->tilesX);
+    grid->wallRows = NULL;
+    grid->wallColumns = NULL;
+    free(grid->changedTiles);
+    grid->changedTiles = NULL;
+}
+
+void copyGrid(Grid *dst, const Grid *src) {
+    *dst = *src;
+    dst->tiles = (unsigned char ***)calloc(src->tilesY, sizeof(unsigned char **));
+    for (int tileY = 0; tileY < src->tilesY; tileY++) {
+        if (src->tiles[tileY] == NULL) continue;
+        dst->tiles[tileY] = (unsigned char **)calloc(src->tilesX, sizeof(unsigned char *));
+        for (int tileX = 0; tileX < src->tilesX; tileX++) {
+            if (src->tiles[tileY][tileX] == NULL) continue;
+            dst->tiles[tileY][tileX] = nmallocT(unsigned char, GRID_TILE_SIZE * GRID_TILE_SIZE);
+            memcpy(dst->tiles[tileY][tileX], src->tiles[tileY][tileX], GRID_TILE_SIZE * GRID_TILE_SIZE);
+        }
+    }
+    dst->wallRows = _m_copyGridWallLines(src->wallRows, src->tilesY);
+    dst->wallColumns = _m_copyGridWallLines(src->wallColumns, src->tilesX);
+    dst->changedTiles = NULL;
+}
+
+static size_t _m_getGridChangeWords(const Grid *grid) {
+    return ((size_t)grid->tilesX * grid->tilesY + 63) / 64;
+}
+
+void trackGridChanges(Grid *grid) {
+    if (grid->changedTiles == NULL)
+        grid->changedTiles = (uint64_t *)calloc(_m_getGridChangeWords(grid), sizeof(uint64_t));
+}
+
+void clearGridChanges(Grid *grid) {
+    memset(grid->changedTiles, 0, _m_getGridChangeWords(grid) * sizeof(uint64_t));
+}
+
+static unsigned char *_m_allocGridTile(Grid *grid, int tileX, int tileY) {
+    if (grid->tiles[tileY] == NULL)
+        grid->tiles[tileY] = (unsigned char **)calloc(grid->tilesX, sizeof(unsigned char *));
+    unsigned char *tile = grid->tiles[tileY][tileX];
+    if (tile != NULL)
+        return tile;
+
+    tile = nmallocT(unsigned char, GRID_TILE_SIZE * GRID_TILE_SIZE);
+    unsigned char *cell = tile;
+    for (int y = tileY << GRID_TILE_SHIFT, dy = 0; dy < GRID_TILE_SIZE; y++, dy++) {
+        for (int x = tileX << GRID_TILE_SHIFT, dx = 0; dx < GRID_TILE_SIZE; x++, dx++, cell++) {
+            if (x < grid->width && y < grid->height)
+                *cell = GRID_CELL_EMPTY | (_m_getGridBorderMask(grid, x, y) << CELL_WALL_MASK_SHIFT);
+            else
+                *cell = GRID_CELL_NONE;
+        }
+    }
+    grid->tiles[tileY][tileX] = tile;
+    grid->tileCount++;
+    return tile;
+}
+
+static unsigned char *_m_getGridCellPtrForWrite(Grid *grid, int x, int y) {
+    unsigned char *tile = _m_allocGridTile(grid, x >> GRID_TILE_SHIFT, y >> GRID_TILE_SHIFT);
+    if (grid->changedTiles != NULL) {
+        size_t index = (size_t)(y >> GRID_TILE_SHIFT) * grid->tilesX + (x >> GRID_TILE_SHIFT);
+        grid->changedTiles[index >> 6] |= 1ull << (index & 63);
+    }
+    return &tile[_m_gridTileIndex(x, y)];
+}
+
+static const GridWallLine *_m_getGridWallLine(GridWallLine *const *groups, int index) {
+    const GridWallLine *group = groups[index >> GRID_TILE_SHIFT];
+    return group == NULL ? NULL : &group[index & GRID_TILE_MASK];
+}
+
+// Index of the first wall at or after pos
+static int _m_lowerBoundWall(const GridWallLine *line, int pos) {
+    int lo = 0, hi = line->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (line->walls[mid] < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Walls are mostly added in increasing order (files are loaded row by
+// row), which makes the common case an append
+static void _m_setGridWallLineBit(GridWallLine **groups, int index, int pos, bool isWall) {
+    GridWallLine **group = &groups[index >> GRID_TILE_SHIFT];
+    if (*group == NULL) {
+        if (!isWall) return;
+        *group = (GridWallLine *)calloc(GRID_TILE_SIZE, sizeof(GridWallLine));
+    }
+    GridWallLine *line = &(*group)[index & GRID_TILE_MASK];
+    int i = line->count > 0 && line->walls[line->count - 1] < pos ? line->count : _m_lowerBoundWall(line, pos);
+    bool present = i < line->count && line->walls[i] == pos;
+    if (present == isWall)
+        return;
+    if (isWall) {
+        if (line->count == line->capacity) {
+            line->capacity = line->capacity ? line->capacity * 2 : 4;
+            line->walls = (int *)realloc(line->walls, line->capacity * sizeof(int));
+        }
+        memmove(&line->walls[i + 1], &line->walls[i], (line->count - i) * sizeof(int));
+        line->walls[i] = pos;
+        line->count++;
+    } else {
+        memmove(&line->walls[i], &line->walls[i + 1], (line->count - i - 1) * sizeof(int));
+        line->count--;
+    }
+}
+
+int getGridFreeRun(const Grid *grid, int x, int y, int dx, int dy) {
+    const GridWallLine *line = dx != 0 ? _m_getGridWallLine(grid->wallRows, y) : _m_getGridWallLine(grid->wallColumns, x);
+    int pos = dx != 0 ? x : y;
+    int step = dx != 0 ? dx : dy;
+    int limit = step > 0 ? (dx != 0 ? grid->width : grid->height) : -1;
+    if (line != NULL && step > 0) {
+        int i = _m_lowerBoundWall(line, pos + 1);
+        if (i < line->count)
+            limit = line->walls[i];
+    } else if (line != NULL) {
+        int i = _m_lowerBoundWall(line, pos);
+        if (i > 0)
+            limit = line->walls[i - 1];
+    }
+    return step > 0 ? limit - pos - 1 : pos - limit - 1;
+}
+
+static void _m_setWallMaskBit(Grid *grid, int x, int y, unsigned char bit, bool isWall) {
+    if (x < 0 || x >= grid->width || y < 0 || y >= grid->height)
+        return;
+    unsigned char *cell = _m_getGridCellPtrForWrite(grid, x, y);
+    if (isWall)
+        *cell |= bit << CELL_WALL_MASK_SHIFT;
+    else
+        *cell &= ~(bit << CELL_WALL_MASK_SHIFT);
+}
+
+void setGridCell(Grid *grid, int x, int y, CellType value) {
+    if (x < 0 || x >= grid->width || y < 0 || y >= grid->height) {
+        printf("Index out of bounds: x = %d, y = %d\n", x, y);
+        return;
+    }
+    const unsigned char *current = _m_getGridCellPtr(grid, x, y);
+    if (current == NULL && value == GRID_CELL_EMPTY)
+        return;
+    unsigned char *cell = _m_getGridCellPtrForWrite(grid, x, y);
+    bool wasWall = (*cell & CELL_TYPE_MASK) == GRID_CELL_WALL;
+    bool isWall = value == GRID_CELL_WALL;
+    if (((*cell & CELL_TYPE_MASK) == GRID_CELL_FILLED) != (value == GRID_CELL_FILLED))
+        grid->paintHash ^= _m_getGridCellKey(x, y);
+    *cell = (*cell & ~CELL_TYPE_MASK) | value;
+
+    if (wasWall != isWall) {
+        _m_setGridWallLineBit(grid->wallRows, y, x, isWall);
+        _m_setGridWallLineBit(grid->wallColumns, x, y, isWall);
+        _m_setWallMaskBit(grid, x, y + 1, WALL_MASK_UP, isWall);
+        _m_setWallMaskBit(grid, x, y - 1, WALL_MASK_DOWN, isWall);
+        _m_setWallMaskBit(grid, x + 1, y, WALL_MASK_LEFT, isWall);
+        _m_setWallMaskBit(grid, x - 1, y, WALL_MASK_RIGHT, isWall);
+    }
+}
+
+bool streq(const char *str1, const char *str2) {
+    return !strcmp(str1, str2);
+}
+
+bool fileExists(const char *filename) {
+    struct stat info;
+    return stat(filename, &info) == 0;
+}
+
+char *getFileExt(char *filename) {
+    char *ext = nmallocT(char, FILENAME_MAX_LENGTH);
+    size_t i, j;
+    for (i = 0; filename[i] != '.' && i < strlen(filename); i++);
+    for (j = ++i; j < strlen(filename); j++)
+        ext[j - i] = filename[j];
+    ext[j - i] = '\0';
+    return ext;
+}
+
+size_t getGridPlaneWords(int width, int height) {
+    return ((size_t)width * height + 63) / 64;
+}
+
+// Cells past the border are GRID_CELL_NONE, so they never match
+uint64_t getGridTileRowMask(const unsigned char *tile, int row, CellType type) {
+    const unsigned char *cells = &tile[row << GRID_TILE_SHIFT];
+    uint64_t mask = 0;
+#ifdef __SSE2__
+    const __m128i typeMask = _mm_set1_epi8(CELL_TYPE_MASK);
+    const __m128i wanted = _mm_set1_epi8((char)type);
+    for (int i = 0; i < GRID_TILE_SIZE; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(cells + i));
+        __m128i match = _mm_cmpeq_epi8(_mm_and_si128(chunk, typeMask), wanted);
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(match) << i;
+    }
+#else
+    // Eight cells a word: the bytes of the type become zero bytes, whose
+    // high bits are then gathered into the low byte by one multiplication
+    for (int i = 0; i < GRID_TILE_SIZE; i += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, cells + i, sizeof(chunk));
+        uint64_t diff = (chunk & 0x0303030303030303ull) ^ (0x0101010101010101ull * type);
+        uint64_t zero = ~(((diff & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | diff | 0x7F7F7F7F7F7F7F7Full);
+        mask |= ((zero >> 7) * 0x0102040810204080ull >> 56) << i;
+    }
+#endif
+    return mask;
+}
+
+// The bits of a tile row go to cell index and on, maybe across two words
+static inline void _m_orPlaneBits(uint64_t *plane, size_t words, size_t index, uint64_t bits) {
+    if (bits == 0) return;
+    size_t word = index >> 6;
+    int shift = index & 63;
+    plane[word] |= bits << shift;
+    if (shift != 0 && word + 1 < words)
+        plane[word + 1] |= bits >> (64 - shift);
+}
+
+void fillGridPlane(const Grid *grid, CellType type, uint64_t *plane) {
+    size_t words = getGridPlaneWords(grid->width, grid->height);
+    for (int tileY = 0; tileY < grid->tilesY; tileY++) {
+        if (grid->tiles[tileY] == NULL) continue;
+        int yStart = tileY << GRID_TILE_SHIFT;
+        int rows = grid->height - yStart < GRID_TILE_SIZE ? grid->height - yStart : GRID_TILE_SIZE;
+        for (int tileX = 0; tileX < grid->tilesX; tileX++) {
+            const unsigned char *tile = getGridTile(grid, tileX, tileY);
+            if (tile == NULL) continue;
+            for (int dy = 0; dy < rows; dy++) {
+                size_t index = (size_t)(yStart + dy) * grid->width + (tileX << GRID_TILE_SHIFT);
+                _m_orPlaneBits(plane, words, index, getGridTileRowMask(tile, dy, type));
+            }
+        }
+    }
+}
+
+void makeGridPlanes(GridPlanes *planes, const Grid *grid) {
+    planes->width = grid->width;
+    planes->height = grid->height;
+    planes->words = getGridPlaneWords(grid->width, grid->height);
+    planes->walls = (uint64_t *)calloc(2 * planes->words, sizeof(uint64_t));
+    planes->paint = planes->walls + planes->words;
+    fillGridPlane(grid, GRID_CELL_WALL, planes->walls);
+    fillGridPlane(grid, GRID_CELL_FILLED, planes->paint);
+}
+
+void freeGridPlanes(GridPlanes *planes) {
+    free(planes->walls);
+    planes->walls = NULL;
+    planes->paint = NULL;
+}
+
+size_t countGridPlaneBits(const uint64_t *plane, size_t words) {
+    size_t count = 0;
+    for (size_t i = 0; i < words; i++)
+        count += countWordBits(plane[i]);
+    return count;
+}
+
+size_t findGridPlaneMismatch(const uint64_t *a, const uint64_t *b, size_t words) {
+    for (size_t i = 0; i < words; i++) {
+        uint64_t diff = a[i] ^ b[i];
+        if (diff == 0) continue;
+        int bit = 0;
+        while (!(diff >> bit & 1))
+            bit++;
+        return i * 64 + bit;
+    }
+    return GRID_PLANES_EQUAL;
+}
+
+int mapFile(const char *filename, MappedFile *mapped) {
+#ifdef _WIN32
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return EXIT_FAILURE;
+    fseek(file, 0, SEEK_END);
+    mapped->size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *data = nmallocT(unsigned char, mapped->size + 1);
+    bool ok = fread(data, 1, mapped->size, file) == mapped->size;
+    fclose(file);
+    if (!ok) {
+        free(data);
+        return EXIT_FAILURE;
+    }
+    mapped->data = data;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return EXIT_FAILURE;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    mapped->size = st.st_size;
+    if (mapped->size == 0) {
+        mapped->data = NULL;
+        close(fd);
+        return EXIT_SUCCESS;
+    }
+    void *data = mmap(NULL, mapped->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return EXIT_FAILURE;
+    mapped->data = data;
+#endif
+    return EXIT_SUCCESS;
+}
+
+void unmapFile(MappedFile *mapped) {
+#ifdef _WIN32
+    free((void *)mapped->data);
+#else
+    if (mapped->data != NULL)
+        munmap((void *)mapped->data, mapped->size);
+#endif
+    mapped->data = NULL;
+}
+
+static int _m_loadGridRecords(Grid *grid, const unsigned char *data, size_t size) {
+    if (size % sizeof(GridFileRecord) != 0)
+        return EXIT_FAILURE;
+    for (size_t offset = 0; offset < size; offset += sizeof(GridFileRecord)) {
+        GridFileRecord record;
+        memcpy(&record, data + offset, sizeof(GridFileRecord));
+        if (record.x < 0 || record.x >= grid->width || record.y < 0 || record.y >= grid->height ||
+            (record.type != GRID_CELL_EMPTY && record.type != GRID_CELL_FILLED && record.type != GRID_CELL_WALL))
+            return EXIT_FAILURE;
+        setGridCell(grid, record.x, record.y, record.type);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Only the set bits are visited, so empty stretches of the planes cost
+// one word comparison per 64 cells
+static int _m_loadGridPlanes(Grid *grid, const unsigned char *data, size_t size) {
+    size_t words = getGridPlaneWords(grid->width, grid->height);
+    if (size != 2 * words * sizeof(uint64_t))
+        return EXIT_FAILURE;
+    for (int plane = 0; plane < 2; plane++) {
+        CellType type = plane == 0 ? GRID_CELL_WALL : GRID_CELL_FILLED;
+        const unsigned char *planeData = data + plane * words * sizeof(uint64_t);
+        for (size_t i = 0; i < words; i++) {
+            uint64_t word;
+            memcpy(&word, planeData + i * sizeof(uint64_t), sizeof(uint64_t));
+            while (word != 0) {
+                size_t cellIndex = i * 64 + __builtin_ctzll(word);
+                word &= word - 1;
+                if (cellIndex >= (size_t)grid->width * grid->height)
+                    return EXIT_FAILURE;
+                setGridCell(grid, cellIndex % grid->width, cellIndex / grid->width, type);
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+bool hasFileExt(const char *filename, const char *extension) {
+    char *m_filename = strdup(filename);
+    char *fileExt = getFileExt(m_filename);
+    bool correctExt = fileExt[0] != '\0' && streq(fileExt, extension);
+    free(fileExt);
+    free(m_filename);
+    return correctExt;
+}
+
+int loadGridFromMemory(Grid *grid, const unsigned char *data, size_t size, int *robotPosX, int *robotPosY) {
+    GridFileHeader header;
+    size_t headerSize;
+    if (size >= sizeof(GridFileHeader) && !memcmp(data, GRID_FILE_MAGIC, sizeof(header.magic))) {
+        memcpy(&header, data, sizeof(GridFileHeader));
+        headerSize = sizeof(GridFileHeader);
+        if (header.version != GRID_FILE_VERSION_RECORDS && header.version != GRID_FILE_VERSION_PLANES) {
+            puts("Unsupported grid file version");
+            return EXIT_FAILURE;
+        }
+    } else if (size >= 2 * sizeof(int)) {
+        header.version = 0;
+        header.width = GRID_LEGACY_SIZE;
+        header.height = GRID_LEGACY_SIZE;
+        memcpy(&header.robotPosX, data, sizeof(int));
+        memcpy(&header.robotPosY, data + sizeof(int), sizeof(int));
+        headerSize = 2 * sizeof(int);
+    } else {
+        puts("Corrupted grid file");
+        return EXIT_FAILURE;
+    }
+    if (header.width <= 0 || header.width > GRID_MAX_SIZE || header.height <= 0 || header.height > GRID_MAX_SIZE) {
+        puts("Invalid grid size");
+        return EXIT_FAILURE;
+    }
+    // Cell lookups don't check bounds, so a robot off the field would
+    // read and write past the tiles
+    if (header.robotPosX < 0 || header.robotPosX >= header.width || header.robotPosY < 0 || header.robotPosY >= header.height) {
+        puts("Corrupted grid file");
+        return EXIT_FAILURE;
+    }
+
+    grid->width = header.width;
+    grid->height = header.height;
+    generateGridData(grid);
+    *robotPosX = header.robotPosX;
+    *robotPosY = header.robotPosY;
+
+    int result;
+    if (header.version == GRID_FILE_VERSION_PLANES)
+        result = _m_loadGridPlanes(grid, data + headerSize, size - headerSize);
+    else
+        result = _m_loadGridRecords(grid, data + headerSize, size - headerSize);
+    if (result == EXIT_SUCCESS && isGridCellWall(grid, header.robotPosX, header.robotPosY))
+        result = EXIT_FAILURE;
+
+    if (result == EXIT_FAILURE) {
+        puts("Corrupted grid file");
+        freeGrid(grid);
+    }
+    return result;
+}
+
+int loadGridFromFile(Grid *grid, const char *filename, int *robotPosX, int *robotPosY) {
+    if (!hasFileExt(filename, GRID_EXTENSION)) {
+        puts("Incorrect file extension. Expected \"*." GRID_EXTENSION "\"");
+        return EXIT_FAILURE;
+    }
+
+    if (!fileExists(filename)) {
+        puts("File doesn't exist (or doesn't have an extension)");
+        return EXIT_FAILURE;
+    }
+
+    MappedFile mapped;
+    if (mapFile(filename, &mapped) == EXIT_FAILURE) {
+        puts("Failed to open file");
+        return EXIT_FAILURE;
+    }
+    int result = loadGridFromMemory(grid, mapped.data, mapped.size, robotPosX, robotPosY);
+    unmapFile(&mapped);
+    return result;
+}
+
+void flipGridColor(Grid *grid, int x, int y) {
+    unsigned char *cell = _m_getGridCellPtrForWrite(grid, x, y);
+    CellType type = *cell & CELL_TYPE_MASK;
+    if (type == GRID_CELL_EMPTY || type == GRID_CELL_FILLED) {
+        *cell ^= GRID_CELL_EMPTY ^ GRID_CELL_FILLED;
+        grid->paintHash ^= _m_getGridCellKey(x, y);
+    }
+}
+
+void flipGridSpan(Grid *grid, int x, int y, int dx, int dy, int count) {
+    int stride = dx + dy * GRID_TILE_SIZE;
+    while (count > 0) {
+        unsigned char *cell = _m_getGridCellPtrForWrite(grid, x, y);
+        int inTile = dx > 0 ? GRID_TILE_SIZE - (x & GRID_TILE_MASK)
+                   : dx < 0 ? (x & GRID_TILE_MASK) + 1
+                   : dy > 0 ? GRID_TILE_SIZE - (y & GRID_TILE_MASK)
+                   : (y & GRID_TILE_MASK) + 1;
+        if (inTile > count) inTile = count;
+        for (int i = 0; i < inTile; i++, cell += stride, x += dx, y += dy) {
+            CellType type = *cell & CELL_TYPE_MASK;
+            if (type == GRID_CELL_EMPTY || type == GRID_CELL_FILLED) {
+                *cell ^= GRID_CELL_EMPTY ^ GRID_CELL_FILLED;
+                grid->paintHash ^= _m_getGridCellKey(x, y);
+            }
+        }
+        count -= inTile;
+    }
+}
+
+static bool _m_isGridTileClear(const unsigned char *tile) {
+    for (int i = 0; i < GRID_TILE_SIZE * GRID_TILE_SIZE; i++) {
+        if ((tile[i] & CELL_TYPE_MASK) == GRID_CELL_FILLED)
+            return false;
+    }
+    return true;
+}
+
+bool isGridPaintEqual(const Grid *a, const Grid *b) {
+    if (a->paintHash != b->paintHash)
+        return false;
+    for (int tileY = 0; tileY < a->tilesY; tileY++) {
+        for (int tileX = 0; tileX < a->tilesX; tileX++) {
+            const unsigned char *tileA = getGridTile(a, tileX, tileY);
+            const unsigned char *tileB = getGridTile(b, tileX, tileY);
+            if (tileA == tileB) continue;
+            if (tileA == NULL || tileB == NULL) {
+                if (!_m_isGridTileClear(tileA == NULL ? tileB : tileA))
+                    return false;
+            } else if (memcmp(tileA, tileB, GRID_TILE_SIZE * GRID_TILE_SIZE) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+GridCellIterator makeGridCellIterator() {
+    return (GridCellIterator){ .tileX = 0, .tileY = 0, .index = 0 };
+}
+
+bool nextGridMarkedCell(const Grid *grid, GridCellIterator *it, int *x, int *y, CellType *type) {
+    for (; it->tileY < grid->tilesY; it->tileY++, it->tileX = 0) {
+        if (grid->tiles[it->tileY] == NULL) continue;
+        for (; it->tileX < grid->tilesX; it->tileX++, it->index = 0) {
+            const unsigned char *tile = getGridTile(grid, it->tileX, it->tileY);
+            if (tile == NULL) continue;
+            for (; it->index < GRID_TILE_SIZE * GRID_TILE_SIZE; it->index++) {
+                CellType cellType = tile[it->index] & CELL_TYPE_MASK;
+                if (cellType == GRID_CELL_EMPTY || cellType == GRID_CELL_NONE) continue;
+                *x = (it->tileX << GRID_TILE_SHIFT) | (it->index & GRID_TILE_MASK);
+                *y = (it->tileY << GRID_TILE_SHIFT) | (it->index >> GRID_TILE_SHIFT);
+                *type = cellType;
+                it->index++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+size_t countGridCells(const Grid *grid, CellType type) {
+    size_t count = 0;
+    for (int tileY = 0; tileY < grid->tilesY; tileY++) {
+        if (grid->tiles[tileY] == NULL) continue;
+        for (int tileX = 0; tileX < grid->tilesX; tileX++) {
+            const unsigned char *tile = getGridTile(grid, tileX, tileY);
+            if (tile == NULL) continue;
+            for (int dy = 0; dy < GRID_TILE_SIZE; dy++)
+                count += countWordBits(getGridTileRowMask(tile, dy, type));
+        }
+    }
+    return count;
+}
+
+static int _m_compareStrings(const void *a, const void *b) {
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+void listFiles(const char *path, const char *extension, char ***filenames, size_t *count) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        *filenames = (char **)realloc(*filenames, (*count + 1) * sizeof(char *));
+        (*filenames)[(*count)++] = strdup(path);
+        return;
+    }
+
+    size_t first = *count;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || !hasFileExt(entry->d_name, extension)) continue;
+        *filenames = (char **)realloc(*filenames, (*count + 1) * sizeof(char *));
+        char *filename = nmallocT(char, strlen(path) + strlen(entry->d_name) + 2);
+        sprintf(filename, "%s/%s", path, entry->d_name);
+        (*filenames)[(*count)++] = filename;
+    }
+    closedir(dir);
+    qsort(*filenames + first, *count - first, sizeof(char *), _m_compareStrings);
+}
+
+int writeGrid(const Grid *grid, FILE *file, int robotPosX, int robotPosY) {
+    int x, y;
+    CellType type;
+    GridCellIterator it;
+    size_t markedCells = countGridCells(grid, GRID_CELL_WALL) + countGridCells(grid, GRID_CELL_FILLED);
+
+    size_t words = getGridPlaneWords(grid->width, grid->height);
+    bool usePlanes = 2 * words * sizeof(uint64_t) <= markedCells * sizeof(GridFileRecord);
+
+    GridFileHeader header = {
+        .version = usePlanes ? GRID_FILE_VERSION_PLANES : GRID_FILE_VERSION_RECORDS,
+        .width = grid->width,
+        .height = grid->height,
+        .robotPosX = robotPosX,
+        .robotPosY = robotPosY
+    };
+    memcpy(header.magic, GRID_FILE_MAGIC, sizeof(header.magic));
+    bool written = fwrite(&header, sizeof(GridFileHeader), 1, file) == 1;
+
+    if (usePlanes) {
+        GridPlanes planes;
+        makeGridPlanes(&planes, grid);
+        written = written && fwrite(planes.walls, sizeof(uint64_t), 2 * words, file) == 2 * words;
+        freeGridPlanes(&planes);
+    } else {
+        it = makeGridCellIterator();
+        while (nextGridMarkedCell(grid, &it, &x, &y, &type)) {
+            GridFileRecord record = { .type = type, .x = x, .y = y };
+            written = written && fwrite(&record, sizeof(GridFileRecord), 1, file) == 1;
+        }
+    }
+
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int dumpGrid(const Grid *grid, const char *filename, int robotPosX, int robotPosY) {
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        puts("Failed to open file");
+        return EXIT_FAILURE;
+    }
+    int result = writeGrid(grid, file, robotPosX, robotPosY);
+    return fclose(file) == 0 ? result : EXIT_FAILURE;
+}
@@ -1,11 +1,14 @@
-#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #ifndef KUMIR_GRID_H
 #define KUMIR_GRID_H
 
 
-#define nmallocT(T, N) (T *)malloc(N * sizeof(T))
+#define nmallocT(T, N) (T *)malloc((N) * sizeof(T))
 #define mallocT(T) (T *)malloc(sizeof(T))
 
 typedef enum {
@@ -15,41 +18,113 @@ typedef enum {
     GRID_CELL_WALL
 } CellType;
 
+// Sorted positions of the wall cells on one row or column
+typedef struct GridWallLine {
+    int *walls;
+    int count;
+    int capacity;
+} GridWallLine;
+
 typedef struct Grid {
     int width;
     int height;
-    int cellSize;
-    Color backgroundColor;
-    Color filledBackgroundColor;
-    Color wallColor;
-    Color gridColor;
-    CellType **data;
+    int tilesX;
+    int tilesY;
+    unsigned char ***tiles;
+    size_t tileCount;
+    uint64_t paintHash;
+    GridWallLine **wallRows;
+    GridWallLine **wallColumns;
+    uint64_t *changedTiles;  // see trackGridChanges
 } Grid;
 
-void generateGridData(Grid *grid) {
-    grid->data = nmallocT(CellType *, grid->width);
-    for (int x = 0; x < grid->width; x++) {
-        grid->data[x] = nmallocT(CellType, grid->height);
-        for (int y = 0; y < grid->height; y++)
-            grid->data[x][y] = GRID_CELL_EMPTY;
-    }
+// The field is split into square tiles that are only allocated once
+// something is written to them; a missing tile reads as empty cells.
+// Inside a tile cells are stored row-major, one byte each: the low two
+// bits hold the CellType, the next four a mask of which neighbours are
+// walls (the border of the field counts as a wall), one bit per Direction
+#define GRID_TILE_SHIFT 6
+#define GRID_TILE_SIZE (1 << GRID_TILE_SHIFT)
+#define GRID_TILE_MASK (GRID_TILE_SIZE - 1)
+
+#define CELL_TYPE_MASK 0x03
+#define CELL_WALL_MASK_SHIFT 2
+
+#define WALL_MASK_UP    (1 << 0)
+#define WALL_MASK_DOWN  (1 << 1)
+#define WALL_MASK_LEFT  (1 << 2)
+#define WALL_MASK_RIGHT (1 << 3)
+
+#define GRID_MAX_SIZE 1000000
+
+#define GRID_DEFAULT_SIZE 15
+
+// A grid with only its size set; generateGridData or loadGridFromFile
+// allocate the storage
+Grid makeGrid(void);
+
+void generateGridData(Grid *grid);
+
+void freeGrid(Grid *grid);
+
+void copyGrid(Grid *dst, const Grid *src);
+
+// From now on every write marks its tile in changedTiles, one bit per
+// tile in row-major order, so that a snapshot only has to look at the
+// tiles written since the last one. Copies do not track changes
+void trackGridChanges(Grid *grid);
+
+void clearGridChanges(Grid *grid);
+
+static inline bool isGridTileChanged(const Grid *grid, int tileX, int tileY) {
+    size_t index = (size_t)tileY * grid->tilesX + tileX;
+    return grid->changedTiles[index >> 6] >> (index & 63) & 1;
+}
+
+static inline unsigned char _m_getGridBorderMask(const Grid *grid, int x, int y) {
+    unsigned char mask = 0;
+    if (y == 0) mask |= WALL_MASK_UP;
+    if (y == grid->height - 1) mask |= WALL_MASK_DOWN;
+    if (x == 0) mask |= WALL_MASK_LEFT;
+    if (x == grid->width - 1) mask |= WALL_MASK_RIGHT;
+    return mask;
+}
+
+static inline const unsigned char *getGridTile(const Grid *grid, int tileX, int tileY) {
+    unsigned char **tileRow = grid->tiles[tileY];
+    return tileRow == NULL ? NULL : tileRow[tileX];
 }
 
-void setGridCell(Grid *grid, int x, int y, CellType value) {
-    if (x < 0 || x >= grid->width || y < 0 || y >= grid->height) {
-        printf("Index out of bounds: x = %d, y = %d\n", x, y);
-        return;
-    }
-    grid->data[x][y] = value;
+#define _m_gridTileIndex(x, y) ((((y) & GRID_TILE_MASK) << GRID_TILE_SHIFT) | ((x) & GRID_TILE_MASK))
+
+static inline const unsigned char *_m_getGridCellPtr(const Grid *grid, int x, int y) {
+    const unsigned char *tile = getGridTile(grid, x >> GRID_TILE_SHIFT, y >> GRID_TILE_SHIFT);
+    return tile == NULL ? NULL : &tile[_m_gridTileIndex(x, y)];
+}
+
+// Number of cells the robot can move from (x, y) in the direction
+// (dx, dy), one of which is zero, before it hits a wall or the border
+int getGridFreeRun(const Grid *grid, int x, int y, int dx, int dy);
+
+void setGridCell(Grid *grid, int x, int y, CellType value);
+
+static inline unsigned char getGridWallMask(const Grid *grid, int x, int y) {
+    const unsigned char *cell = _m_getGridCellPtr(grid, x, y);
+    if (cell == NULL)
+        return _m_getGridBorderMask(grid, x, y);
+    return *cell >> CELL_WALL_MASK_SHIFT;
 }
 
-CellType getGridCell(Grid grid, int x, int y) {
-    if (x < 0 || x >= grid.width || y < 0 || y >= grid.height)
+static inline CellType getGridCell(const Grid *grid, int x, int y) {
+    if (x < 0 || x >= grid->width || y < 0 || y >= grid->height)
         return GRID_CELL_NONE;
-    return grid.data[x][y];
+    const unsigned char *cell = _m_getGridCellPtr(grid, x, y);
+    if (cell == NULL)
+        return GRID_CELL_EMPTY;
+    return *cell & CELL_TYPE_MASK;
 }
 
-bool isGridCellWall(Grid grid, int x, int y) {
+static inline bool isGridCellWall(const Grid *grid, int x, int y) {
     CellType cell = getGridCell(grid, x, y);
     return cell == GRID_CELL_WALL || cell == GRID_CELL_NONE;
 }
@@ -57,142 +132,143 @@ bool isGridCellWall(Grid grid, int x, int y) {
 #define FILENAME_MAX_LENGTH 128
 #define GRID_EXTENSION "kum_grid"
 
-bool streq(const char *str1, const char *str2) {
-    return !strcmp(str1, str2);
-}
+bool streq(const char *str1, const char *str2);
 
-char *getFileExt(char *filename) {
-    char *ext = nmallocT(char, FILENAME_MAX_LENGTH);
-    size_t i, j;
-    for (i = 0; filename[i] != '.' && i < strlen(filename); i++);
-    for (j = ++i; j < strlen(filename); j++)
-        ext[j - i] = filename[j];
-    ext[j - i] = '\0';
-    return ext;
-}
+bool fileExists(const char *filename);
 
-int loadGridFromFile(Grid *grid, const char *filename, int *robotPosX, int *robotPosY) {
-    char *m_filename = strdup(filename);
-    char *fileExt = getFileExt(m_filename);
-    if (fileExt[0] == '\0' || !streq(fileExt, GRID_EXTENSION)) {
-        printf("Incorrect file extension. Expected \"*." GRID_EXTENSION "\"");
-        return EXIT_FAILURE;
-    }
-    free(fileExt);
+char *getFileExt(char *filename);
 
-    if (!FileExists(m_filename)) {
-        puts("File doesn't exist (or doesn't have an extension)");
-        return EXIT_FAILURE;
-    }
+// The whole file, mapped read-only where mmap exists and read into memory
+// elsewhere; an empty file has no data
+typedef struct MappedFile {
+    const unsigned char *data;
+    size_t size;
+} MappedFile;
 
-    FILE *file = fopen(filename, "rb");
+int mapFile(const char *filename, MappedFile *mapped);
 
-    if (file == NULL) {
-        puts("Failed to open file");
-        return EXIT_FAILURE;
-    }
+void unmapFile(MappedFile *mapped);
 
-    generateGridData(grid);
+// Grid files start with a header carrying the field size; files written
+// before it existed start straight with the robot position and are 15x15.
+// Version 1 follows the header with (CellType, x, y) records, version 2
+// with two bit planes (walls, then paint) of one bit per cell in row-major
+// order, packed into 64-bit words
+#define GRID_FILE_MAGIC "KUMG"
+#define GRID_FILE_VERSION_RECORDS 1
+#define GRID_FILE_VERSION_PLANES 2
+#define GRID_LEGACY_SIZE 15
 
-    fread(robotPosX, sizeof(int), 1, file);
-    fread(robotPosY, sizeof(int), 1, file);
+typedef struct GridFileHeader {
+    char magic[4];
+    int version;
+    int width;
+    int height;
+    int robotPosX;
+    int robotPosY;
+} GridFileHeader;
 
-    int x, y;
+typedef struct GridFileRecord {
     CellType type;
-    while (!feof(file)) {
-        fread(&type, sizeof(CellType), 1, file);
-        fread(&x, sizeof(int), 1, file);
-        fread(&y, sizeof(int), 1, file);
-        
-        setGridCell(grid, x, y, type);
-    }
-
-    fclose(file);
-    return EXIT_SUCCESS;
-}
+    int x;
+    int y;
+} GridFileRecord;
+
+size_t getGridPlaneWords(int width, int height);
+
+// Walls and paint as bit planes in the layout of version 2 grid files, so
+// a 15x15 field takes four words a plane. Counting, comparing and finding
+// differences then go a word at a time. The planes are built a tile row
+// (64 cells) at a time, with SSE2 where it is available
+typedef struct GridPlanes {
+    int width;
+    int height;
+    size_t words;
+    uint64_t *walls;
+    uint64_t *paint;  // right after walls, as in the file
+} GridPlanes;
+
+void makeGridPlanes(GridPlanes *planes, const Grid *grid);
+
+void freeGridPlanes(GridPlanes *planes);
 
-void flipGridColor(Grid *grid, int x, int y) {
-    if (grid->data[x][y] == GRID_CELL_EMPTY)
-        grid->data[x][y] = GRID_CELL_FILLED;
-    else if (grid->data[x][y] == GRID_CELL_FILLED)
-        grid->data[x][y] = GRID_CELL_EMPTY;
+// Sets the bit of every cell of the type; the rest of the plane is kept
+void fillGridPlane(const Grid *grid, CellType type, uint64_t *plane);
+
+// The same for one row of a tile, bit i for the cell i columns in. Dense
+// planes cost as much as the whole field, so whatever only has to look
+// at the allocated tiles of a huge field works on tile rows instead
+uint64_t getGridTileRowMask(const unsigned char *tile, int row, CellType type);
+
+static inline void setGridPlaneBit(uint64_t *plane, int width, int x, int y) {
+    size_t index = (size_t)y * width + x;
+    plane[index >> 6] |= (uint64_t)1 << (index & 63);
 }
 
-void drawGrid(Grid grid, int screenWidth, int screenHeight) {
-    int xMin = (screenWidth - grid.width * grid.cellSize) / 2;
-    int yMin = (screenHeight - grid.height * grid.cellSize) / 2;
-
-    int xMax = (screenWidth + grid.width * grid.cellSize) / 2;
-    int yMax = (screenHeight + grid.height * grid.cellSize) / 2;
-
-    Color cellColor;
-    for (int x = 0, xPos = xMin; x < grid.width; x++, xPos+=grid.cellSize) {
-        for (int y = 0, yPos = yMin; y < grid.height; y++, yPos+=grid.cellSize) {
-            if (grid.data[x][y] == GRID_CELL_EMPTY)
-                cellColor = grid.backgroundColor;
-            else if (grid.data[x][y] == GRID_CELL_FILLED)
-                cellColor = grid.filledBackgroundColor;
-            else if (grid.data[x][y] == GRID_CELL_WALL)
-                cellColor = grid.wallColor;
-            DrawRectangle(xPos, yPos, grid.cellSize, grid.cellSize, cellColor);
-        }
-    }
-    
-    for (int x = xMin; x <= xMax; x+=grid.cellSize)
-        DrawLineEx((Vector2){ x, yMin }, (Vector2){ x, yMax }, 2, grid.gridColor);
-    for (int y = yMin; y <= yMax; y+=grid.cellSize)
-        DrawLineEx((Vector2){ xMin, y }, (Vector2){ xMax, y }, 2, grid.gridColor);
+static inline bool getGridPlaneBit(const uint64_t *plane, int width, int x, int y) {
+    size_t index = (size_t)y * width + x;
+    return plane[index >> 6] >> (index & 63) & 1;
 }
 
-void freeGrid(Grid *grid) {
-    for (size_t x = 0; x < grid->width; x++)
-        free(grid->data[x]);
-    free(grid->data);
+static inline int countWordBits(uint64_t word) {
+#ifdef __GNUC__
+    return __builtin_popcountll(word);
+#else
+    word -= (word >> 1) & 0x5555555555555555ull;
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (int)((word * 0x0101010101010101ull) >> 56);
+#endif
 }
 
-void getGridMousePos(Grid grid, int *x, int *y, int screenWidth, int screenHeight) {
-    Vector2 mousePos = GetMousePosition();
+size_t countGridPlaneBits(const uint64_t *plane, size_t words);
 
-    int xMin = (screenWidth - grid.width * grid.cellSize) / 2;
-    int yMin = (screenHeight - grid.height * grid.cellSize) / 2;
+#define GRID_PLANES_EQUAL SIZE_MAX
 
-    mousePos.x -= xMin;
-    mousePos.y -= yMin;
+// The index (y * width + x) of the first cell where two planes differ
+size_t findGridPlaneMismatch(const uint64_t *a, const uint64_t *b, size_t words);
 
-    mousePos.x /= grid.cellSize;
-    mousePos.y /= grid.cellSize;
+bool hasFileExt(const char *filename, const char *extension);
 
-    int m_x = (int)mousePos.x;
-    int m_y = (int)mousePos.y;
+// The whole of data is one grid file. Fails on a robot off the field or
+// on a wall
+int loadGridFromMemory(Grid *grid, const unsigned char *data, size_t size, int *robotPosX, int *robotPosY);
 
-    if (0 <= m_x && m_x < grid.width &&
-        0 <= m_y && m_y < grid.height) {
-        *x = m_x;
-        *y = m_y;
-    } else {
-        *x = -1;
-        *y = -1;
-    }
-}
+int loadGridFromFile(Grid *grid, const char *filename, int *robotPosX, int *robotPosY);
 
-void dumpGrid(Grid grid, const char *filename, int robotPosX, int robotPosY) {
-    FILE *file = fopen(filename, "wb");
+void flipGridColor(Grid *grid, int x, int y);
 
-    fwrite(&robotPosX, sizeof(int), 1, file);
-    fwrite(&robotPosY, sizeof(int), 1, file);
+// Flips count cells starting at (x, y) and stepping by (dx, dy), looking
+// each tile up only once
+void flipGridSpan(Grid *grid, int x, int y, int dx, int dy, int count);
 
-    for (int x = 0; x < grid.width; x++) {
-        for (int y = 0; y < grid.height; y++) {
-            if (grid.data[x][y] != GRID_CELL_EMPTY && grid.data[x][y] != GRID_CELL_NONE) {
-                fwrite(&grid.data[x][y], sizeof(CellType), 1, file);
-                fwrite(&x, sizeof(int), 1, file);
-                fwrite(&y, sizeof(int), 1, file);
-            }
-        }
-    }
+// Compares the painted cells of two grids with the same walls, e.g. a
+// grid and an earlier copy of it. A tile that only exists on one side
+// matches if it holds no paint
+bool isGridPaintEqual(const Grid *a, const Grid *b);
 
-    fclose(file);
-}
+// Walks the walls and painted cells of every allocated tile, tile by tile
+typedef struct GridCellIterator {
+    int tileX;
+    int tileY;
+    int index;
+} GridCellIterator;
+
+GridCellIterator makeGridCellIterator(void);
+
+bool nextGridMarkedCell(const Grid *grid, GridCellIterator *it, int *x, int *y, CellType *type);
+
+size_t countGridCells(const Grid *grid, CellType type);
+
+// Appends every file of a directory with the given extension, sorted by
+// name, or the path itself when it is not a directory
+void listFiles(const char *path, const char *extension, char ***filenames, size_t *count);
+
+// Writes whichever of the two layouts is smaller: bit planes for small or
+// dense fields, records for huge mostly empty ones
+int writeGrid(const Grid *grid, FILE *file, int robotPosX, int robotPosY);
+
+int dumpGrid(const Grid *grid, const char *filename, int robotPosX, int robotPosY);
 
 
 #endif // !KUMIR_GRID_H
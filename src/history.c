@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+
+
+#define _m_TILE_BYTES (GRID_TILE_SIZE * GRID_TILE_SIZE)
+
+static const unsigned char *_m_getLiveTile(const Grid *grid, int tileX, int tileY) {
+    return grid->tiles[tileY] == NULL ? NULL : grid->tiles[tileY][tileX];
+}
+
+static SnapshotTile *_m_getImageTile(const SnapshotRow *row, int tileX) {
+    return row == NULL ? NULL : row->tiles[tileX];
+}
+
+static void _m_releaseSnapshotRow(SnapshotRow *row, int tilesX) {
+    if (row == NULL || --row->refs > 0) return;
+    for (int tileX = 0; tileX < tilesX; tileX++) {
+        SnapshotTile *tile = row->tiles[tileX];
+        if (tile != NULL && --tile->refs == 0)
+            free(tile);
+    }
+    free(row->tiles);
+    free(row);
+}
+
+static void _m_releaseGridImage(GridImage *image, const Grid *grid) {
+    if (image->rows == NULL) return;
+    for (int tileY = 0; tileY < grid->tilesY; tileY++)
+        _m_releaseSnapshotRow(image->rows[tileY], grid->tilesX);
+    free(image->rows);
+    image->rows = NULL;
+}
+
+static GridImage _m_retainGridImage(const GridImage *image, const Grid *grid) {
+    GridImage copy = *image;
+    copy.rows = (SnapshotRow **)malloc(grid->tilesY * sizeof(SnapshotRow *));
+    for (int tileY = 0; tileY < grid->tilesY; tileY++) {
+        copy.rows[tileY] = image->rows[tileY];
+        if (copy.rows[tileY] != NULL)
+            copy.rows[tileY]->refs++;
+    }
+    return copy;
+}
+
+// A tile is shared with like when it did not change since the grid was
+// like, which a tracked grid knows and any other finds out by comparing
+static bool _m_canShareTile(const Grid *grid, const SnapshotTile *likeTile, int tileX, int tileY, bool tracked) {
+    const unsigned char *tile = _m_getLiveTile(grid, tileX, tileY);
+    if (tile == NULL || likeTile == NULL)
+        return tile == NULL && likeTile == NULL;
+    return tracked ? !isGridTileChanged(grid, tileX, tileY) : !memcmp(tile, likeTile->cells, _m_TILE_BYTES);
+}
+
+static GridImage _m_captureGridImage(const Grid *grid, const GridImage *like, bool tracked) {
+    GridImage image = {
+        .rows = (SnapshotRow **)calloc(grid->tilesY, sizeof(SnapshotRow *)),
+        .tileCount = grid->tileCount,
+        .paintHash = grid->paintHash
+    };
+    for (int tileY = 0; tileY < grid->tilesY; tileY++) {
+        SnapshotRow *likeRow = like != NULL ? like->rows[tileY] : NULL;
+        bool sameRow = true;
+        for (int tileX = 0; tileX < grid->tilesX && sameRow; tileX++)
+            sameRow = _m_canShareTile(grid, _m_getImageTile(likeRow, tileX), tileX, tileY, tracked);
+        if (sameRow) {
+            image.rows[tileY] = likeRow;
+            if (likeRow != NULL) likeRow->refs++;
+            continue;
+        }
+
+        SnapshotRow *row = mallocT(SnapshotRow);
+        row->refs = 1;
+        row->tiles = (SnapshotTile **)calloc(grid->tilesX, sizeof(SnapshotTile *));
+        for (int tileX = 0; tileX < grid->tilesX; tileX++) {
+            const unsigned char *tile = _m_getLiveTile(grid, tileX, tileY);
+            SnapshotTile *likeTile = _m_getImageTile(likeRow, tileX);
+            if (tile == NULL) continue;
+            if (_m_canShareTile(grid, likeTile, tileX, tileY, tracked)) {
+                likeTile->refs++;
+                row->tiles[tileX] = likeTile;
+            } else {
+                row->tiles[tileX] = mallocT(SnapshotTile);
+                row->tiles[tileX]->refs = 1;
+                memcpy(row->tiles[tileX]->cells, tile, _m_TILE_BYTES);
+            }
+        }
+        image.rows[tileY] = row;
+    }
+    return image;
+}
+
+// Makes the tiles of the grid those of the image. With from, the image
+// the grid was synced to, only the tiles that differ from it or changed
+// since are written. A tile missing from the image was allocated later,
+// when it could only hold empty cells, so it is freed
+static void _m_applyGridImage(Grid *grid, const GridImage *image, const GridImage *from) {
+    for (int tileY = 0; tileY < grid->tilesY; tileY++) {
+        SnapshotRow *row = image->rows[tileY];
+        SnapshotRow *fromRow = from != NULL ? from->rows[tileY] : NULL;
+        for (int tileX = 0; tileX < grid->tilesX; tileX++) {
+            SnapshotTile *tile = _m_getImageTile(row, tileX);
+            if (from != NULL && tile == _m_getImageTile(fromRow, tileX) &&
+                (grid->changedTiles == NULL || !isGridTileChanged(grid, tileX, tileY)))
+                continue;
+            unsigned char **liveRow = grid->tiles[tileY];
+            if (tile == NULL) {
+                if (liveRow != NULL) {
+                    free(liveRow[tileX]);
+                    liveRow[tileX] = NULL;
+                }
+                continue;
+            }
+            if (liveRow == NULL)
+                liveRow = grid->tiles[tileY] = (unsigned char **)calloc(grid->tilesX, sizeof(unsigned char *));
+            if (liveRow[tileX] == NULL)
+                liveRow[tileX] = nmallocT(unsigned char, _m_TILE_BYTES);
+            memcpy(liveRow[tileX], tile->cells, _m_TILE_BYTES);
+        }
+    }
+    grid->tileCount = image->tileCount;
+    grid->paintHash = image->paintHash;
+}
+
+static void _m_syncRunHistory(RunHistory *history, const GridImage *image) {
+    Grid *grid = history->interpreter->grid;
+    _m_releaseGridImage(&history->synced, grid);
+    history->synced = _m_retainGridImage(image, grid);
+    clearGridChanges(grid);
+}
+
+static void _m_releaseRunSnapshot(RunSnapshot *snapshot, const Grid *grid) {
+    _m_releaseGridImage(&snapshot->grid, grid);
+    _m_releaseGridImage(&snapshot->checkpoint, grid);
+}
+
+static void _m_captureRunSnapshot(RunHistory *history) {
+    Interpreter *interpreter = history->interpreter;
+    Grid *grid = interpreter->grid;
+    RunSnapshot snapshot = {
+        .pc = interpreter->pc,
+        .robot = *interpreter->robot,
+        .grid = _m_captureGridImage(grid, history->snapshotCount > 0 ? &history->synced : NULL, history->snapshotCount > 0),
+        .loopCheck = interpreter->loopCheck,
+        .checkpoint = { .rows = NULL }
+    };
+    snapshot.loopCheck.paint = (Grid){ .tiles = NULL };
+
+    // The checkpoint only changes when its power grows, and is then a copy
+    // of a recent grid, so it is shared with the previous snapshot or
+    // mostly with this one
+    const LoopCheck *check = &interpreter->loopCheck;
+    if (check->hasCheckpoint) {
+        const RunSnapshot *previous = history->snapshotCount > 0 ? &history->snapshots[history->snapshotCount - 1] : NULL;
+        if (previous != NULL && previous->loopCheck.hasCheckpoint && previous->loopCheck.power == check->power)
+            snapshot.checkpoint = _m_retainGridImage(&previous->checkpoint, grid);
+        else
+            snapshot.checkpoint = _m_captureGridImage(&check->paint, &snapshot.grid, false);
+    }
+
+    history->snapshots = (RunSnapshot *)realloc(history->snapshots, (history->snapshotCount + 1) * sizeof(RunSnapshot));
+    history->snapshots[history->snapshotCount++] = snapshot;
+    _m_syncRunHistory(history, &snapshot.grid);
+
+    if (history->snapshotCount < HISTORY_MAX_SNAPSHOTS)
+        return;
+    size_t kept = 0;
+    for (size_t i = 0; i < history->snapshotCount; i++) {
+        if (i % 2 == 0)
+            history->snapshots[kept++] = history->snapshots[i];
+        else
+            _m_releaseRunSnapshot(&history->snapshots[i], grid);
+    }
+    history->snapshotCount = kept;
+    history->interval *= 2;
+}
+
+// The run is deterministic, so a snapshot that exists for this step
+// holds exactly the current state
+static void _m_reachRunHistoryStep(RunHistory *history) {
+    size_t steps = history->interpreter->steps;
+    if (steps > history->furthestSteps)
+        history->furthestSteps = steps;
+    if (steps % history->interval != 0)
+        return;
+    size_t index = steps / history->interval;
+    if (index < history->snapshotCount)
+        _m_syncRunHistory(history, &history->snapshots[index].grid);
+    else if (index == history->snapshotCount)
+        _m_captureRunSnapshot(history);
+}
+
+static void _m_restoreRunSnapshot(RunHistory *history, size_t index) {
+    Interpreter *interpreter = history->interpreter;
+    Grid *grid = interpreter->grid;
+    const RunSnapshot *snapshot = &history->snapshots[index];
+    _m_applyGridImage(grid, &snapshot->grid, &history->synced);
+    _m_syncRunHistory(history, &snapshot->grid);
+    interpreter->pc = snapshot->pc;
+    interpreter->steps = index * history->interval;
+    *interpreter->robot = snapshot->robot;
+
+    // A checkpoint of the same power is the same checkpoint
+    LoopCheck *check = &interpreter->loopCheck;
+    const LoopCheck *saved = &snapshot->loopCheck;
+    bool keepPaint = check->hasCheckpoint && saved->hasCheckpoint && check->power == saved->power;
+    Grid paint = check->paint;
+    if (check->hasCheckpoint && !keepPaint)
+        freeGrid(&paint);
+    if (saved->hasCheckpoint && !keepPaint) {
+        copyGrid(&paint, grid);
+        _m_applyGridImage(&paint, &snapshot->checkpoint, &snapshot->grid);
+    }
+    *check = *saved;
+    check->paint = paint;
+}
+
+void initRunHistory(RunHistory *history, Interpreter *interpreter) {
+    *history = (RunHistory){
+        .interpreter = interpreter,
+        .snapshots = NULL,
+        .snapshotCount = 0,
+        .interval = HISTORY_FIRST_INTERVAL,
+        .synced = { .rows = NULL },
+        .furthestSteps = 0,
+        .finished = false
+    };
+    trackGridChanges(interpreter->grid);
+    _m_captureRunSnapshot(history);
+}
+
+void freeRunHistory(RunHistory *history) {
+    const Grid *grid = history->interpreter->grid;
+    for (size_t i = 0; i < history->snapshotCount; i++)
+        _m_releaseRunSnapshot(&history->snapshots[i], grid);
+    free(history->snapshots);
+    history->snapshots = NULL;
+    history->snapshotCount = 0;
+    _m_releaseGridImage(&history->synced, grid);
+}
+
+static void _m_finishRunHistory(RunHistory *history, RunResult result) {
+    history->finished = true;
+    history->result = result;
+    if (result.steps > history->furthestSteps)
+        history->furthestSteps = result.steps;
+}
+
+InterpreterExitCode stepRunHistory(RunHistory *history) {
+    Interpreter *interpreter = history->interpreter;
+    size_t pc = interpreter->pc;
+    InterpreterExitCode code = stepInterpreter(interpreter);
+    if (code == INTERPRETER_NORMAL) {
+        _m_reachRunHistoryStep(history);
+    } else if (code != INTERPRETER_SKIP_LINE) {
+        _m_finishRunHistory(history, (RunResult){
+            .code = code,
+            .line = getInstructionLine(interpreter->program, pc),
+            .steps = interpreter->steps,
+            .pc = pc
+        });
+    }
+    return code;
+}
+
+InterpreterExitCode seekRunHistory(RunHistory *history, size_t steps) {
+    Interpreter *interpreter = history->interpreter;
+    if (history->finished && steps > history->result.steps)
+        steps = history->result.steps;
+    size_t index = steps / history->interval;
+    if (index >= history->snapshotCount)
+        index = history->snapshotCount - 1;
+    if (interpreter->steps > steps || interpreter->steps < index * history->interval)
+        _m_restoreRunSnapshot(history, index);
+
+    // Forward it is a plain run with fused instructions, stopped at every
+    // snapshot step by the step limit
+    InterpreterLimits limits = interpreter->limits;
+    bool stepFused = interpreter->stepFused;
+    interpreter->stepFused = false;
+    InterpreterExitCode code = INTERPRETER_NORMAL;
+    while (interpreter->steps < steps) {
+        size_t next = (interpreter->steps / history->interval + 1) * history->interval;
+        interpreter->limits = (InterpreterLimits){
+            .maxSteps = next < steps ? next : steps,
+            .maxSeconds = 0,
+            .detectLoops = limits.detectLoops
+        };
+        RunResult result = runInterpreter(interpreter);
+        if (result.code != INTERPRETER_STEP_LIMIT) {
+            _m_finishRunHistory(history, result);
+            code = result.code;
+            break;
+        }
+        _m_reachRunHistoryStep(history);
+    }
+    interpreter->limits = limits;
+    interpreter->stepFused = stepFused;
+    return code;
+}
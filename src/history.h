@@ -0,0 +1,69 @@
+#include "interpreter.h"
+
+#ifndef KUMIR_HISTORY_H
+#define KUMIR_HISTORY_H
+
+
+// Lets a viewer go back in a run. The state of the run is snapshotted
+// every `interval` steps, and any step is reached again by restoring the
+// last snapshot before it and running forward. Snapshots are copy on
+// write: a row of tiles or a tile that did not change since the previous
+// snapshot is shared with it, so a snapshot costs about the tiles the run
+// painted in between. Once there are HISTORY_MAX_SNAPSHOTS every other
+// one is dropped and the interval doubles, which bounds the memory of a
+// run of any length while seeking stays one restore and at most one
+// interval of fused steps
+#define HISTORY_FIRST_INTERVAL 1024
+#define HISTORY_MAX_SNAPSHOTS 256
+
+typedef struct SnapshotTile {
+    size_t refs;
+    unsigned char cells[GRID_TILE_SIZE * GRID_TILE_SIZE];
+} SnapshotTile;
+
+typedef struct SnapshotRow {
+    size_t refs;
+    SnapshotTile **tiles;  // tilesX of them, NULL where no tile was allocated
+} SnapshotRow;
+
+typedef struct GridImage {
+    SnapshotRow **rows;  // tilesY of them, NULL for rows without tiles
+    size_t tileCount;
+    uint64_t paintHash;
+} GridImage;
+
+// Snapshot i is taken at step i * interval
+typedef struct RunSnapshot {
+    size_t pc;
+    Robot robot;
+    GridImage grid;
+    LoopCheck loopCheck;   // without the paint grid, which is kept as
+    GridImage checkpoint;  // an image when there is a checkpoint
+} RunSnapshot;
+
+typedef struct RunHistory {
+    Interpreter *interpreter;
+    RunSnapshot *snapshots;
+    size_t snapshotCount;
+    size_t interval;
+    GridImage synced;  // the grid is this image but for its changed tiles
+    size_t furthestSteps;
+    bool finished;
+    RunResult result;  // once finished, how the run ended
+} RunHistory;
+
+// The interpreter has to be at the start of its run
+void initRunHistory(RunHistory *history, Interpreter *interpreter);
+
+void freeRunHistory(RunHistory *history);
+
+// stepInterpreter, taking snapshots on the way
+InterpreterExitCode stepRunHistory(RunHistory *history);
+
+// Brings the run to the given step, or to its end if that comes first,
+// going back through a snapshot when needed. Returns how the run ended if
+// it did on the way and INTERPRETER_NORMAL otherwise
+InterpreterExitCode seekRunHistory(RunHistory *history, size_t steps);
+
+
+#endif // !KUMIR_HISTORY_H
@@ -0,0 +1,706 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "interpreter.h"
+
+
+void printErrcode(InterpreterExitCode code, size_t lineNum) {
+    if (code == INTERPRETER_NORMAL || code == INTERPRETER_SKIP_LINE) return;
+    printf("\033[31mInterpreter error at line %zu: ", lineNum);
+    switch (code) {
+    case INTERPRETER_ERROR: puts("Unexpected error\033[0m"); break;
+    case INTERPRETER_FINISHED: puts("Program finished\033[0m"); break;
+    case INTERPRETER_FORCE_EXIT: puts("'exit' called to terminate\033[0m"); break;
+    case INTERPRETER_INVALID_TOKEN: puts("Encountered an invalid token\033[0m"); break;
+    case INTERPRETER_STACK_OVERFLOW: puts("Loop stack overflow\033[0m"); break;
+    case INTERPRETER_SYNTAX_ERROR: puts("Syntax error\033[0m"); break;
+    case INTERPRETER_STEP_LIMIT: puts("Step limit exceeded\033[0m"); break;
+    case INTERPRETER_TIMEOUT: puts("Time limit exceeded\033[0m"); break;
+    case INTERPRETER_INFINITE_LOOP: puts("Infinite loop: the program returned to an earlier state\033[0m"); break;
+    default: break;
+    }
+}
+
+const char *getErrcodeName(InterpreterExitCode code) {
+    switch (code) {
+    case INTERPRETER_NORMAL: return "normal";
+    case INTERPRETER_SKIP_LINE: return "skip_line";
+    case INTERPRETER_FINISHED: return "finished";
+    case INTERPRETER_FORCE_EXIT: return "force_exit";
+    case INTERPRETER_ERROR: return "error";
+    case INTERPRETER_INVALID_TOKEN: return "invalid_token";
+    case INTERPRETER_STACK_OVERFLOW: return "stack_overflow";
+    case INTERPRETER_SYNTAX_ERROR: return "syntax_error";
+    case INTERPRETER_STEP_LIMIT: return "step_limit";
+    case INTERPRETER_TIMEOUT: return "timeout";
+    case INTERPRETER_INFINITE_LOOP: return "infinite_loop";
+    default: return "unknown";
+    }
+}
+
+double getTimeSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Condition _m_makeCheckCondition(Direction dir, bool negate) {
+    Condition condition = 0;
+    for (unsigned mask = 0; mask < 16; mask++) {
+        bool isFree = !(mask & (1 << dir));
+        if (isFree != negate)
+            condition |= 1 << mask;
+    }
+    return condition;
+}
+
+// Conditions are folded left to right with no precedence between и/или
+static InterpreterExitCode _m_parseLogicExpression(Lexer *lexer, Token *token, Condition *result) {
+    Keyword op = KEYWORD_NONE;
+    while (true) {
+        bool negate = false;
+        if (token->type == TOKEN_KEYWORD && token->keyword == KEYWORD_NOT) {
+            negate = true;
+            *token = lexNextToken(lexer);
+        }
+        if (token->type != TOKEN_KEYWORD)
+            return token->type == TOKEN_INVALID ? INTERPRETER_INVALID_TOKEN : INTERPRETER_SYNTAX_ERROR;
+
+        Direction dir;
+        switch (token->keyword) {
+        case KEYWORD_CHECK_UP: dir = DIRECTION_UP; break;
+        case KEYWORD_CHECK_DOWN: dir = DIRECTION_DOWN; break;
+        case KEYWORD_CHECK_LEFT: dir = DIRECTION_LEFT; break;
+        case KEYWORD_CHECK_RIGHT: dir = DIRECTION_RIGHT; break;
+        default: return INTERPRETER_SYNTAX_ERROR;
+        }
+        *token = lexNextToken(lexer);
+        if (token->type != TOKEN_KEYWORD || token->keyword != KEYWORD_CHECK_CLEAR)
+            return INTERPRETER_SYNTAX_ERROR;
+        *token = lexNextToken(lexer);
+
+        Condition check = _m_makeCheckCondition(dir, negate);
+        if (op == KEYWORD_AND)
+            *result &= check;
+        else if (op == KEYWORD_OR)
+            *result |= check;
+        else
+            *result = check;
+
+        if (token->type != TOKEN_KEYWORD || (token->keyword != KEYWORD_AND && token->keyword != KEYWORD_OR))
+            return INTERPRETER_NORMAL;
+        op = token->keyword;
+        *token = lexNextToken(lexer);
+    }
+}
+
+static Instruction *_m_emitInstruction(Program *program, OpCode op, size_t line) {
+    if (program->size == program->capacity) {
+        program->capacity = program->capacity ? program->capacity * 2 : 64;
+        program->code = (Instruction *)realloc(program->code, program->capacity * sizeof(Instruction));
+    }
+    Instruction *instr = &program->code[program->size++];
+    *instr = (Instruction){ .op = op, .line = line, .target = NO_TARGET, .condition = CONDITION_ALWAYS };
+    return instr;
+}
+
+static InterpreterExitCode _m_pushBlock(ProgramCompiler *compiler, OpCode op) {
+    if (compiler->stackSize == compiler->stackCapacity) {
+        compiler->stackCapacity = compiler->stackCapacity ? compiler->stackCapacity * 2 : 32;
+        compiler->stack = (BlockStackItem *)realloc(compiler->stack, compiler->stackCapacity * sizeof(BlockStackItem));
+    }
+    compiler->stack[compiler->stackSize++] = (BlockStackItem){
+        .op = op,
+        .index = compiler->program->size - 1,
+        .lastBreak = NO_TARGET
+    };
+    return INTERPRETER_NORMAL;
+}
+
+static InterpreterExitCode _m_compileLine(ProgramCompiler *compiler, const char *line, size_t lineNum) {
+    Program *program = compiler->program;
+
+    Lexer lexer = makeLexer(line, compiler->language);
+    Token token = lexNextToken(&lexer);
+    if (token.type == TOKEN_END) return INTERPRETER_SKIP_LINE;
+    if (token.type != TOKEN_KEYWORD) return INTERPRETER_INVALID_TOKEN;
+
+    Keyword keyword = token.keyword;
+    token = lexNextToken(&lexer);
+
+    InterpreterExitCode code = INTERPRETER_NORMAL;
+    switch (keyword) {
+    case KEYWORD_ENDIF: {
+        if (compiler->stackSize == 0 || compiler->stack[compiler->stackSize - 1].op != OP_IF)
+            return INTERPRETER_SYNTAX_ERROR;
+        BlockStackItem block = compiler->stack[--compiler->stackSize];
+        program->code[block.index].target = program->size;
+        break;
+    }
+    case KEYWORD_ENDLOOP: {
+        if (compiler->stackSize == 0 || compiler->stack[compiler->stackSize - 1].op != OP_LOOP)
+            return INTERPRETER_SYNTAX_ERROR;
+        BlockStackItem block = compiler->stack[--compiler->stackSize];
+        _m_emitInstruction(program, OP_ENDLOOP, lineNum)->target = block.index;
+        program->code[block.index].target = program->size;
+        // Breaks are chained through their targets until the loop end is known
+        for (size_t brk = block.lastBreak; brk != NO_TARGET;) {
+            size_t next = program->code[brk].target;
+            program->code[brk].target = program->size;
+            brk = next;
+        }
+        break;
+    }
+    case KEYWORD_EXIT:
+        _m_emitInstruction(program, OP_EXIT, lineNum);
+        break;
+    case KEYWORD_EXITLOOP: {
+        size_t loop = compiler->stackSize;
+        while (loop > 0 && compiler->stack[loop - 1].op != OP_LOOP) loop--;
+        if (loop == 0)
+            return INTERPRETER_SYNTAX_ERROR;
+        BlockStackItem *block = &compiler->stack[loop - 1];
+        _m_emitInstruction(program, OP_EXITLOOP, lineNum)->target = block->lastBreak;
+        block->lastBreak = program->size - 1;
+        break;
+    }
+    case KEYWORD_IF: {
+        Condition condition;
+        code = _m_parseLogicExpression(&lexer, &token, &condition);
+        if (code != INTERPRETER_NORMAL) return code;
+        if (token.type != TOKEN_KEYWORD || token.keyword != KEYWORD_THEN)
+            return INTERPRETER_SYNTAX_ERROR;
+        token = lexNextToken(&lexer);
+        _m_emitInstruction(program, OP_IF, lineNum)->condition = condition;
+        code = _m_pushBlock(compiler, OP_IF);
+        break;
+    }
+    case KEYWORD_LOOP: {
+        Condition condition = CONDITION_ALWAYS;
+        if (token.type == TOKEN_KEYWORD && token.keyword == KEYWORD_WHILE) {
+            token = lexNextToken(&lexer);
+            code = _m_parseLogicExpression(&lexer, &token, &condition);
+            if (code != INTERPRETER_NORMAL) return code;
+        }
+        _m_emitInstruction(program, OP_LOOP, lineNum)->condition = condition;
+        code = _m_pushBlock(compiler, OP_LOOP);
+        break;
+    }
+    case KEYWORD_PAINT:
+        _m_emitInstruction(program, OP_PAINT, lineNum);
+        break;
+    case KEYWORD_GO_UP:
+        _m_emitInstruction(program, OP_GO_UP, lineNum);
+        break;
+    case KEYWORD_GO_DOWN:
+        _m_emitInstruction(program, OP_GO_DOWN, lineNum);
+        break;
+    case KEYWORD_GO_LEFT:
+        _m_emitInstruction(program, OP_GO_LEFT, lineNum);
+        break;
+    case KEYWORD_GO_RIGHT:
+        _m_emitInstruction(program, OP_GO_RIGHT, lineNum);
+        break;
+    case KEYWORD_SETPOS: {
+        Token x = token, comma = lexNextToken(&lexer), y = lexNextToken(&lexer);
+        if (x.type != TOKEN_NUMBER || comma.type != TOKEN_COMMA || y.type != TOKEN_NUMBER)
+            return INTERPRETER_SYNTAX_ERROR;
+        token = lexNextToken(&lexer);
+        Instruction *instr = _m_emitInstruction(program, OP_SETPOS, lineNum);
+        instr->x = x.number;
+        instr->y = y.number;
+        break;
+    }
+    default:
+        return INTERPRETER_SYNTAX_ERROR;
+    }
+
+    if (code == INTERPRETER_NORMAL && token.type != TOKEN_END)
+        return token.type == TOKEN_INVALID ? INTERPRETER_INVALID_TOKEN : INTERPRETER_SYNTAX_ERROR;
+    return code;
+}
+
+void freeProgram(Program *program) {
+    free(program->code);
+    program->code = NULL;
+    program->size = 0;
+    program->capacity = 0;
+}
+
+static bool _m_isMoveOp(OpCode op) {
+    return op >= OP_GO_UP && op <= OP_GO_RIGHT;
+}
+
+void removeDeadCode(Program *program) {
+    size_t size = program->size;
+    bool *reachable = (bool *)calloc(size + 1, sizeof(bool));
+    size_t *stack = nmallocT(size_t, (size + 1) * 2);
+    size_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        size_t pc = stack[--stackSize];
+        if (pc > size || reachable[pc]) continue;
+        reachable[pc] = true;
+        if (pc == size) continue;
+        const Instruction *instr = &program->code[pc];
+        switch (instr->op) {
+        case OP_IF:
+        case OP_LOOP:
+            stack[stackSize++] = instr->target;
+            stack[stackSize++] = pc + 1;
+            break;
+        case OP_ENDLOOP:
+        case OP_EXITLOOP:
+            stack[stackSize++] = instr->target;
+            break;
+        case OP_EXIT:
+            break;
+        default:
+            stack[stackSize++] = pc + 1;
+            break;
+        }
+    }
+
+    size_t *remap = nmallocT(size_t, (size + 1));
+    size_t newSize = 0;
+    for (size_t pc = 0; pc < size; pc++) {
+        remap[pc] = newSize;
+        if (reachable[pc])
+            program->code[newSize++] = program->code[pc];
+    }
+    remap[size] = newSize;
+    for (size_t pc = 0; pc < newSize; pc++) {
+        Instruction *instr = &program->code[pc];
+        if (instr->op == OP_IF || instr->op == OP_LOOP || instr->op == OP_ENDLOOP || instr->op == OP_EXITLOOP)
+            instr->target = remap[instr->target];
+    }
+    program->size = newSize;
+    free(remap);
+    free(stack);
+    free(reachable);
+}
+
+void fuseSlideLoops(Program *program) {
+    for (size_t i = 0; i < program->size; i++) {
+        Instruction *loop = &program->code[i];
+        if (loop->op != OP_LOOP || loop->target < i + 3 || loop->target > i + 4)
+            continue;
+        size_t bodySize = loop->target - i - 2;
+        const Instruction *body = &program->code[i + 1];
+        size_t move = 0;
+        FusedPaint paint = FUSED_PAINT_NONE;
+        if (bodySize == 2 && body[0].op == OP_PAINT) {
+            move = 1;
+            paint = FUSED_PAINT_BEFORE;
+        } else if (bodySize == 2 && body[1].op == OP_PAINT) {
+            paint = FUSED_PAINT_AFTER;
+        } else if (bodySize != 1) {
+            continue;
+        }
+        OpCode op = body[move].op;
+        if (!_m_isMoveOp(op) || body[bodySize].op != OP_ENDLOOP)
+            continue;
+        Direction dir = (Direction)(op - OP_GO_UP);
+        if (loop->condition != _m_makeCheckCondition(dir, false))
+            continue;
+        loop->op = OP_SLIDE;
+        loop->x = dir;
+        loop->y = paint;
+    }
+}
+
+void fuseMoveRuns(Program *program) {
+    size_t size = program->size;
+    size_t *moveRun = nmallocT(size_t, (size + 1));
+    size_t *strideRun = nmallocT(size_t, (size + 1));
+    int *strideDir = nmallocT(int, (size + 1));
+    moveRun[size] = strideRun[size] = 0;
+    strideDir[size] = -1;
+    for (size_t i = size; i-- > 0;) {
+        const Instruction *instr = &program->code[i];
+        const Instruction *next = i + 1 < size ? &program->code[i + 1] : NULL;
+        moveRun[i] = strideRun[i] = 0;
+        strideDir[i] = -1;
+        if (_m_isMoveOp(instr->op)) {
+            moveRun[i] = next != NULL && next->op == instr->op ? moveRun[i + 1] + 1 : 1;
+            strideDir[i] = instr->op - OP_GO_UP;
+            bool extends = next != NULL && next->op == OP_PAINT && (strideDir[i + 1] == -1 || strideDir[i + 1] == strideDir[i]);
+            strideRun[i] = extends ? strideRun[i + 1] + 1 : 1;
+        } else if (instr->op == OP_PAINT) {
+            bool extends = next != NULL && _m_isMoveOp(next->op);
+            strideRun[i] = extends ? strideRun[i + 1] + 1 : 1;
+            strideDir[i] = extends ? strideDir[i + 1] : -1;
+        }
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        Instruction *instr = &program->code[i];
+        if (moveRun[i] >= 2) {
+            instr->x = instr->op - OP_GO_UP;
+            instr->y = FUSED_PAINT_NONE;
+            instr->target = i + moveRun[i];
+        } else if (strideRun[i] >= 2) {
+            instr->x = strideDir[i];
+            instr->y = instr->op == OP_PAINT ? FUSED_PAINT_BEFORE : FUSED_PAINT_AFTER;
+            instr->target = i + strideRun[i];
+        } else {
+            continue;
+        }
+        instr->op = OP_MOVE_RUN;
+    }
+    free(moveRun);
+    free(strideRun);
+    free(strideDir);
+}
+
+void optimizeProgram(Program *program) {
+    removeDeadCode(program);
+    fuseSlideLoops(program);
+    fuseMoveRuns(program);
+}
+
+bool isProgramFile(const char *filename) {
+    if (!hasFileExt(filename, FILE_EXTENSION)) {
+        puts("Incorrect file extension. Expected \"*." FILE_EXTENSION "\"");
+        return false;
+    }
+    if (!fileExists(filename)) {
+        puts("File doesn't exist (or doesn't have an extension)");
+        return false;
+    }
+    return true;
+}
+
+static InterpreterExitCode _m_finishProgram(ProgramCompiler *compiler, size_t lineNum, size_t *errorLine) {
+    Program *program = compiler->program;
+    program->lineCount = lineNum;
+    bool unclosed = compiler->stackSize != 0;
+    if (unclosed)
+        *errorLine = program->code[compiler->stack[compiler->stackSize - 1].index].line;
+    free(compiler->stack);
+    if (unclosed) {
+        freeProgram(program);
+        return INTERPRETER_SYNTAX_ERROR;
+    }
+    optimizeProgram(program);
+    return INTERPRETER_NORMAL;
+}
+
+// The lexer stops at the newline or the '\0' ending a line, so a line
+// that ends with a newline is lexed in place
+InterpreterExitCode compileProgramBuffer(const char *data, size_t size, Language lang, Program *program, size_t *lineNum) {
+    *program = (Program){ .code = NULL, .size = 0, .capacity = 0, .lineCount = 0 };
+    ProgramCompiler compiler = { .program = program, .language = lang, .stack = NULL, .stackSize = 0, .stackCapacity = 0 };
+
+    *lineNum = 0;
+    const char *end = data + size;
+    for (const char *line = data; line < end;) {
+        const char *newline = memchr(line, '\n', end - line);
+        (*lineNum)++;
+        InterpreterExitCode code;
+        if (newline != NULL) {
+            code = _m_compileLine(&compiler, line, *lineNum);
+            line = newline + 1;
+        } else {
+            char *last = strndup(line, end - line);
+            code = _m_compileLine(&compiler, last, *lineNum);
+            free(last);
+            line = end;
+        }
+        if (code != INTERPRETER_NORMAL && code != INTERPRETER_SKIP_LINE) {
+            free(compiler.stack);
+            freeProgram(program);
+            return code;
+        }
+    }
+    return _m_finishProgram(&compiler, *lineNum, lineNum);
+}
+
+InterpreterExitCode compileProgramSource(const char *source, Language lang, Program *program, size_t *lineNum) {
+    return compileProgramBuffer(source, strlen(source), lang, program, lineNum);
+}
+
+InterpreterExitCode compileProgramFile(const char *filename, Language lang, Program *program, size_t *lineNum) {
+    MappedFile source;
+    if (mapFile(filename, &source) == EXIT_FAILURE) {
+        *program = (Program){ .code = NULL, .size = 0, .capacity = 0, .lineCount = 0 };
+        *lineNum = 0;
+        return INTERPRETER_ERROR;
+    }
+    InterpreterExitCode code = compileProgramBuffer((const char *)source.data, source.size, lang, program, lineNum);
+    unmapFile(&source);
+    return code;
+}
+
+InterpreterExitCode compileProgram(const char *filename, Program *program, size_t *lineNum) {
+    return compileProgramFile(filename, getKeywordLanguage(), program, lineNum);
+}
+
+size_t getInstructionLine(const Program *program, size_t pc) {
+    if (pc < program->size)
+        return program->code[pc].line;
+    return program->lineCount;
+}
+
+InterpreterLimits makeDefaultLimits() {
+    return (InterpreterLimits){ .maxSteps = 0, .maxSeconds = 0, .detectLoops = true };
+}
+
+void initInterpreter(Interpreter *interpreter, const Program *program, Robot *robot, Grid *grid) {
+    *interpreter = (Interpreter){
+        .program = program,
+        .robot = robot,
+        .grid = grid,
+        .pc = 0,
+        .steps = 0,
+        .limits = makeDefaultLimits(),
+        .loopCheck = { .hasCheckpoint = false },
+        .stepFused = false,
+        .step = stepInterpreter,
+        .profile = NULL,
+        .trace = NULL
+    };
+}
+
+void setInterpreterLimits(Interpreter *interpreter, InterpreterLimits limits) {
+    interpreter->limits = limits;
+}
+
+void freeInterpreter(Interpreter *interpreter) {
+    if (interpreter->loopCheck.hasCheckpoint)
+        freeGrid(&interpreter->loopCheck.paint);
+    interpreter->loopCheck.hasCheckpoint = false;
+}
+
+Interpreter *createInterpreter(const Program *program, Robot *robot, Grid *grid) {
+    Interpreter *interpreter = mallocT(Interpreter);
+    if (interpreter != NULL)
+        initInterpreter(interpreter, program, robot, grid);
+    return interpreter;
+}
+
+void resetInterpreter(Interpreter *interpreter, Robot *robot, Grid *grid) {
+    freeInterpreter(interpreter);
+    interpreter->robot = robot;
+    interpreter->grid = grid;
+    interpreter->pc = 0;
+    interpreter->steps = 0;
+}
+
+void destroyInterpreter(Interpreter *interpreter) {
+    if (interpreter == NULL) return;
+    freeInterpreter(interpreter);
+    free(interpreter);
+}
+
+static bool _m_isLoopCheckpoint(const LoopCheck *check, const Interpreter *interpreter) {
+    return check->pc == interpreter->pc
+        && check->posX == interpreter->robot->posX
+        && check->posY == interpreter->robot->posY
+        && isGridPaintEqual(&check->paint, interpreter->grid);
+}
+
+// Called on every visit of an нц; returns true once a state repeats
+static bool _m_checkLoopState(Interpreter *interpreter) {
+    LoopCheck *check = &interpreter->loopCheck;
+    if (check->hasCheckpoint) {
+        if (_m_isLoopCheckpoint(check, interpreter))
+            return true;
+        if (++check->length < check->power)
+            return false;
+        freeGrid(&check->paint);
+        check->power *= 2;
+    } else {
+        check->power = 1;
+    }
+    check->hasCheckpoint = true;
+    check->length = 0;
+    check->pc = interpreter->pc;
+    check->posX = interpreter->robot->posX;
+    check->posY = interpreter->robot->posY;
+    copyGrid(&check->paint, interpreter->grid);
+    return false;
+}
+
+size_t getInterpreterLine(const Interpreter *interpreter) {
+    return getInstructionLine(interpreter->program, interpreter->pc);
+}
+
+// Runs a whole OP_SLIDE loop and counts the steps the loop would take
+// one instruction at a time. Returns false when that would cross the
+// step limit, so the loop is stepped through and stops at the same place
+static bool _m_runSlide(Interpreter *interpreter, const Instruction *instr) {
+    Robot *robot = interpreter->robot;
+    int dx = m_directionX[instr->x], dy = m_directionY[instr->x];
+    int moves = getGridFreeRun(interpreter->grid, robot->posX, robot->posY, dx, dy);
+    size_t bodySteps = instr->y == FUSED_PAINT_NONE ? 1 : 2;
+    size_t steps = (size_t)moves * (bodySteps + 1) + 1;
+    if (interpreter->limits.maxSteps && interpreter->steps + steps > interpreter->limits.maxSteps)
+        return false;
+
+    if (instr->y == FUSED_PAINT_BEFORE)
+        flipGridSpan(interpreter->grid, robot->posX, robot->posY, dx, dy, moves);
+    else if (instr->y == FUSED_PAINT_AFTER)
+        flipGridSpan(interpreter->grid, robot->posX + dx, robot->posY + dy, dx, dy, moves);
+    robot->posX += dx * moves;
+    robot->posY += dy * moves;
+    interpreter->steps += steps;
+    interpreter->pc = instr->target;
+    return true;
+}
+
+// Runs an OP_MOVE_RUN up to its end or up to the move that hits a wall,
+// which is then reported from its own pc with the cells before it done.
+// Returns false when the run would cross the step limit
+static bool _m_runMoveRun(Interpreter *interpreter, const Instruction *instr, InterpreterExitCode *code) {
+    Robot *robot = interpreter->robot;
+    int dx = m_directionX[instr->x], dy = m_directionY[instr->x];
+    size_t length = instr->target - interpreter->pc;
+    size_t moves = instr->y == FUSED_PAINT_NONE ? length
+                 : instr->y == FUSED_PAINT_BEFORE ? length / 2
+                 : (length + 1) / 2;
+    size_t freeRun = getGridFreeRun(interpreter->grid, robot->posX, robot->posY, dx, dy);
+
+    // Number of instructions that succeed: all of them, or those before
+    // the first move past freeRun
+    size_t executed = length;
+    *code = INTERPRETER_NORMAL;
+    if (freeRun < moves) {
+        moves = freeRun;
+        executed = instr->y == FUSED_PAINT_NONE ? moves
+                 : instr->y == FUSED_PAINT_BEFORE ? 2 * moves + 1
+                 : 2 * moves;
+        *code = INTERPRETER_ERROR;
+    }
+    // Stopping exactly at the limit has to be reported from the last
+    // instruction of the run, so that case is stepped through as well
+    if (interpreter->limits.maxSteps && interpreter->steps + executed >= interpreter->limits.maxSteps)
+        return false;
+
+    size_t paints = executed - moves;
+    if (paints > 0) {
+        int offset = instr->y == FUSED_PAINT_AFTER ? 1 : 0;
+        flipGridSpan(interpreter->grid, robot->posX + dx * offset, robot->posY + dy * offset, dx, dy, paints);
+    }
+    robot->posX += dx * (int)moves;
+    robot->posY += dy * (int)moves;
+    interpreter->steps += executed;
+    interpreter->pc += executed;
+    return true;
+}
+
+InterpreterExitCode stepInterpreter(Interpreter *interpreter) {
+    const Program *program = interpreter->program;
+    Robot *robot = interpreter->robot;
+    Grid *grid = interpreter->grid;
+
+    if (interpreter->pc >= program->size)
+        return INTERPRETER_FINISHED;
+    const Instruction *instr = &program->code[interpreter->pc];
+
+    switch (instr->op) {
+    case OP_GO_UP:
+        if (robotGoUp(robot, grid) == EXIT_FAILURE) return INTERPRETER_ERROR;
+        break;
+    case OP_GO_DOWN:
+        if (robotGoDown(robot, grid) == EXIT_FAILURE) return INTERPRETER_ERROR;
+        break;
+    case OP_GO_LEFT:
+        if (robotGoLeft(robot, grid) == EXIT_FAILURE) return INTERPRETER_ERROR;
+        break;
+    case OP_GO_RIGHT:
+        if (robotGoRight(robot, grid) == EXIT_FAILURE) return INTERPRETER_ERROR;
+        break;
+    case OP_PAINT:
+        flipGridColor(grid, robot->posX, robot->posY);
+        break;
+    case OP_SETPOS:
+        if (robotSetPos(robot, grid, instr->x, instr->y) == EXIT_FAILURE) return INTERPRETER_ERROR;
+        break;
+    case OP_MOVE_RUN: {
+        InterpreterExitCode code;
+        if (!interpreter->stepFused && _m_runMoveRun(interpreter, instr, &code))
+            return code;
+        if (instr->y == FUSED_PAINT_BEFORE)
+            flipGridColor(grid, robot->posX, robot->posY);
+        else if (robotGo(robot, grid, instr->x) == EXIT_FAILURE)
+            return INTERPRETER_ERROR;
+        break;
+    }
+    case OP_SLIDE:
+        if (!interpreter->stepFused && _m_runSlide(interpreter, instr))
+            return INTERPRETER_NORMAL;
+        if (!_m_solveCondition(instr->condition, robot, grid)) {
+            interpreter->pc = instr->target;
+            interpreter->steps++;
+            return INTERPRETER_NORMAL;
+        }
+        break;
+    case OP_LOOP:
+        if (interpreter->limits.detectLoops && _m_checkLoopState(interpreter))
+            return INTERPRETER_INFINITE_LOOP;
+        // fallthrough
+    case OP_IF:
+        if (!_m_solveCondition(instr->condition, robot, grid)) {
+            interpreter->pc = instr->target;
+            interpreter->steps++;
+            return INTERPRETER_NORMAL;
+        }
+        break;
+    case OP_ENDLOOP:
+        interpreter->pc = instr->target;
+        return INTERPRETER_SKIP_LINE;
+    case OP_EXITLOOP:
+        interpreter->pc = instr->target;
+        interpreter->steps++;
+        return INTERPRETER_NORMAL;
+    case OP_EXIT:
+        return INTERPRETER_FORCE_EXIT;
+    }
+    interpreter->pc++;
+    interpreter->steps++;
+    return INTERPRETER_NORMAL;
+}
+
+// Always inlined, so the call through step becomes a direct call when
+// step is the constant stepInterpreter
+static inline __attribute__((always_inline)) RunResult _m_runInterpreterLoop(Interpreter *interpreter, InterpreterStep step) {
+    const InterpreterLimits *limits = &interpreter->limits;
+    size_t maxSteps = limits->maxSteps ? limits->maxSteps : SIZE_MAX;
+    double deadline = limits->maxSeconds > 0 ? getTimeSeconds() + limits->maxSeconds : 0;
+    size_t nextClock = interpreter->steps + INTERPRETER_CLOCK_INTERVAL;
+    while (true) {
+        size_t pc = interpreter->pc;
+        InterpreterExitCode code = step(interpreter);
+        // A fused run that fails stops at the pc of the failing move
+        if (code == INTERPRETER_ERROR)
+            pc = interpreter->pc;
+        if (code == INTERPRETER_NORMAL || code == INTERPRETER_SKIP_LINE) {
+            if (interpreter->steps >= maxSteps && interpreter->pc < interpreter->program->size)
+                code = INTERPRETER_STEP_LIMIT;
+            else if (deadline > 0 && interpreter->steps >= nextClock) {
+                nextClock = interpreter->steps + INTERPRETER_CLOCK_INTERVAL;
+                if (getTimeSeconds() > deadline)
+                    code = INTERPRETER_TIMEOUT;
+            }
+        }
+        if (code != INTERPRETER_NORMAL && code != INTERPRETER_SKIP_LINE) {
+            return (RunResult){
+                .code = code,
+                .line = getInstructionLine(interpreter->program, pc),
+                .steps = interpreter->steps,
+                .pc = pc
+            };
+        }
+    }
+}
+
+RunResult runInterpreter(Interpreter *interpreter) {
+    if (interpreter->step == stepInterpreter)
+        return _m_runInterpreterLoop(interpreter, stepInterpreter);
+    return _m_runInterpreterLoop(interpreter, interpreter->step);
+}
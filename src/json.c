@@ -0,0 +1,256 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+
+typedef struct JsonParser {
+    const char *cur;
+    const char *end;
+} JsonParser;
+
+static void _m_skipJsonSpace(JsonParser *parser) {
+    while (parser->cur < parser->end && (*parser->cur == ' ' || *parser->cur == '\t' || *parser->cur == '\n' || *parser->cur == '\r'))
+        parser->cur++;
+}
+
+static bool _m_matchJsonWord(JsonParser *parser, const char *word) {
+    size_t length = strlen(word);
+    if ((size_t)(parser->end - parser->cur) < length || memcmp(parser->cur, word, length) != 0)
+        return false;
+    parser->cur += length;
+    return true;
+}
+
+static int _m_parseJsonHex(const char *c) {
+    int value = 0;
+    for (int i = 0; i < 4; i++) {
+        value <<= 4;
+        if (c[i] >= '0' && c[i] <= '9') value |= c[i] - '0';
+        else if (c[i] >= 'a' && c[i] <= 'f') value |= c[i] - 'a' + 10;
+        else if (c[i] >= 'A' && c[i] <= 'F') value |= c[i] - 'A' + 10;
+        else return -1;
+    }
+    return value;
+}
+
+static size_t _m_putUtf8(char *out, uint32_t code) {
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char)(0xC0 | code >> 6);
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char)(0xE0 | code >> 12);
+        out[1] = (char)(0x80 | (code >> 6 & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | code >> 18);
+    out[1] = (char)(0x80 | (code >> 12 & 0x3F));
+    out[2] = (char)(0x80 | (code >> 6 & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+// The decoded string is never longer than its escaped form
+static bool _m_parseJsonString(JsonParser *parser, char **string, size_t *length) {
+    parser->cur++;
+    const char *start = parser->cur;
+    while (parser->cur < parser->end && *parser->cur != '"') {
+        if (*parser->cur == '\\') parser->cur++;
+        parser->cur++;
+    }
+    if (parser->cur >= parser->end)
+        return false;
+    const char *stop = parser->cur++;
+
+    char *out = (char *)malloc(stop - start + 1);
+    size_t size = 0;
+    for (const char *c = start; c < stop; c++) {
+        if ((unsigned char)*c < 0x20)
+            goto fail;
+        if (*c != '\\') {
+            out[size++] = *c;
+            continue;
+        }
+        c++;
+        switch (*c) {
+        case '"': case '\\': case '/': out[size++] = *c; break;
+        case 'b': out[size++] = '\b'; break;
+        case 'f': out[size++] = '\f'; break;
+        case 'n': out[size++] = '\n'; break;
+        case 'r': out[size++] = '\r'; break;
+        case 't': out[size++] = '\t'; break;
+        case 'u': {
+            int code = stop - c > 4 ? _m_parseJsonHex(c + 1) : -1;
+            if (code < 0) goto fail;
+            c += 4;
+            // A surrogate pair is two escapes
+            if (code >= 0xD800 && code < 0xDC00 && stop - c > 6 && c[1] == '\\' && c[2] == 'u') {
+                int low = _m_parseJsonHex(c + 3);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    c += 6;
+                }
+            }
+            size += _m_putUtf8(out + size, code);
+            break;
+        }
+        default:
+            goto fail;
+        }
+    }
+    out[size] = '\0';
+    *string = out;
+    *length = size;
+    return true;
+
+fail:
+    free(out);
+    return false;
+}
+
+static bool _m_parseJsonValue(JsonParser *parser, JsonValue *value, int depth);
+
+static bool _m_parseJsonContainer(JsonParser *parser, JsonValue *value, int depth, bool isObject) {
+    char close = isObject ? '}' : ']';
+    size_t capacity = 0;
+    parser->cur++;
+    _m_skipJsonSpace(parser);
+    if (parser->cur < parser->end && *parser->cur == close) {
+        parser->cur++;
+        return true;
+    }
+    while (true) {
+        if (value->count == capacity) {
+            capacity = capacity ? capacity * 2 : 4;
+            value->items = (JsonValue *)realloc(value->items, capacity * sizeof(JsonValue));
+            if (isObject)
+                value->keys = (char **)realloc(value->keys, capacity * sizeof(char *));
+        }
+        if (isObject) {
+            _m_skipJsonSpace(parser);
+            size_t keyLength;
+            if (parser->cur >= parser->end || *parser->cur != '"' || !_m_parseJsonString(parser, &value->keys[value->count], &keyLength))
+                return false;
+            _m_skipJsonSpace(parser);
+            if (parser->cur >= parser->end || *parser->cur != ':') {
+                free(value->keys[value->count]);
+                return false;
+            }
+            parser->cur++;
+        }
+        if (!_m_parseJsonValue(parser, &value->items[value->count], depth + 1)) {
+            if (isObject) free(value->keys[value->count]);
+            return false;
+        }
+        value->count++;
+        _m_skipJsonSpace(parser);
+        if (parser->cur >= parser->end)
+            return false;
+        if (*parser->cur == close) {
+            parser->cur++;
+            return true;
+        }
+        if (*parser->cur != ',')
+            return false;
+        parser->cur++;
+    }
+}
+
+static bool _m_parseJsonNumber(JsonParser *parser, JsonValue *value) {
+    const char *start = parser->cur;
+    while (parser->cur < parser->end && strchr("+-0123456789.eE", *parser->cur) != NULL)
+        parser->cur++;
+    size_t length = parser->cur - start;
+    if (length == 0 || length > 63)
+        return false;
+    char buffer[64];
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    char *stop;
+    value->number = strtod(buffer, &stop);
+    return *stop == '\0';
+}
+
+static bool _m_parseJsonValue(JsonParser *parser, JsonValue *value, int depth) {
+    *value = (JsonValue){ .type = JSON_NULL };
+    _m_skipJsonSpace(parser);
+    if (parser->cur >= parser->end || depth > JSON_MAX_DEPTH)
+        return false;
+    value->raw = parser->cur;
+
+    bool ok;
+    switch (*parser->cur) {
+    case '{':
+        value->type = JSON_OBJECT;
+        ok = _m_parseJsonContainer(parser, value, depth, true);
+        break;
+    case '[':
+        value->type = JSON_ARRAY;
+        ok = _m_parseJsonContainer(parser, value, depth, false);
+        break;
+    case '"':
+        value->type = JSON_STRING;
+        ok = _m_parseJsonString(parser, &value->string, &value->length);
+        break;
+    case 't':
+    case 'f':
+        value->type = JSON_BOOL;
+        value->boolean = *parser->cur == 't';
+        ok = _m_matchJsonWord(parser, value->boolean ? "true" : "false");
+        break;
+    case 'n':
+        ok = _m_matchJsonWord(parser, "null");
+        break;
+    default:
+        value->type = JSON_NUMBER;
+        ok = _m_parseJsonNumber(parser, value);
+        break;
+    }
+    if (!ok) {
+        freeJson(value);
+        return false;
+    }
+    value->rawLength = parser->cur - value->raw;
+    return true;
+}
+
+bool parseJson(const char *text, size_t length, JsonValue *value) {
+    JsonParser parser = { .cur = text, .end = text + length };
+    if (!_m_parseJsonValue(&parser, value, 0))
+        return false;
+    _m_skipJsonSpace(&parser);
+    if (parser.cur != parser.end) {
+        freeJson(value);
+        return false;
+    }
+    return true;
+}
+
+void freeJson(JsonValue *value) {
+    for (size_t i = 0; i < value->count; i++) {
+        freeJson(&value->items[i]);
+        if (value->keys != NULL) free(value->keys[i]);
+    }
+    free(value->items);
+    free(value->keys);
+    free(value->string);
+    *value = (JsonValue){ .type = JSON_NULL };
+}
+
+const JsonValue *getJsonMember(const JsonValue *object, const char *key) {
+    if (object->type != JSON_OBJECT)
+        return NULL;
+    for (size_t i = 0; i < object->count; i++) {
+        if (strcmp(object->keys[i], key) == 0)
+            return &object->items[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,44 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef KUMIR_JSON_H
+#define KUMIR_JSON_H
+
+
+// Just enough JSON to read requests: a value is parsed into a tree whose
+// strings are decoded and NUL-terminated. Every value also keeps the span
+// of source text it came from, so it can be echoed back verbatim
+typedef enum {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+} JsonType;
+
+typedef struct JsonValue {
+    JsonType type;
+    bool boolean;
+    double number;
+    char *string;
+    size_t length;             // of string
+    struct JsonValue *items;   // array items or object values
+    char **keys;               // object keys
+    size_t count;
+    const char *raw;
+    size_t rawLength;
+} JsonValue;
+
+#define JSON_MAX_DEPTH 64
+
+// The whole text has to be one value, with nothing but whitespace around it
+bool parseJson(const char *text, size_t length, JsonValue *value);
+
+void freeJson(JsonValue *value);
+
+// NULL when the object has no such member or is not an object
+const JsonValue *getJsonMember(const JsonValue *object, const char *key);
+
+
+#endif // !KUMIR_JSON_H
@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "keywords.h"
+
+
+const char *m_keywordStrings[LANG_COUNT][KEYWORD_COUNT] = {
+    [LANG_EN] = {
+        [KEYWORD_IF]       = "if",
+        [KEYWORD_THEN]     = "then",
+        [KEYWORD_ENDIF]    = "endif",
+        [KEYWORD_LOOP]     = "loop",
+        [KEYWORD_WHILE]    = "while",
+        [KEYWORD_ENDLOOP]  = "endloop",
+        [KEYWORD_EXITLOOP] = "break",
+
+        [KEYWORD_NOT]      = "not",
+        [KEYWORD_AND]      = "and",
+        [KEYWORD_OR]       = "or",
+
+        [KEYWORD_EXIT]     = "exit",
+
+        [KEYWORD_SETPOS]   = "goto",
+        [KEYWORD_GO_UP]    = "go up",
+        [KEYWORD_GO_DOWN]  = "go down",
+        [KEYWORD_GO_LEFT]  = "go left",
+        [KEYWORD_GO_RIGHT] = "go right",
+        [KEYWORD_PAINT]    = "paint",
+
+        [KEYWORD_CHECK_CLEAR]  = "free",
+        [KEYWORD_CHECK_UP]     = "upwards",
+        [KEYWORD_CHECK_DOWN]   = "downwards",
+        [KEYWORD_CHECK_LEFT]   = "leftwards",
+        [KEYWORD_CHECK_RIGHT]  = "rightwards"
+    },
+    [LANG_RU] = {
+        [KEYWORD_IF]       = "если",
+        [KEYWORD_THEN]     = "то",
+        [KEYWORD_ENDIF]    = "все",
+        [KEYWORD_LOOP]     = "нц",
+        [KEYWORD_WHILE]    = "пока",
+        [KEYWORD_ENDLOOP]  = "кц",
+        [KEYWORD_EXITLOOP] = "прервать",
+
+        [KEYWORD_NOT]      = "не",
+        [KEYWORD_AND]      = "и",
+        [KEYWORD_OR]       = "или",
+
+        [KEYWORD_EXIT]     = "конец",
+
+        [KEYWORD_SETPOS]   = "переместить",
+        [KEYWORD_GO_UP]    = "вверх",
+        [KEYWORD_GO_DOWN]  = "вниз",
+        [KEYWORD_GO_LEFT]  = "влево",
+        [KEYWORD_GO_RIGHT] = "вправо",
+        [KEYWORD_PAINT]    = "закрасить",
+
+        [KEYWORD_CHECK_CLEAR]  = "свободно",
+        [KEYWORD_CHECK_UP]     = "сверху",
+        [KEYWORD_CHECK_DOWN]   = "снизу",
+        [KEYWORD_CHECK_LEFT]   = "слева",
+        [KEYWORD_CHECK_RIGHT]  = "справа"
+    }
+};
+
+Language m_keywordLanguage = LANG_RU;
+
+void setKeywordLanguage(Language lang) {
+    m_keywordLanguage = lang;
+}
+
+Language getKeywordLanguage() {
+    return m_keywordLanguage;
+}
+
+const char *getKeywordString(Keyword keyword) {
+    return m_keywordStrings[m_keywordLanguage][keyword];
+}
+
+bool parseLanguageName(const char *name, Language *lang) {
+    if (!strcmp(name, "ru")) *lang = LANG_RU;
+    else if (!strcmp(name, "en")) *lang = LANG_EN;
+    else return false;
+    return true;
+}
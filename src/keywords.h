@@ -1,88 +1,62 @@
+#include <stdbool.h>
+#include <string.h>
+
 #ifndef KUMIR_KEYWORDS_H
 #define KUMIR_KEYWORDS_H
 
-#define LANG_RU
-
-#ifdef LANG_EN
-
-// Control keywords
-
-#define KEYWORD_IF       "if"
-#define KEYWORD_THEN     "then"
-#define KEYWORD_ENDIF    "endif"
-#define KEYWORD_LOOP     "loop"
-#define KEYWORD_WHILE    "while"
-#define KEYWORD_ENDLOOP  "endloop"
-#define KEYWORD_EXITLOOP "break"
-
-#define KEYWORD_NOT      "not"
-#define KEYWORD_AND      "and"
-#define KEYWORD_OR       "or"
-
-#define KEYWORD_EXIT     "exit"
 
-// Robot keywords
+typedef enum {
+    LANG_RU,
+    LANG_EN,
+    LANG_COUNT
+} Language;
 
-#define KEYWORD_SETPOS   "goto"
-#define KEYWORD_GO_UP    "go up"
-#define KEYWORD_GO_DOWN  "go down"
-#define KEYWORD_GO_LEFT  "go left"
-#define KEYWORD_GO_RIGHT "go right"
-#define KEYWORD_PAINT    "paint"
+typedef enum {
+    KEYWORD_NONE,
 
-#define KEYWORD_CHECK_CLEAR  "free"
-#define KEYWORD_CHECK_UP     "upwards"
-#define KEYWORD_CHECK_DOWN   "downwards"
-#define KEYWORD_CHECK_LEFT   "leftwards"
-#define KEYWORD_CHECK_RIGHT  "rightwards"
+    // Control keywords
 
-#endif // LANG_EN
+    KEYWORD_IF,
+    KEYWORD_THEN,
+    KEYWORD_ENDIF,
+    KEYWORD_LOOP,
+    KEYWORD_WHILE,
+    KEYWORD_ENDLOOP,
+    KEYWORD_EXITLOOP,
 
-#ifdef LANG_RU
+    KEYWORD_NOT,
+    KEYWORD_AND,
+    KEYWORD_OR,
 
-// Control keywords
+    KEYWORD_EXIT,
 
-#define KEYWORD_IF       "если"
-#define KEYWORD_THEN     "то"
-#define KEYWORD_ENDIF    "все"
-#define KEYWORD_LOOP     "нц"
-#define KEYWORD_WHILE    "пока"
-#define KEYWORD_ENDLOOP  "кц"
-#define KEYWORD_EXITLOOP "прервать"
+    // Robot keywords
 
-#define KEYWORD_NOT      "не"
-#define KEYWORD_AND      "и"
-#define KEYWORD_OR       "или"
+    KEYWORD_SETPOS,
+    KEYWORD_GO_UP,
+    KEYWORD_GO_DOWN,
+    KEYWORD_GO_LEFT,
+    KEYWORD_GO_RIGHT,
+    KEYWORD_PAINT,
 
-#define KEYWORD_EXIT     "конец"
+    KEYWORD_CHECK_CLEAR,
+    KEYWORD_CHECK_UP,
+    KEYWORD_CHECK_DOWN,
+    KEYWORD_CHECK_LEFT,
+    KEYWORD_CHECK_RIGHT,
 
-// Robot keywords
+    KEYWORD_COUNT
+} Keyword;
 
-#define KEYWORD_SETPOS   "переместить"
-#define KEYWORD_GO_UP    "вверх"
-#define KEYWORD_GO_DOWN  "вниз"
-#define KEYWORD_GO_LEFT  "влево"
-#define KEYWORD_GO_RIGHT "вправо"
-#define KEYWORD_PAINT    "закрасить"
+extern const char *m_keywordStrings[LANG_COUNT][KEYWORD_COUNT];
 
-#define KEYWORD_CHECK_CLEAR  "свободно"
-#define KEYWORD_CHECK_UP     "сверху"
-#define KEYWORD_CHECK_DOWN   "снизу"
-#define KEYWORD_CHECK_LEFT   "слева"
-#define KEYWORD_CHECK_RIGHT  "справа"
+void setKeywordLanguage(Language lang);
 
-#endif // LANG_RU
+Language getKeywordLanguage(void);
 
-#define KEYWORD_LOOP_WHILE KEYWORD_LOOP" "KEYWORD_WHILE
+const char *getKeywordString(Keyword keyword);
 
-#define KEYWORD_CHECK_UP_FULL     KEYWORD_CHECK_UP" "KEYWORD_CHECK_CLEAR
-#define KEYWORD_CHECK_DOWN_FULL   KEYWORD_CHECK_DOWN" "KEYWORD_CHECK_CLEAR
-#define KEYWORD_CHECK_LEFT_FULL   KEYWORD_CHECK_LEFT" "KEYWORD_CHECK_CLEAR
-#define KEYWORD_CHECK_RIGHT_FULL  KEYWORD_CHECK_RIGHT" "KEYWORD_CHECK_CLEAR
+bool parseLanguageName(const char *name, Language *lang);
 
-#define KEYWORD_NOT_CHECK_UP_FULL     KEYWORD_NOT" "KEYWORD_CHECK_UP" "KEYWORD_CHECK_CLEAR
-#define KEYWORD_NOT_CHECK_DOWN_FULL   KEYWORD_NOT" "KEYWORD_CHECK_DOWN" "KEYWORD_CHECK_CLEAR
-#define KEYWORD_NOT_CHECK_LEFT_FULL   KEYWORD_NOT" "KEYWORD_CHECK_LEFT" "KEYWORD_CHECK_CLEAR
-#define KEYWORD_NOT_CHECK_RIGHT_FULL  KEYWORD_NOT" "KEYWORD_CHECK_RIGHT" "KEYWORD_CHECK_CLEAR
 
 #endif // !KUMIR_KEYWORDS_H
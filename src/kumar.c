@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "interpreter.h"
+#include "kumar.h"
+
+
+_Static_assert(KUMAR_FINISHED == (int)INTERPRETER_FINISHED && KUMAR_INFINITE_LOOP == (int)INTERPRETER_INFINITE_LOOP,
+               "KumarCode must mirror InterpreterExitCode");
+_Static_assert(KUMAR_CELL_WALL == (int)GRID_CELL_WALL, "KumarCell must mirror CellType");
+
+struct KumarProgram {
+    Program program;
+};
+
+struct KumarGrid {
+    Grid grid;
+    Robot robot;
+};
+
+int kumarGetApiVersion() {
+    return KUMAR_API_VERSION;
+}
+
+const char *kumarGetCodeName(KumarCode code) {
+    return getErrcodeName((InterpreterExitCode)code);
+}
+
+KumarLimits kumarDefaultLimits() {
+    InterpreterLimits limits = makeDefaultLimits();
+    return (KumarLimits){ .maxSteps = limits.maxSteps, .maxSeconds = limits.maxSeconds, .detectLoops = limits.detectLoops };
+}
+
+static KumarProgram *_m_finishCompile(InterpreterExitCode code, size_t lineNum, Program *program, KumarCode *error, size_t *errorLine) {
+    if (error != NULL) *error = code == INTERPRETER_NORMAL ? KUMAR_OK : (KumarCode)code;
+    if (errorLine != NULL) *errorLine = code == INTERPRETER_NORMAL ? 0 : lineNum;
+    if (code != INTERPRETER_NORMAL)
+        return NULL;
+    KumarProgram *result = mallocT(KumarProgram);
+    result->program = *program;
+    return result;
+}
+
+KumarProgram *kumarCompileFile(const char *filename, KumarLanguage lang, KumarCode *error, size_t *errorLine) {
+    Program program;
+    size_t lineNum;
+    InterpreterExitCode code = compileProgramFile(filename, lang == KUMAR_LANG_EN ? LANG_EN : LANG_RU, &program, &lineNum);
+    return _m_finishCompile(code, lineNum, &program, error, errorLine);
+}
+
+KumarProgram *kumarCompileString(const char *source, KumarLanguage lang, KumarCode *error, size_t *errorLine) {
+    Program program;
+    size_t lineNum;
+    InterpreterExitCode code = compileProgramSource(source, lang == KUMAR_LANG_EN ? LANG_EN : LANG_RU, &program, &lineNum);
+    return _m_finishCompile(code, lineNum, &program, error, errorLine);
+}
+
+void kumarFreeProgram(KumarProgram *program) {
+    if (program == NULL) return;
+    freeProgram(&program->program);
+    free(program);
+}
+
+KumarGrid *kumarCreateGrid(int width, int height) {
+    if (width <= 0 || width > GRID_MAX_SIZE || height <= 0 || height > GRID_MAX_SIZE)
+        return NULL;
+    KumarGrid *grid = mallocT(KumarGrid);
+    grid->grid = makeGrid();
+    grid->grid.width = width;
+    grid->grid.height = height;
+    generateGridData(&grid->grid);
+    grid->robot = makeRobot();
+    return grid;
+}
+
+KumarGrid *kumarLoadGrid(const char *filename) {
+    KumarGrid *grid = mallocT(KumarGrid);
+    grid->grid = makeGrid();
+    grid->robot = makeRobot();
+    if (loadGridFromFile(&grid->grid, filename, &grid->robot.posX, &grid->robot.posY) == EXIT_FAILURE) {
+        free(grid);
+        return NULL;
+    }
+    return grid;
+}
+
+bool kumarSaveGrid(const KumarGrid *grid, const char *filename) {
+    if (!hasFileExt(filename, GRID_EXTENSION))
+        return false;
+    return dumpGrid(&grid->grid, filename, grid->robot.posX, grid->robot.posY) == EXIT_SUCCESS;
+}
+
+KumarGrid *kumarCopyGrid(const KumarGrid *grid) {
+    KumarGrid *copy = mallocT(KumarGrid);
+    copyGrid(&copy->grid, &grid->grid);
+    copy->robot = grid->robot;
+    return copy;
+}
+
+void kumarFreeGrid(KumarGrid *grid) {
+    if (grid == NULL) return;
+    freeGrid(&grid->grid);
+    free(grid);
+}
+
+int kumarGetGridWidth(const KumarGrid *grid) {
+    return grid->grid.width;
+}
+
+int kumarGetGridHeight(const KumarGrid *grid) {
+    return grid->grid.height;
+}
+
+KumarCell kumarGetCell(const KumarGrid *grid, int x, int y) {
+    return (KumarCell)getGridCell(&grid->grid, x, y);
+}
+
+bool kumarSetCell(KumarGrid *grid, int x, int y, KumarCell cell) {
+    if (getGridCell(&grid->grid, x, y) == GRID_CELL_NONE || cell == KUMAR_CELL_NONE)
+        return false;
+    if (cell == KUMAR_CELL_WALL && x == grid->robot.posX && y == grid->robot.posY)
+        return false;
+    setGridCell(&grid->grid, x, y, (CellType)cell);
+    return true;
+}
+
+void kumarGetRobot(const KumarGrid *grid, int *x, int *y) {
+    *x = grid->robot.posX;
+    *y = grid->robot.posY;
+}
+
+bool kumarSetRobot(KumarGrid *grid, int x, int y) {
+    return robotSetPos(&grid->robot, &grid->grid, x, y) == EXIT_SUCCESS;
+}
+
+KumarResult kumarRun(const KumarProgram *program, KumarGrid *grid, const KumarLimits *limits) {
+    Interpreter interpreter;
+    initInterpreter(&interpreter, &program->program, &grid->robot, &grid->grid);
+    if (limits != NULL)
+        setInterpreterLimits(&interpreter, (InterpreterLimits){
+            .maxSteps = limits->maxSteps,
+            .maxSeconds = limits->maxSeconds,
+            .detectLoops = limits->detectLoops
+        });
+    RunResult result = runInterpreter(&interpreter);
+    freeInterpreter(&interpreter);
+    return (KumarResult){
+        .code = (KumarCode)result.code,
+        .line = result.line,
+        .steps = result.steps,
+        .x = grid->robot.posX,
+        .y = grid->robot.posY
+    };
+}
@@ -0,0 +1,101 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef KUMAR_H
+#define KUMAR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// The embedding API of kumar_core. Programs and grids are opaque handles
+// and every struct below only ever grows at the end, so code built
+// against an older KUMAR_API_VERSION keeps working. Nothing here needs
+// raylib or a display. A compiled program is read-only and can be run
+// on any number of grids at once from different threads; a grid must
+// only be used by one run at a time
+#define KUMAR_API_VERSION 1
+
+typedef struct KumarProgram KumarProgram;
+typedef struct KumarGrid KumarGrid;
+
+typedef enum {
+    KUMAR_LANG_RU,
+    KUMAR_LANG_EN
+} KumarLanguage;
+
+typedef enum {
+    KUMAR_CELL_NONE,   // outside the field
+    KUMAR_CELL_EMPTY,
+    KUMAR_CELL_FILLED,
+    KUMAR_CELL_WALL
+} KumarCell;
+
+// Same values and names as the exit codes printed by kumar check
+typedef enum {
+    KUMAR_OK = 0,
+    KUMAR_FINISHED = 2,
+    KUMAR_FORCE_EXIT,
+    KUMAR_ERROR,
+    KUMAR_INVALID_TOKEN,
+    KUMAR_STACK_OVERFLOW,
+    KUMAR_SYNTAX_ERROR,
+    KUMAR_STEP_LIMIT,
+    KUMAR_TIMEOUT,
+    KUMAR_INFINITE_LOOP
+} KumarCode;
+
+// Zero means no limit
+typedef struct KumarLimits {
+    size_t maxSteps;
+    double maxSeconds;
+    bool detectLoops;
+} KumarLimits;
+
+typedef struct KumarResult {
+    KumarCode code;
+    size_t line;
+    size_t steps;
+    int x;
+    int y;
+} KumarResult;
+
+int kumarGetApiVersion(void);
+
+const char *kumarGetCodeName(KumarCode code);
+
+KumarLimits kumarDefaultLimits(void);
+
+// On failure NULL is returned and, when given, *error and *errorLine
+// tell what went wrong and where
+KumarProgram *kumarCompileFile(const char *filename, KumarLanguage lang, KumarCode *error, size_t *errorLine);
+KumarProgram *kumarCompileString(const char *source, KumarLanguage lang, KumarCode *error, size_t *errorLine);
+void kumarFreeProgram(KumarProgram *program);
+
+// A new grid has no walls or paint and the robot at (0, 0)
+KumarGrid *kumarCreateGrid(int width, int height);
+KumarGrid *kumarLoadGrid(const char *filename);
+bool kumarSaveGrid(const KumarGrid *grid, const char *filename);
+KumarGrid *kumarCopyGrid(const KumarGrid *grid);
+void kumarFreeGrid(KumarGrid *grid);
+
+int kumarGetGridWidth(const KumarGrid *grid);
+int kumarGetGridHeight(const KumarGrid *grid);
+KumarCell kumarGetCell(const KumarGrid *grid, int x, int y);
+// Fails outside the field and on the robot's cell when cell is a wall
+bool kumarSetCell(KumarGrid *grid, int x, int y, KumarCell cell);
+void kumarGetRobot(const KumarGrid *grid, int *x, int *y);
+// Fails outside the field and on walls
+bool kumarSetRobot(KumarGrid *grid, int x, int y);
+
+// Runs the program on the grid in place: afterwards the grid holds the
+// final paint and robot position
+KumarResult kumarRun(const KumarProgram *program, KumarGrid *grid, const KumarLimits *limits);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !KUMAR_H
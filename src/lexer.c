@@ -0,0 +1,116 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lexer.h"
+
+
+static KeywordTrie m_keywordTries[LANG_COUNT];
+static pthread_once_t m_keywordTriesOnce = PTHREAD_ONCE_INIT;
+
+static uint16_t _m_trieFindChild(const KeywordTrie *trie, uint16_t node, unsigned char byte) {
+    for (uint16_t child = trie->nodes[node].child; child != KEYWORD_TRIE_NONE; child = trie->nodes[child].sibling) {
+        if (trie->nodes[child].byte == byte)
+            return child;
+    }
+    return KEYWORD_TRIE_NONE;
+}
+
+static void _m_trieInsert(KeywordTrie *trie, const char *str, Keyword keyword) {
+    uint16_t node = 0;
+    for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; c++) {
+        uint16_t child = _m_trieFindChild(trie, node, *c);
+        if (child == KEYWORD_TRIE_NONE) {
+            if (trie->size == KEYWORD_TRIE_MAX_NODES) {
+                puts("Keyword trie overflow");
+                exit(EXIT_FAILURE);
+            }
+            child = trie->size++;
+            trie->nodes[child] = (KeywordTrieNode){
+                .byte = *c,
+                .keyword = KEYWORD_NONE,
+                .child = KEYWORD_TRIE_NONE,
+                .sibling = trie->nodes[node].child
+            };
+            trie->nodes[node].child = child;
+        }
+        node = child;
+    }
+    trie->nodes[node].keyword = keyword;
+}
+
+static void _m_buildKeywordTries() {
+    for (int lang = 0; lang < LANG_COUNT; lang++) {
+        KeywordTrie *trie = &m_keywordTries[lang];
+        trie->nodes[0] = (KeywordTrieNode){ .keyword = KEYWORD_NONE };
+        trie->size = 1;
+        for (int keyword = KEYWORD_NONE + 1; keyword < KEYWORD_COUNT; keyword++)
+            _m_trieInsert(trie, m_keywordStrings[lang][keyword], keyword);
+    }
+}
+
+void initKeywordTries() {
+    pthread_once(&m_keywordTriesOnce, _m_buildKeywordTries);
+}
+
+Lexer makeLexer(const char *line, Language lang) {
+    initKeywordTries();
+    return (Lexer){ .cur = line, .trie = &m_keywordTries[lang] };
+}
+
+static bool _m_isTokenEnd(char c) {
+    return c == '\0' || c == '\n' || c == '\r' || c == ' ' || c == '\t' || c == ',' || c == '#';
+}
+
+Token lexNextToken(Lexer *lexer) {
+    const char *c = lexer->cur;
+    while (*c == ' ' || *c == '\t') c++;
+
+    if (*c == '\0' || *c == '\n' || *c == '\r' || *c == '#') {
+        lexer->cur = c;
+        return (Token){ .type = TOKEN_END };
+    }
+    if (*c == ',') {
+        lexer->cur = c + 1;
+        return (Token){ .type = TOKEN_COMMA };
+    }
+    if (*c == '-' || (*c >= '0' && *c <= '9')) {
+        bool negative = *c == '-';
+        if (negative) c++;
+        if (*c < '0' || *c > '9') {
+            lexer->cur = c;
+            return (Token){ .type = TOKEN_INVALID };
+        }
+        long value = 0;
+        for (; *c >= '0' && *c <= '9'; c++) {
+            if (value <= INT32_MAX)
+                value = value * 10 + (*c - '0');
+        }
+        lexer->cur = c;
+        if (!_m_isTokenEnd(*c) || value > INT32_MAX)
+            return (Token){ .type = TOKEN_INVALID };
+        return (Token){ .type = TOKEN_NUMBER, .number = (int)(negative ? -value : value) };
+    }
+
+    const KeywordTrie *trie = lexer->trie;
+    Keyword match = KEYWORD_NONE;
+    const char *matchEnd = c;
+    uint16_t node = 0;
+    for (const char *p = c; *p != '\0'; p++) {
+        node = _m_trieFindChild(trie, node, (unsigned char)*p);
+        if (node == KEYWORD_TRIE_NONE) break;
+        if (trie->nodes[node].keyword != KEYWORD_NONE && _m_isTokenEnd(p[1])) {
+            match = trie->nodes[node].keyword;
+            matchEnd = p + 1;
+        }
+    }
+
+    if (match == KEYWORD_NONE) {
+        while (!_m_isTokenEnd(*c)) c++;
+        lexer->cur = c;
+        return (Token){ .type = TOKEN_INVALID };
+    }
+    lexer->cur = matchEnd;
+    return (Token){ .type = TOKEN_KEYWORD, .keyword = match };
+}
@@ -0,0 +1,56 @@
+#include <stdint.h>
+
+#include "keywords.h"
+
+#ifndef KUMIR_LEXER_H
+#define KUMIR_LEXER_H
+
+
+// Keywords are matched byte by byte through a trie built once from
+// m_keywordStrings, so every line is scanned exactly once whatever
+// the number of keywords. Multi-word keywords ("go up") are stored
+// with their space and matched greedily.
+
+typedef struct KeywordTrieNode {
+    unsigned char byte;
+    Keyword keyword;
+    uint16_t child;
+    uint16_t sibling;
+} KeywordTrieNode;
+
+#define KEYWORD_TRIE_MAX_NODES 512
+#define KEYWORD_TRIE_NONE 0
+
+typedef struct KeywordTrie {
+    KeywordTrieNode nodes[KEYWORD_TRIE_MAX_NODES];
+    uint16_t size;
+} KeywordTrie;
+
+// The tries are read-only once built, so lexers on any thread share them
+void initKeywordTries(void);
+
+typedef enum {
+    TOKEN_END,
+    TOKEN_KEYWORD,
+    TOKEN_NUMBER,
+    TOKEN_COMMA,
+    TOKEN_INVALID
+} TokenType;
+
+typedef struct Token {
+    TokenType type;
+    Keyword keyword;
+    int number;
+} Token;
+
+typedef struct Lexer {
+    const char *cur;
+    const KeywordTrie *trie;
+} Lexer;
+
+Lexer makeLexer(const char *line, Language lang);
+
+Token lexNextToken(Lexer *lexer);
+
+
+#endif // !KUMIR_LEXER_H
@@ -1,224 +1,753 @@
-#include <raylib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "cache.h"
+#include "grade.h"
 #include "interpreter.h"
+#include "parallel.h"
+#include "profile.h"
 #include "robot.h"
+#include "serve.h"
+#include "sweep.h"
+#include "thumbnail.h"
+#include "trace.h"
+
+#ifdef KUMAR_GUI
+#include "viewer.h"
+#endif
+
+typedef struct RunOptions {
+    InterpreterLimits limits;
+    const char *cacheDir;
+    bool profile;
+    const char *profileJson;
+    const char *trace;      // a file for check, a folder for batch and grade
+    const char *thumbnail;  // the same
+    int cellSize;
+} RunOptions;
+
+// Removes the run options from argv wherever they are, so the commands
+// keep their positional arguments
+int extractRunOptions(int *argc, const char **argv, RunOptions *options) {
+    options->limits = makeDefaultLimits();
+    options->cacheDir = NULL;
+    options->profile = false;
+    options->profileJson = NULL;
+    options->trace = NULL;
+    options->thumbnail = NULL;
+    options->cellSize = THUMBNAIL_DEFAULT_CELL_SIZE;
+    int count = 1;
+    for (int i = 1; i < *argc; i++) {
+        if (streq(argv[i], "--max-steps") && i + 1 < *argc) {
+            long long value = atoll(argv[++i]);
+            if (value <= 0) {
+                puts("Expected a positive step limit");
+                return EXIT_FAILURE;
+            }
+            options->limits.maxSteps = (size_t)value;
+        } else if (streq(argv[i], "--timeout") && i + 1 < *argc) {
+            options->limits.maxSeconds = atof(argv[++i]);
+            if (options->limits.maxSeconds <= 0) {
+                puts("Expected a positive timeout in seconds");
+                return EXIT_FAILURE;
+            }
+        } else if (streq(argv[i], "--no-loop-check")) {
+            options->limits.detectLoops = false;
+        } else if (streq(argv[i], "--cache") && i + 1 < *argc) {
+            options->cacheDir = argv[++i];
+        } else if (streq(argv[i], "--profile")) {
+            options->profile = true;
+        } else if (streq(argv[i], "--profile-json") && i + 1 < *argc) {
+            options->profileJson = argv[++i];
+        } else if (streq(argv[i], "--trace") && i + 1 < *argc) {
+            options->trace = argv[++i];
+        } else if (streq(argv[i], "--thumbnail") && i + 1 < *argc) {
+            options->thumbnail = argv[++i];
+        } else if (streq(argv[i], "--cell-size") && i + 1 < *argc) {
+            options->cellSize = atoi(argv[++i]);
+            if (options->cellSize <= 0 || options->cellSize > THUMBNAIL_MAX_CELL_SIZE) {
+                printf("Expected a cell size from 1 to %d\n", THUMBNAIL_MAX_CELL_SIZE);
+                return EXIT_FAILURE;
+            }
+        } else {
+            argv[count++] = argv[i];
+        }
+    }
+    *argc = count;
+    // Both swap in their own step
+    if (options->trace != NULL && (options->profile || options->profileJson != NULL)) {
+        puts("Profiling and tracing can't be combined");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
 
-#define SCREEN_WIDTH 800
-#define SCREEN_HEIGHT 800
+// gridKey describes the grid before the run and is only used with a cache
+RunResult runWithOptions(const RunOptions *options, const Program *program, Robot *robot, Grid *grid, const CacheKey *gridKey) {
+    RunResult result;
+    CacheKey key;
+    if (options->cacheDir != NULL) {
+        key = makeRunCacheKey(program, gridKey, &options->limits);
+        if (loadCachedRun(options->cacheDir, &key, program, robot, grid, &result))
+            return result;
+    }
 
-#define FILE_EXTENSION "kum"
+    Interpreter interpreter;
+    initInterpreter(&interpreter, program, robot, grid);
+    setInterpreterLimits(&interpreter, options->limits);
+    result = runInterpreter(&interpreter);
+    freeInterpreter(&interpreter);
 
-FILE *openFile(const char *filename) {
-    char *m_filename = strdup(filename);
-    char *fileExt = getFileExt(m_filename);
-    if (fileExt[0] == '\0' || !streq(fileExt, FILE_EXTENSION)) {
-        puts("Incorrect file extension. Expected \"*." FILE_EXTENSION "\"");
-        return NULL;
-    }
-    free(fileExt);
+    if (options->cacheDir != NULL)
+        storeCachedRun(options->cacheDir, &key, robot, grid, &result);
+    return result;
+}
+
+bool isProfiling(const RunOptions *options) {
+    return options->profile || options->profileJson != NULL;
+}
 
-    if (!FileExists(m_filename)) {
-        puts("File doesn't exist (or doesn't have an extension)");
-        return NULL;
+// Profiled runs bypass the cache: a cached result has no profile. The
+// report goes to stderr so the verdict on stdout stays one JSON line
+RunResult runProfiled(const RunOptions *options, const Program *program, Robot *robot, Grid *grid) {
+    Profile profile = makeProfile(program);
+    Interpreter interpreter;
+    initInterpreter(&interpreter, program, robot, grid);
+    setInterpreterLimits(&interpreter, options->limits);
+    setInterpreterProfile(&interpreter, &profile);
+    RunResult result = runInterpreter(&interpreter);
+    freeInterpreter(&interpreter);
+
+    if (options->profile)
+        printProfileReport(stderr, &profile);
+    if (options->profileJson != NULL) {
+        FILE *file = fopen(options->profileJson, "w");
+        if (file != NULL) {
+            writeProfileJson(file, &profile);
+            fclose(file);
+        } else {
+            puts("Failed to open profile file");
+        }
     }
-    FILE *file = fopen(m_filename, "r");
-    if (file == NULL) {
-        puts("Failed to open file");
-        return NULL;
+    freeProfile(&profile);
+    return result;
+}
+
+// Traced runs bypass the cache as well, the trace needs every step
+RunResult runTraced(const RunOptions *options, const Program *program, Robot *robot, Grid *grid, const char *traceFilename) {
+    TraceRecorder recorder;
+    bool tracing = startTraceRecorder(&recorder, traceFilename, grid, robot->posX, robot->posY) == EXIT_SUCCESS;
+    if (!tracing)
+        printf("Failed to open trace file %s\n", traceFilename);
+
+    Interpreter interpreter;
+    initInterpreter(&interpreter, program, robot, grid);
+    setInterpreterLimits(&interpreter, options->limits);
+    if (tracing)
+        setInterpreterTrace(&interpreter, &recorder);
+    RunResult result = runInterpreter(&interpreter);
+    freeInterpreter(&interpreter);
+
+    if (tracing && finishTraceRecorder(&recorder, &result) == EXIT_FAILURE)
+        printf("Failed to write trace file %s\n", traceFilename);
+    return result;
+}
+
+// <folder>/<program>.<grid>.<extension>, from the names without their
+// folders and extensions
+char *makeRunFilename(const char *folder, const char *programFilename, const char *gridFilename, const char *extension) {
+    const char *names[2] = { programFilename, gridFilename };
+    size_t lengths[2];
+    for (int i = 0; i < 2; i++) {
+        const char *slash = strrchr(names[i], '/');
+        if (slash != NULL) names[i] = slash + 1;
+        const char *dot = strrchr(names[i], '.');
+        lengths[i] = dot != NULL && dot != names[i] ? (size_t)(dot - names[i]) : strlen(names[i]);
     }
-    return file;
+    size_t size = strlen(folder) + lengths[0] + lengths[1] + strlen(extension) + 4;
+    char *filename = nmallocT(char, size);
+    snprintf(filename, size, "%s/%.*s.%.*s.%s", folder,
+             (int)lengths[0], names[0], (int)lengths[1], names[1], extension);
+    return filename;
 }
 
-Grid makeGrid() {
-    return (Grid){
-        .width = 15,
-        .height = 15,
-        .cellSize = 50,
-        .backgroundColor = GREEN,
-        .filledBackgroundColor = PURPLE,
-        .wallColor = GRAY,
-        .gridColor = YELLOW,
-        .data = NULL
-    };
+void saveRunThumbnail(const RunOptions *options, const char *filename, const Grid *grid, const Robot *robot) {
+    Thumbnail thumbnail;
+    renderThumbnail(&thumbnail, grid, robot, options->cellSize);
+    if (saveThumbnail(&thumbnail, filename) == EXIT_FAILURE)
+        printf("Failed to write thumbnail %s\n", filename);
+    freeThumbnail(&thumbnail);
 }
 
-Robot makeRobot() {
-    return (Robot){
-        .posX = 0,
-        .posY = 0,
-        .size = 15,
-        .color = GRAY,
-        .innerSize = 10,
-        .innerColor = LIGHTGRAY
-    };
+// The fields of a verdict, without the braces around them
+void printVerdictFields(InterpreterExitCode code, size_t lineNum, size_t steps, const Robot *robot, const Grid *grid) {
+    printf("\"code\":\"%s\",\"line\":%zu,\"steps\":%zu,\"x\":%d,\"y\":%d,\"painted\":[",
+           getErrcodeName(code), lineNum, steps, robot->posX, robot->posY);
+    bool first = true;
+    for (int tileY = 0; tileY < grid->tilesY; tileY++) {
+        if (grid->tiles[tileY] == NULL) continue;
+        for (int y = tileY << GRID_TILE_SHIFT; y < grid->height && y < (tileY + 1) << GRID_TILE_SHIFT; y++) {
+            for (int tileX = 0; tileX < grid->tilesX; tileX++) {
+                const unsigned char *tile = getGridTile(grid, tileX, tileY);
+                if (tile == NULL) continue;
+                const unsigned char *cell = &tile[_m_gridTileIndex(0, y)];
+                for (int x = tileX << GRID_TILE_SHIFT, dx = 0; dx < GRID_TILE_SIZE; x++, dx++) {
+                    if ((cell[dx] & CELL_TYPE_MASK) != GRID_CELL_FILLED) continue;
+                    printf(first ? "[%d,%d]" : ",[%d,%d]", x, y);
+                    first = false;
+                }
+            }
+        }
+    }
+    putchar(']');
 }
 
-#define SECONDS_PER_STEP_DEFAULT 0.05
+void printVerdict(InterpreterExitCode code, size_t lineNum, size_t steps, const Robot *robot, const Grid *grid) {
+    putchar('{');
+    printVerdictFields(code, lineNum, steps, robot, grid);
+    puts("}");
+}
 
-int runProgram(int argc, const char **argv) {
+int runCheck(int argc, const char **argv) {
+    RunOptions options;
+    if (extractRunOptions(&argc, argv, &options) == EXIT_FAILURE) return EXIT_FAILURE;
     if (argc == 1) {
         puts("No filename found");
-        return -1;
+        return EXIT_FAILURE;
     } else if (argc == 2) {
         puts("No grid data filename found");
-        return -1;
+        return EXIT_FAILURE;
+    }
+    if (!isProgramFile(argv[1])) return EXIT_FAILURE;
+
+    Program program;
+    size_t currentLine;
+    InterpreterExitCode interpreterCode = compileProgram(argv[1], &program, &currentLine);
+    if (interpreterCode == INTERPRETER_ERROR) {
+        puts("Failed to open file");
+        return EXIT_FAILURE;
     }
-    FILE *file = openFile(argv[1]);
-    if (file == NULL) return EXIT_FAILURE;
 
     Grid grid = makeGrid();
     Robot robot = makeRobot();
 
-    if (loadGridFromFile(&grid, argv[2], &robot.posX, &robot.posY) == EXIT_FAILURE) return EXIT_FAILURE;
-
-    initInterpreter(&robot, &grid);
-
-    float secondsPerLineCycle;
-    bool isInstant = false;
-    if (argc == 3)
-        secondsPerLineCycle = SECONDS_PER_STEP_DEFAULT;
-    else {
-        secondsPerLineCycle = atof(argv[3]);
-        if (secondsPerLineCycle > 0.f)
-            secondsPerLineCycle = 1.f / secondsPerLineCycle;
-        else
-            isInstant = true;
-    }
-
-    size_t currentLine = 0;
-    float secondsSinceLineCycle = 0;
-    bool interpreterRunning = true;
-    InterpreterExitCode interpreterCode;
-    bool skipNextLineDelay = false;
-
-    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Kumar");
-
-    while (!WindowShouldClose()) {
-        if (interpreterRunning) {
-            if (!isInstant && !skipNextLineDelay)
-                secondsSinceLineCycle += GetFrameTime();
-            if (isInstant || skipNextLineDelay || secondsSinceLineCycle >= secondsPerLineCycle) {
-                skipNextLineDelay = false;
-                // printf(" -=- Line: %llu -=-\n", currentLine + 1);
-                interpreterCode = interpretLine(file, &currentLine);
-                if (interpreterCode != INTERPRETER_NORMAL && interpreterCode != INTERPRETER_SKIP_LINE) {
-                    interpreterRunning = false;
-                    printErrcode(interpreterCode, currentLine + 1);
-                    freeInterpreter();
-                } else
-                    currentLine++;
-                if (interpreterCode == INTERPRETER_SKIP_LINE)
-                    skipNextLineDelay = true;
-                secondsSinceLineCycle = 0;
-            }
-        }
+    if (loadGridFromFile(&grid, argv[2], &robot.posX, &robot.posY) == EXIT_FAILURE) {
+        freeProgram(&program);
+        return EXIT_FAILURE;
+    }
 
-        BeginDrawing();
-            ClearBackground(BLACK);
-            drawGrid(grid, SCREEN_WIDTH, SCREEN_HEIGHT);
-            drawRobot(robot, grid, SCREEN_WIDTH, SCREEN_HEIGHT);
-        EndDrawing();
+    RunResult result = { .code = interpreterCode, .line = currentLine, .steps = 0 };
+    if (interpreterCode == INTERPRETER_NORMAL) {
+        if (isProfiling(&options)) {
+            result = runProfiled(&options, &program, &robot, &grid);
+        } else if (options.trace != NULL) {
+            result = runTraced(&options, &program, &robot, &grid, options.trace);
+        } else {
+            CacheKey gridKey;
+            if (options.cacheDir != NULL)
+                gridKey = makeGridCacheKey(&grid, robot.posX, robot.posY);
+            result = runWithOptions(&options, &program, &robot, &grid, &gridKey);
+        }
     }
-    freeInterpreter();
+    interpreterCode = result.code;
+    if (options.thumbnail != NULL)
+        saveRunThumbnail(&options, options.thumbnail, &grid, &robot);
 
-    CloseWindow();
+    printVerdict(result.code, result.line, result.steps, &robot, &grid);
 
-    fclose(file);
-    return EXIT_SUCCESS;
+    freeProgram(&program);
+    freeGrid(&grid);
+
+    if (interpreterCode == INTERPRETER_FINISHED || interpreterCode == INTERPRETER_FORCE_EXIT)
+        return EXIT_SUCCESS;
+    return EXIT_FAILURE;
 }
 
-#define ROBOT_HOLD_SCALE_FACTOR 1.2f
-#define ROBOT_HOLD_ALPHA 200
+typedef struct BatchJob {
+    const char *gridFilename;
+    bool loaded;
+    RunResult result;
+    int robotPosX;
+    int robotPosY;
+    size_t paintedCells;
+    double seconds;
+} BatchJob;
+
+typedef struct BatchContext {
+    const Program *program;
+    const char *programFilename;
+    const RunOptions *options;
+    BatchJob *jobs;
+} BatchContext;
+
+void runBatchJob(void *context, size_t index) {
+    BatchContext *batch = context;
+    BatchJob *job = &batch->jobs[index];
 
-int runGridEditor(int argc, const char **argv) {
+    Grid grid = makeGrid();
+    Robot robot = makeRobot();
+    job->loaded = loadGridFromFile(&grid, job->gridFilename, &robot.posX, &robot.posY) == EXIT_SUCCESS;
+    if (!job->loaded) return;
+
+    double start = getTimeSeconds();
+    if (batch->options->trace != NULL) {
+        char *traceFilename = makeRunFilename(batch->options->trace, batch->programFilename, job->gridFilename, TRACE_EXTENSION);
+        job->result = runTraced(batch->options, batch->program, &robot, &grid, traceFilename);
+        free(traceFilename);
+    } else {
+        CacheKey gridKey;
+        if (batch->options->cacheDir != NULL)
+            gridKey = makeGridCacheKey(&grid, robot.posX, robot.posY);
+        job->result = runWithOptions(batch->options, batch->program, &robot, &grid, &gridKey);
+    }
+    job->seconds = getTimeSeconds() - start;
+
+    if (batch->options->thumbnail != NULL) {
+        char *thumbnailFilename = makeRunFilename(batch->options->thumbnail, batch->programFilename, job->gridFilename, THUMBNAIL_EXTENSION);
+        saveRunThumbnail(batch->options, thumbnailFilename, &grid, &robot);
+        free(thumbnailFilename);
+    }
+
+    job->robotPosX = robot.posX;
+    job->robotPosY = robot.posY;
+    job->paintedCells = countGridCells(&grid, GRID_CELL_FILLED);
+    freeGrid(&grid);
+}
+
+int runBatch(int argc, const char **argv) {
+    RunOptions options;
+    if (extractRunOptions(&argc, argv, &options) == EXIT_FAILURE) return EXIT_FAILURE;
+    if (isProfiling(&options)) {
+        puts("Profiling only works with check");
+        return EXIT_FAILURE;
+    }
     if (argc == 1) {
         puts("No filename found");
         return EXIT_FAILURE;
+    } else if (argc == 2) {
+        puts("No grid data filename found");
+        return EXIT_FAILURE;
+    }
+    if (!isProgramFile(argv[1])) return EXIT_FAILURE;
+
+    Program program;
+    size_t currentLine;
+    InterpreterExitCode interpreterCode = compileProgram(argv[1], &program, &currentLine);
+    if (interpreterCode == INTERPRETER_ERROR) {
+        puts("Failed to open file");
+        return EXIT_FAILURE;
     }
-    char *filename = strdup(argv[1]);
-    char *fileExt = getFileExt(filename);
-    if (fileExt[0] == '\0' || !streq(fileExt, GRID_EXTENSION)) {
-        puts("Incorrect file extension. Expected \"*." GRID_EXTENSION "\"");
+    if (interpreterCode != INTERPRETER_NORMAL) {
+        printErrcode(interpreterCode, currentLine);
         return EXIT_FAILURE;
     }
 
-    Grid grid = makeGrid();
+    char **gridFilenames = NULL;
+    size_t gridCount = 0;
+    for (int i = 2; i < argc; i++)
+        listFiles(argv[i], GRID_EXTENSION, &gridFilenames, &gridCount);
+
+    BatchJob *jobs = (BatchJob *)calloc(gridCount, sizeof(BatchJob));
+    int nameWidth = 4;
+    for (size_t i = 0; i < gridCount; i++) {
+        jobs[i].gridFilename = gridFilenames[i];
+        if ((int)strlen(gridFilenames[i]) > nameWidth)
+            nameWidth = strlen(gridFilenames[i]);
+    }
+
+    BatchContext batch = { .program = &program, .programFilename = argv[1], .options = &options, .jobs = jobs };
+    runParallel(runBatchJob, &batch, gridCount);
+
+    bool allPassed = gridCount > 0;
+    printf("%-*s  %-14s %8s %12s %6s %6s %8s %10s\n", nameWidth, "grid", "code", "line", "steps", "x", "y", "painted", "time_ms");
+    for (size_t i = 0; i < gridCount; i++) {
+        BatchJob *job = &jobs[i];
+        if (!job->loaded) {
+            printf("%-*s  %s\n", nameWidth, job->gridFilename, "load_failed");
+            allPassed = false;
+            continue;
+        }
+        printf("%-*s  %-14s %8zu %12zu %6d %6d %8zu %10.3f\n", nameWidth, job->gridFilename,
+               getErrcodeName(job->result.code), job->result.line, job->result.steps,
+               job->robotPosX, job->robotPosY, job->paintedCells, job->seconds * 1000);
+        if (job->result.code != INTERPRETER_FINISHED && job->result.code != INTERPRETER_FORCE_EXIT)
+            allPassed = false;
+    }
+
+    for (size_t i = 0; i < gridCount; i++)
+        free(gridFilenames[i]);
+    free(gridFilenames);
+    free(jobs);
+    freeProgram(&program);
+    return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+typedef struct GradeSubmission {
+    char *filename;
+    Program program;
+    InterpreterExitCode compileCode;
+    size_t compileLine;
+} GradeSubmission;
+
+typedef struct GradeGrid {
+    char *filename;
+    bool loaded;
+    Grid grid;
+    int robotPosX;
+    int robotPosY;
+    CacheKey cacheKey;
+    const GradeSpec *spec;
+    GradeTarget target;
+} GradeGrid;
+
+typedef struct GradeContext {
+    GradeSubmission *submissions;
+    GradeGrid *grids;
+    size_t gridCount;
+    const RunOptions *options;
+    GradeResult *results;
+} GradeContext;
+
+void runGradeJob(void *context, size_t index) {
+    GradeContext *grade = context;
+    const GradeSubmission *submission = &grade->submissions[index / grade->gridCount];
+    const GradeGrid *gradeGrid = &grade->grids[index % grade->gridCount];
+    GradeResult *result = &grade->results[index];
+
+    result->submission = submission->filename;
+    result->grid = gradeGrid->filename;
+    result->mismatchX = -1;
+    result->mismatchY = -1;
+    if (submission->compileCode != INTERPRETER_NORMAL) {
+        result->verdict = GRADE_COMPILE_ERROR;
+        result->run = (RunResult){ .code = submission->compileCode, .line = submission->compileLine, .steps = 0 };
+        return;
+    }
+    if (!gradeGrid->loaded) {
+        result->verdict = GRADE_LOAD_FAILED;
+        return;
+    }
+
+    Grid grid;
+    copyGrid(&grid, &gradeGrid->grid);
     Robot robot = makeRobot();
+    robot.posX = gradeGrid->robotPosX;
+    robot.posY = gradeGrid->robotPosY;
+
+    double start = getTimeSeconds();
+    if (grade->options->trace != NULL) {
+        char *traceFilename = makeRunFilename(grade->options->trace, submission->filename, gradeGrid->filename, TRACE_EXTENSION);
+        result->run = runTraced(grade->options, &submission->program, &robot, &grid, traceFilename);
+        free(traceFilename);
+    } else {
+        result->run = runWithOptions(grade->options, &submission->program, &robot, &grid, &gradeGrid->cacheKey);
+    }
+    result->seconds = getTimeSeconds() - start;
 
-    if (FileExists(filename))
-        loadGridFromFile(&grid, filename, &robot.posX, &robot.posY);
-    else
-        generateGridData(&grid);
+    if (grade->options->thumbnail != NULL) {
+        char *thumbnailFilename = makeRunFilename(grade->options->thumbnail, submission->filename, gradeGrid->filename, THUMBNAIL_EXTENSION);
+        saveRunThumbnail(grade->options, thumbnailFilename, &grid, &robot);
+        free(thumbnailFilename);
+    }
 
-    int selectedX, selectedY;
-    bool holdingRobot = false;
+    result->robotPosX = robot.posX;
+    result->robotPosY = robot.posY;
+    result->verdict = verifyOutcome(gradeGrid->spec, &gradeGrid->target, result->run.code, &robot, &grid,
+                                    &result->mismatchX, &result->mismatchY);
+    freeGrid(&grid);
+}
 
-    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Kumar (grid editor)");
+int runGrade(int argc, const char **argv) {
+    RunOptions options;
+    if (extractRunOptions(&argc, argv, &options) == EXIT_FAILURE) return EXIT_FAILURE;
+    if (isProfiling(&options)) {
+        puts("Profiling only works with check");
+        return EXIT_FAILURE;
+    }
+    if (argc < 4) {
+        puts("Expected a submissions folder, a grids folder and a spec file");
+        return EXIT_FAILURE;
+    }
+    const char *csvFilename = NULL, *jsonFilename = NULL;
+    for (int i = 4; i < argc; i++) {
+        if (streq(argv[i], "--csv") && i + 1 < argc)
+            csvFilename = argv[++i];
+        else if (streq(argv[i], "--json") && i + 1 < argc)
+            jsonFilename = argv[++i];
+        else {
+            printf("Unexpected token at position %d\n", i + 1);
+            return EXIT_FAILURE;
+        }
+    }
 
-    while (!WindowShouldClose()) {
-        getGridMousePos(grid, &selectedX, &selectedY, SCREEN_WIDTH, SCREEN_HEIGHT);
+    GradeSpec *specs;
+    size_t specCount;
+    if (loadGradeSpecs(argv[3], &specs, &specCount) == EXIT_FAILURE) return EXIT_FAILURE;
+
+    char **filenames = NULL;
+    size_t submissionCount = 0;
+    listFiles(argv[1], FILE_EXTENSION, &filenames, &submissionCount);
+    GradeSubmission *submissions = (GradeSubmission *)calloc(submissionCount, sizeof(GradeSubmission));
+    for (size_t i = 0; i < submissionCount; i++) {
+        submissions[i].filename = filenames[i];
+        submissions[i].compileCode = compileProgram(filenames[i], &submissions[i].program, &submissions[i].compileLine);
+    }
+    free(filenames);
+
+    filenames = NULL;
+    size_t gridCount = 0;
+    listFiles(argv[2], GRID_EXTENSION, &filenames, &gridCount);
+    GradeGrid *grids = (GradeGrid *)calloc(gridCount, sizeof(GradeGrid));
+    for (size_t i = 0; i < gridCount; i++) {
+        grids[i].filename = filenames[i];
+        grids[i].grid = makeGrid();
+        grids[i].loaded = loadGridFromFile(&grids[i].grid, filenames[i], &grids[i].robotPosX, &grids[i].robotPosY) == EXIT_SUCCESS;
+        grids[i].spec = findGradeSpec(specs, specCount, filenames[i]);
+        if (grids[i].spec == NULL)
+            fprintf(stderr, "No spec line for %s, every run on it fails with no_spec\n", getFileBasename(filenames[i]));
+        if (grids[i].loaded && options.cacheDir != NULL)
+            grids[i].cacheKey = makeGridCacheKey(&grids[i].grid, grids[i].robotPosX, grids[i].robotPosY);
+        if (grids[i].loaded && grids[i].spec != NULL)
+            makeGradeTarget(&grids[i].target, grids[i].spec, grids[i].grid.width, grids[i].grid.height);
+    }
+    free(filenames);
+
+    size_t resultCount = submissionCount * gridCount;
+    GradeResult *results = (GradeResult *)calloc(resultCount, sizeof(GradeResult));
+    GradeContext grade = {
+        .submissions = submissions,
+        .grids = grids,
+        .gridCount = gridCount,
+        .options = &options,
+        .results = results
+    };
+    runParallel(runGradeJob, &grade, resultCount);
+
+    int exitCode = EXIT_SUCCESS;
+    if (csvFilename == NULL && jsonFilename == NULL)
+        writeGradeCsv(stdout, results, resultCount);
+    if (csvFilename != NULL && writeGradeReport(csvFilename, writeGradeCsv, results, resultCount) == EXIT_FAILURE)
+        exitCode = EXIT_FAILURE;
+    if (jsonFilename != NULL && writeGradeReport(jsonFilename, writeGradeJson, results, resultCount) == EXIT_FAILURE)
+        exitCode = EXIT_FAILURE;
+
+    for (size_t i = 0; i < submissionCount; i++) {
+        if (submissions[i].compileCode == INTERPRETER_NORMAL)
+            freeProgram(&submissions[i].program);
+        free(submissions[i].filename);
+    }
+    for (size_t i = 0; i < gridCount; i++) {
+        if (grids[i].loaded)
+            freeGrid(&grids[i].grid);
+        if (grids[i].loaded && grids[i].spec != NULL)
+            freeGradeTarget(&grids[i].target);
+        free(grids[i].filename);
+    }
+    free(submissions);
+    free(grids);
+    free(results);
+    freeGradeSpecs(specs, specCount);
+    return exitCode;
+}
 
-        if (selectedX != robot.posX || selectedY != robot.posY) {
-            if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-                if (selectedX != -1) {
-                    if (getGridCell(grid, selectedX, selectedY) != GRID_CELL_WALL)
-                        setGridCell(&grid, selectedX, selectedY, GRID_CELL_WALL);
-                    else
-                        setGridCell(&grid, selectedX, selectedY, GRID_CELL_EMPTY);
-                }
-            } else if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT)) {
-                if (selectedX != -1) {
-                    if (getGridCell(grid, selectedX, selectedY) != GRID_CELL_FILLED)
-                        setGridCell(&grid, selectedX, selectedY, GRID_CELL_FILLED);
-                    else
-                        setGridCell(&grid, selectedX, selectedY, GRID_CELL_EMPTY);
-                }
-            }
-        } else if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
-            if (!holdingRobot) {
-                robot.color.a = ROBOT_HOLD_ALPHA;
-                robot.innerColor.a = ROBOT_HOLD_ALPHA;
-                robot.innerSize *= ROBOT_HOLD_SCALE_FACTOR;
-                robot.size *= ROBOT_HOLD_SCALE_FACTOR;
+int runServe(int argc, const char **argv) {
+    RunOptions options;
+    if (extractRunOptions(&argc, argv, &options) == EXIT_FAILURE) return EXIT_FAILURE;
+    if (options.cacheDir != NULL || isProfiling(&options) || options.trace != NULL || options.thumbnail != NULL) {
+        puts("serve only takes limits");
+        return EXIT_FAILURE;
+    }
+    ServeOptions serve = {
+        .limits = options.limits,
+        .socketPath = NULL,
+        .threadCount = 0,
+        .cacheEntries = SERVE_DEFAULT_CACHE_ENTRIES
+    };
+    for (int i = 1; i < argc; i++) {
+        if (streq(argv[i], "--socket") && i + 1 < argc) {
+            serve.socketPath = argv[++i];
+        } else if (streq(argv[i], "--threads") && i + 1 < argc) {
+            serve.threadCount = atoi(argv[++i]);
+            if (serve.threadCount <= 0) {
+                puts("Expected a positive thread count");
+                return EXIT_FAILURE;
             }
-            holdingRobot = true;
-        } if (holdingRobot) {
-            robotSetPos(&robot, grid, selectedX, selectedY);
-            if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
-                holdingRobot = false;
-                robot.color.a = 255;
-                robot.innerColor.a = 255;
-                robot.innerSize /= ROBOT_HOLD_SCALE_FACTOR;
-                robot.size /= ROBOT_HOLD_SCALE_FACTOR;
+        } else if (streq(argv[i], "--cache-entries") && i + 1 < argc) {
+            long long value = atoll(argv[++i]);
+            if (value <= 0) {
+                puts("Expected a positive cache size");
+                return EXIT_FAILURE;
             }
+            serve.cacheEntries = (size_t)value;
+        } else {
+            printf("Unexpected token at position %d\n", i + 1);
+            return EXIT_FAILURE;
+        }
+    }
+    return runServer(&serve);
+}
+
+// One verdict line per start cell, each what check would print with the
+// robot starting there, plus the start and, with a spec, the grade
+int runSweep(int argc, const char **argv) {
+    RunOptions options;
+    if (extractRunOptions(&argc, argv, &options) == EXIT_FAILURE) return EXIT_FAILURE;
+    if (options.cacheDir != NULL || isProfiling(&options) || options.trace != NULL || options.thumbnail != NULL) {
+        puts("sweep only takes limits");
+        return EXIT_FAILURE;
+    }
+    if (argc == 1) {
+        puts("No filename found");
+        return EXIT_FAILURE;
+    } else if (argc == 2) {
+        puts("No grid data filename found");
+        return EXIT_FAILURE;
+    }
+    const char *specFilename = NULL;
+    bool hasArea = false;
+    int area[4];
+    for (int i = 3; i < argc; i++) {
+        if (streq(argv[i], "--spec") && i + 1 < argc) {
+            specFilename = argv[++i];
+        } else if (streq(argv[i], "--area") && i + 4 < argc) {
+            hasArea = true;
+            for (int j = 0; j < 4; j++)
+                area[j] = atoi(argv[++i]);
+        } else {
+            printf("Unexpected token at position %d\n", i + 1);
+            return EXIT_FAILURE;
         }
+    }
+    if (!isProgramFile(argv[1])) return EXIT_FAILURE;
 
-        BeginDrawing();
-            ClearBackground(BLACK);
-            drawGrid(grid, SCREEN_WIDTH, SCREEN_HEIGHT);
-            drawRobot(robot, grid, SCREEN_WIDTH, SCREEN_HEIGHT);
-        EndDrawing();
+    Program program;
+    size_t currentLine;
+    InterpreterExitCode interpreterCode = compileProgram(argv[1], &program, &currentLine);
+    if (interpreterCode == INTERPRETER_ERROR) {
+        puts("Failed to open file");
+        return EXIT_FAILURE;
+    }
+    if (interpreterCode != INTERPRETER_NORMAL) {
+        printErrcode(interpreterCode, currentLine);
+        return EXIT_FAILURE;
     }
 
-    CloseWindow();
-    dumpGrid(grid, filename, robot.posX, robot.posY);
+    Grid grid = makeGrid();
+    Robot robot = makeRobot();
+    if (loadGridFromFile(&grid, argv[2], &robot.posX, &robot.posY) == EXIT_FAILURE) {
+        freeProgram(&program);
+        return EXIT_FAILURE;
+    }
 
-    return EXIT_SUCCESS;
+    GradeSpec *specs = NULL;
+    size_t specCount = 0;
+    const GradeSpec *spec = NULL;
+    GradeTarget target;
+    if (specFilename != NULL && loadGradeSpecs(specFilename, &specs, &specCount) == EXIT_FAILURE) {
+        freeProgram(&program);
+        freeGrid(&grid);
+        return EXIT_FAILURE;
+    }
+    if (specFilename != NULL) {
+        spec = findGradeSpec(specs, specCount, argv[2]);
+        if (spec == NULL) {
+            printf("No spec line for %s\n", getFileBasename(argv[2]));
+            freeGradeSpecs(specs, specCount);
+            freeProgram(&program);
+            freeGrid(&grid);
+            return EXIT_FAILURE;
+        }
+        makeGradeTarget(&target, spec, grid.width, grid.height);
+    }
+
+    uint64_t *starts = NULL;
+    if (hasArea) {
+        starts = (uint64_t *)calloc(getGridPlaneWords(grid.width, grid.height), sizeof(uint64_t));
+        for (int y = area[1] < 0 ? 0 : area[1]; y <= area[3] && y < grid.height; y++) {
+            for (int x = area[0] < 0 ? 0 : area[0]; x <= area[2] && x < grid.width; x++)
+                setGridPlaneBit(starts, grid.width, x, y);
+        }
+    }
+
+    int exitCode = EXIT_SUCCESS;
+    Sweep sweep;
+    if (sweepProgram(&sweep, &program, &grid, starts, options.limits) == EXIT_FAILURE) {
+        printf("Expected a field of at most %d cells\n", SWEEP_MAX_CELLS);
+        exitCode = EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < sweep.count; i++) {
+        const SweepResult *result = &sweep.results[i];
+        Grid paint;
+        copyGrid(&paint, &grid);
+        applySweepPaint(result, &paint);
+        robot.posX = result->robotPosX;
+        robot.posY = result->robotPosY;
+
+        printf("{\"start\":[%d,%d],", result->startX, result->startY);
+        printVerdictFields(result->run.code, result->run.line, result->run.steps, &robot, &paint);
+        if (specFilename != NULL) {
+            int mismatchX, mismatchY;
+            GradeVerdict verdict = verifyOutcome(spec, &target, result->run.code, &robot, &paint, &mismatchX, &mismatchY);
+            printf(",\"verdict\":\"%s\"", getGradeVerdictName(verdict));
+            if (mismatchX >= 0)
+                printf(",\"mismatch\":[%d,%d]", mismatchX, mismatchY);
+            if (verdict != GRADE_PASS)
+                exitCode = EXIT_FAILURE;
+        } else if (result->run.code != INTERPRETER_FINISHED && result->run.code != INTERPRETER_FORCE_EXIT) {
+            exitCode = EXIT_FAILURE;
+        }
+        puts("}");
+        freeGrid(&paint);
+    }
+
+    freeSweep(&sweep);
+    free(starts);
+    if (spec != NULL)
+        freeGradeTarget(&target);
+    if (specFilename != NULL)
+        freeGradeSpecs(specs, specCount);
+    freeProgram(&program);
+    freeGrid(&grid);
+    return exitCode;
 }
 
 /*
  * 
- * Синтаксис:
- *   Изменить поле:     kumar grid <файл поля>
+ * Синтаксис:  kumar [--lang ru|en] <команда> ...
+ *   Изменить поле:     kumar grid <файл поля> [ширина высота (для нового поля, по умолчанию 15 15)]
  *   Запустить файл:    kumar run <файл> <файл поля> [шагов в секунду > 0 (если <= 0, то мгновенно), если не указано, то 20 шагов в секунду]
+ *   Проверить файл:    kumar check <файл> <файл поля> [ограничения]
+ *   Проверить на полях: kumar batch <файл> <файлы полей или папки с ними>... [ограничения]
+ *   Оценить решения:   kumar grade <папка с решениями> <папка с полями> <файл ожиданий> [--csv <файл>] [--json <файл>] [ограничения]
+ *   Воспроизвести:     kumar replay <файл трассы> [шагов в секунду, как у run]
+ *   Сервер проверки:   kumar serve [--socket <путь>] [--threads <потоков>] [--cache-entries <записей>] [ограничения]
+ *   Со всех клеток:    kumar sweep <файл> <файл поля> [--area <x1> <y1> <x2> <y2>] [--spec <файл ожиданий>] [ограничения]
+ *
+ * Ограничения: --max-steps <шагов>, --timeout <секунд>, --no-loop-check (не искать зацикливание)
+ * Кэш результатов: --cache <папка>
+ * Профиль (только check): --profile (таблица в stderr), --profile-json <файл>
+ * Трасса: --trace <файл> (check) или --trace <папка> (batch, grade: <программа>.<поле>.kum_trace)
+ * Картинка итогового поля: --thumbnail <файл> (check) или --thumbnail <папка> (batch, grade: <программа>.<поле>.png), --cell-size <пикселей>
  * 
 */
 
 int main(int argc, const char **argv) {
+    if (argc >= 3 && streq(argv[1], "--lang")) {
+        Language lang;
+        if (!parseLanguageName(argv[2], &lang)) {
+            puts("Unknown language. Expected \"ru\" or \"en\"");
+            return EXIT_FAILURE;
+        }
+        setKeywordLanguage(lang);
+        argc -= 2;
+        argv += 2;
+    }
     if (argc == 1) {
         puts("Not enough arguments");
         return EXIT_FAILURE;
     }
+#ifdef KUMAR_GUI
     if (streq(argv[1], "run")) {
         if (runProgram(argc - 1, argv + 1) == EXIT_FAILURE) {
             puts("Unexpected error");
@@ -226,6 +755,18 @@ int main(int argc, const char **argv) {
         }
         return EXIT_SUCCESS;
     }
+#endif
+    if (streq(argv[1], "check"))
+        return runCheck(argc - 1, argv + 1);
+    if (streq(argv[1], "batch"))
+        return runBatch(argc - 1, argv + 1);
+    if (streq(argv[1], "grade"))
+        return runGrade(argc - 1, argv + 1);
+    if (streq(argv[1], "serve"))
+        return runServe(argc - 1, argv + 1);
+    if (streq(argv[1], "sweep"))
+        return runSweep(argc - 1, argv + 1);
+#ifdef KUMAR_GUI
     if (streq(argv[1], "grid")) {
         if (runGridEditor(argc - 1, argv + 1) == EXIT_FAILURE) {
             puts("Unexpected error");
@@ -233,6 +774,9 @@ int main(int argc, const char **argv) {
         }
         return EXIT_SUCCESS;
     }
+    if (streq(argv[1], "replay"))
+        return runReplay(argc - 1, argv + 1);
+#endif
 
     puts("Unexpected token at position 1");
     return EXIT_FAILURE;
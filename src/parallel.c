@@ -0,0 +1,116 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "parallel.h"
+
+
+int getCpuCount() {
+#ifdef _WIN32
+    int count = pthread_num_processors_np();
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
+
+// Each worker owns a contiguous range of job indices and takes jobs from
+// its front. A worker that runs dry steals the back half of another
+// worker's range, so a few slow jobs never leave the other cores idle
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} WorkQueue;
+
+typedef struct ParallelRun {
+    ParallelJob job;
+    void *context;
+    WorkQueue *queues;
+    size_t workerCount;
+} ParallelRun;
+
+typedef struct ParallelWorker {
+    ParallelRun *run;
+    size_t id;
+} ParallelWorker;
+
+static bool _m_popWork(WorkQueue *queue, size_t *index) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->head < queue->tail;
+    if (found)
+        *index = queue->head++;
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static bool _m_stealWork(ParallelRun *run, size_t thief) {
+    for (size_t i = 1; i < run->workerCount; i++) {
+        WorkQueue *victim = &run->queues[(thief + i) % run->workerCount];
+        pthread_mutex_lock(&victim->lock);
+        size_t remaining = victim->tail - victim->head;
+        if (remaining == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        size_t end = victim->tail;
+        victim->tail -= (remaining + 1) / 2;
+        size_t start = victim->tail;
+        pthread_mutex_unlock(&victim->lock);
+
+        WorkQueue *own = &run->queues[thief];
+        pthread_mutex_lock(&own->lock);
+        own->head = start;
+        own->tail = end;
+        pthread_mutex_unlock(&own->lock);
+        return true;
+    }
+    return false;
+}
+
+static void *_m_parallelWorker(void *arg) {
+    ParallelWorker *worker = arg;
+    ParallelRun *run = worker->run;
+    size_t index;
+    do {
+        while (_m_popWork(&run->queues[worker->id], &index))
+            run->job(run->context, index);
+    } while (_m_stealWork(run, worker->id));
+    return NULL;
+}
+
+void runParallel(ParallelJob job, void *context, size_t jobCount) {
+    size_t workerCount = getCpuCount();
+    if (workerCount > jobCount) workerCount = jobCount;
+    if (workerCount <= 1) {
+        for (size_t i = 0; i < jobCount; i++)
+            job(context, i);
+        return;
+    }
+
+    ParallelRun run = { .job = job, .context = context, .workerCount = workerCount };
+    run.queues = (WorkQueue *)malloc(workerCount * sizeof(WorkQueue));
+    ParallelWorker *workers = (ParallelWorker *)malloc(workerCount * sizeof(ParallelWorker));
+    pthread_t *threads = (pthread_t *)malloc(workerCount * sizeof(pthread_t));
+
+    for (size_t i = 0; i < workerCount; i++) {
+        pthread_mutex_init(&run.queues[i].lock, NULL);
+        run.queues[i].head = jobCount * i / workerCount;
+        run.queues[i].tail = jobCount * (i + 1) / workerCount;
+        workers[i] = (ParallelWorker){ .run = &run, .id = i };
+    }
+    for (size_t i = 0; i < workerCount; i++)
+        pthread_create(&threads[i], NULL, _m_parallelWorker, &workers[i]);
+    for (size_t i = 0; i < workerCount; i++)
+        pthread_join(threads[i], NULL);
+
+    for (size_t i = 0; i < workerCount; i++)
+        pthread_mutex_destroy(&run.queues[i].lock);
+    free(threads);
+    free(workers);
+    free(run.queues);
+}
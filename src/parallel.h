@@ -0,0 +1,15 @@
+#include <stddef.h>
+
+#ifndef KUMIR_PARALLEL_H
+#define KUMIR_PARALLEL_H
+
+
+int getCpuCount(void);
+
+typedef void (*ParallelJob)(void *context, size_t index);
+
+// Runs job(context, 0..jobCount-1) on one thread per core
+void runParallel(ParallelJob job, void *context, size_t jobCount);
+
+
+#endif // !KUMIR_PARALLEL_H
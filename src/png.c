@@ -0,0 +1,241 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "png.h"
+
+
+typedef struct PngWriter {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    uint64_t bits;
+    int bitCount;
+} PngWriter;
+
+static void _m_reservePng(PngWriter *writer, size_t extra) {
+    if (writer->size + extra <= writer->capacity)
+        return;
+    while (writer->size + extra > writer->capacity)
+        writer->capacity = writer->capacity ? writer->capacity * 2 : 1024;
+    writer->data = (unsigned char *)realloc(writer->data, writer->capacity);
+}
+
+static void _m_putPngBytes(PngWriter *writer, const void *data, size_t size) {
+    _m_reservePng(writer, size);
+    memcpy(writer->data + writer->size, data, size);
+    writer->size += size;
+}
+
+static void _m_putPngUint32(PngWriter *writer, uint32_t value) {
+    unsigned char bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+    _m_putPngBytes(writer, bytes, 4);
+}
+
+// Deflate packs bits from the least significant end. Bits pile up below
+// 32 and a code is at most 13 bits, so a flush writes up to 5 bytes
+static void _m_putBits(PngWriter *writer, uint32_t value, int count) {
+    writer->bits |= (uint64_t)value << writer->bitCount;
+    writer->bitCount += count;
+    if (writer->bitCount < 32)
+        return;
+    _m_reservePng(writer, 8);
+    while (writer->bitCount >= 8) {
+        writer->data[writer->size++] = (unsigned char)writer->bits;
+        writer->bits >>= 8;
+        writer->bitCount -= 8;
+    }
+}
+
+static void _m_flushBits(PngWriter *writer) {
+    _m_reservePng(writer, 8);
+    while (writer->bitCount > 0) {
+        writer->data[writer->size++] = (unsigned char)writer->bits;
+        writer->bits >>= 8;
+        writer->bitCount -= 8;
+    }
+    writer->bits = 0;
+    writer->bitCount = 0;
+}
+
+// while Huffman codes go most significant bit first
+static void _m_putHuffman(PngWriter *writer, uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++)
+        reversed |= (code >> i & 1) << (length - 1 - i);
+    _m_putBits(writer, reversed, length);
+}
+
+static void _m_putFixedSymbol(PngWriter *writer, int symbol) {
+    if (symbol < 144)
+        _m_putHuffman(writer, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        _m_putHuffman(writer, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        _m_putHuffman(writer, symbol - 256, 7);
+    else
+        _m_putHuffman(writer, 0xC0 + symbol - 280, 8);
+}
+
+static const int m_deflateLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int m_deflateLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+// A copy of the byte just before, length times
+static void _m_putRepeat(PngWriter *writer, int length) {
+    int code = 28;
+    while (m_deflateLengthBase[code] > length)
+        code--;
+    _m_putFixedSymbol(writer, 257 + code);
+    _m_putBits(writer, length - m_deflateLengthBase[code], m_deflateLengthExtra[code]);
+    _m_putHuffman(writer, 0, 5);  // distance 1
+}
+
+static void _m_deflateRuns(PngWriter *writer, const unsigned char *data, size_t size) {
+    _m_putBits(writer, 1, 1);  // the last block
+    _m_putBits(writer, 1, 2);  // fixed codes
+    for (size_t i = 0; i < size;) {
+        _m_putFixedSymbol(writer, data[i]);
+        size_t end = i + 1;
+        while (end < size && data[end] == data[i])
+            end++;
+        size_t run = end - i - 1;
+        while (run >= DEFLATE_MIN_MATCH) {
+            int length = run > DEFLATE_MAX_MATCH ? DEFLATE_MAX_MATCH : (int)run;
+            // Don't leave a tail too short for a match if it can be avoided
+            if (run - length > 0 && run - length < DEFLATE_MIN_MATCH && length > DEFLATE_MAX_MATCH - DEFLATE_MIN_MATCH)
+                length -= DEFLATE_MIN_MATCH;
+            _m_putRepeat(writer, length);
+            run -= length;
+        }
+        for (; run > 0; run--)
+            _m_putFixedSymbol(writer, data[i]);
+        i = end;
+    }
+    _m_putFixedSymbol(writer, 256);
+    _m_flushBits(writer);
+}
+
+static uint32_t m_crcTable[256];
+static pthread_once_t m_crcTableOnce = PTHREAD_ONCE_INIT;
+
+static void _m_buildCrcTable() {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        m_crcTable[n] = c;
+    }
+}
+
+static uint32_t _m_crc32(const unsigned char *data, size_t size) {
+    // Thumbnails are encoded from the worker threads of batch and grade
+    pthread_once(&m_crcTableOnce, _m_buildCrcTable);
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+        crc = m_crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static uint32_t _m_adler32(const unsigned char *data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t block = size < 5552 ? size : 5552;
+        size -= block;
+        for (; block > 0; block--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+static void _m_startChunk(PngWriter *writer, const char *type, size_t *start) {
+    _m_putPngUint32(writer, 0);
+    *start = writer->size;
+    _m_putPngBytes(writer, type, 4);
+}
+
+static void _m_finishChunk(PngWriter *writer, size_t start) {
+    uint32_t length = (uint32_t)(writer->size - start - 4);
+    unsigned char *lengthBytes = writer->data + start - 4;
+    lengthBytes[0] = length >> 24;
+    lengthBytes[1] = length >> 16;
+    lengthBytes[2] = length >> 8;
+    lengthBytes[3] = length;
+    _m_putPngUint32(writer, _m_crc32(writer->data + start, writer->size - start));
+}
+
+#define PNG_FILTER_SUB 1
+#define PNG_FILTER_UP 2
+
+unsigned char *encodePng(const unsigned char *pixels, int width, int height, const PngColor *palette, int paletteSize, size_t *size) {
+    size_t stride = (size_t)width + 1;
+    unsigned char *filtered = (unsigned char *)malloc(stride * height);
+    for (int y = 0; y < height; y++) {
+        const unsigned char *row = pixels + (size_t)y * width;
+        unsigned char *out = filtered + y * stride;
+        if (y > 0 && memcmp(row, row - width, width) == 0) {
+            out[0] = PNG_FILTER_UP;
+            memset(out + 1, 0, width);
+            continue;
+        }
+        out[0] = PNG_FILTER_SUB;
+        out[1] = row[0];
+        for (int x = 1; x < width; x++)
+            out[x + 1] = row[x] - row[x - 1];
+    }
+
+    PngWriter writer = { .data = NULL, .size = 0, .capacity = 0, .bits = 0, .bitCount = 0 };
+    _m_reservePng(&writer, 1024 + stride * height / 16);
+    _m_putPngBytes(&writer, "\x89PNG\r\n\x1a\n", 8);
+
+    size_t chunk;
+    _m_startChunk(&writer, "IHDR", &chunk);
+    _m_putPngUint32(&writer, width);
+    _m_putPngUint32(&writer, height);
+    unsigned char format[5] = { 8, 3, 0, 0, 0 };  // 8-bit palette indices
+    _m_putPngBytes(&writer, format, 5);
+    _m_finishChunk(&writer, chunk);
+
+    _m_startChunk(&writer, "PLTE", &chunk);
+    _m_putPngBytes(&writer, palette, 3 * (size_t)paletteSize);
+    _m_finishChunk(&writer, chunk);
+
+    _m_startChunk(&writer, "IDAT", &chunk);
+    _m_putPngBytes(&writer, "\x78\x01", 2);
+    _m_deflateRuns(&writer, filtered, stride * height);
+    _m_putPngUint32(&writer, _m_adler32(filtered, stride * height));
+    _m_finishChunk(&writer, chunk);
+
+    _m_startChunk(&writer, "IEND", &chunk);
+    _m_finishChunk(&writer, chunk);
+
+    free(filtered);
+    *size = writer.size;
+    return writer.data;
+}
+
+int writePng(const char *filename, const unsigned char *pixels, int width, int height, const PngColor *palette, int paletteSize) {
+    size_t size;
+    unsigned char *data = encodePng(pixels, width, height, palette, paletteSize, &size);
+    FILE *file = fopen(filename, "wb");
+    bool written = file != NULL && fwrite(data, 1, size, file) == size;
+    if (file != NULL && fclose(file) != 0)
+        written = false;
+    free(data);
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,24 @@
+#include <stddef.h>
+
+#ifndef KUMIR_PNG_H
+#define KUMIR_PNG_H
+
+
+typedef struct PngColor {
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+} PngColor;
+
+// Palette images, one byte per pixel, in memory or on disk. Rows equal to
+// the one above are filtered to zeros and the others to the difference
+// from the left neighbour, so flat rectangles become long runs of zeros;
+// these are compressed as repeats of the previous byte with the fixed
+// Huffman codes of deflate. That is far from the best compression, but
+// it is one pass and needs no tables
+unsigned char *encodePng(const unsigned char *pixels, int width, int height, const PngColor *palette, int paletteSize, size_t *size);
+
+int writePng(const char *filename, const unsigned char *pixels, int width, int height, const PngColor *palette, int paletteSize);
+
+
+#endif // !KUMIR_PNG_H
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "profile.h"
+
+
+Profile makeProfile(const Program *program) {
+    Profile profile = { .lineCount = program->lineCount };
+    profile.lines = (ProfileLine *)calloc(profile.lineCount + 1, sizeof(ProfileLine));
+    for (size_t pc = 0; pc < program->size; pc++) {
+        const Instruction *instr = &program->code[pc];
+        ProfileLine *line = &profile.lines[instr->line];
+        line->isLoop = instr->op == OP_LOOP || instr->op == OP_SLIDE;
+        line->hasCondition = (instr->op == OP_IF || line->isLoop) && instr->condition != CONDITION_ALWAYS;
+    }
+    return profile;
+}
+
+void freeProfile(Profile *profile) {
+    free(profile->lines);
+    profile->lines = NULL;
+}
+
+static InterpreterExitCode _m_stepProfiled(Interpreter *interpreter) {
+    if (interpreter->pc >= interpreter->program->size)
+        return stepInterpreter(interpreter);
+    const Instruction *instr = &interpreter->program->code[interpreter->pc];
+    ProfileLine *line = &interpreter->profile->lines[instr->line];
+    bool outcome = line->hasCondition && _m_solveCondition(instr->condition, interpreter->robot, interpreter->grid);
+
+    double start = getTimeSeconds();
+    InterpreterExitCode code = stepInterpreter(interpreter);
+    line->seconds += getTimeSeconds() - start;
+    line->executions++;
+
+    // An нц stopped by the loop check never evaluated its condition
+    if (code != INTERPRETER_NORMAL && code != INTERPRETER_SKIP_LINE)
+        return code;
+    if (line->hasCondition) {
+        if (outcome) line->conditionTrue++;
+        else line->conditionFalse++;
+    }
+    if (line->isLoop && (outcome || !line->hasCondition))
+        line->iterations++;
+    return code;
+}
+
+void setInterpreterProfile(Interpreter *interpreter, Profile *profile) {
+    interpreter->profile = profile;
+    interpreter->step = profile != NULL ? _m_stepProfiled : stepInterpreter;
+    if (profile != NULL)
+        interpreter->stepFused = true;
+}
+
+static void _m_sumProfile(const Profile *profile, double *seconds, size_t *executions) {
+    *seconds = 0;
+    *executions = 0;
+    for (size_t i = 1; i <= profile->lineCount; i++) {
+        *seconds += profile->lines[i].seconds;
+        *executions += profile->lines[i].executions;
+    }
+}
+
+// Lines are sorted as pointers into the same array, so ties fall back
+// to the line order
+static int _m_compareProfileLines(const void *a, const void *b) {
+    const ProfileLine *lineA = *(const ProfileLine *const *)a;
+    const ProfileLine *lineB = *(const ProfileLine *const *)b;
+    if (lineA->seconds != lineB->seconds)
+        return lineA->seconds < lineB->seconds ? 1 : -1;
+    if (lineA->executions != lineB->executions)
+        return lineA->executions < lineB->executions ? 1 : -1;
+    return lineA < lineB ? -1 : 1;
+}
+
+void printProfileReport(FILE *file, const Profile *profile) {
+    double seconds;
+    size_t executions;
+    _m_sumProfile(profile, &seconds, &executions);
+
+    size_t count = 0;
+    const ProfileLine **order = nmallocT(const ProfileLine *, profile->lineCount + 1);
+    for (size_t i = 1; i <= profile->lineCount; i++) {
+        if (profile->lines[i].executions > 0)
+            order[count++] = &profile->lines[i];
+    }
+    qsort(order, count, sizeof(const ProfileLine *), _m_compareProfileLines);
+
+    fprintf(file, "%6s %14s %10s %6s %12s %12s %12s\n", "line", "executions", "time_ms", "time%", "iterations", "true", "false");
+    for (size_t i = 0; i < count; i++) {
+        const ProfileLine *line = order[i];
+        fprintf(file, "%6zu %14zu %10.3f %5.1f%%", (size_t)(line - profile->lines), line->executions,
+                line->seconds * 1000, seconds > 0 ? line->seconds * 100 / seconds : 0);
+        if (line->isLoop) fprintf(file, " %12zu", line->iterations);
+        else fprintf(file, " %12s", "-");
+        if (line->hasCondition) fprintf(file, " %12zu %12zu\n", line->conditionTrue, line->conditionFalse);
+        else fprintf(file, " %12s %12s\n", "-", "-");
+    }
+    fprintf(file, "%6s %14zu %10.3f\n", "total", executions, seconds * 1000);
+    free((void *)order);
+}
+
+void writeProfileJson(FILE *file, const Profile *profile) {
+    double seconds;
+    size_t executions;
+    _m_sumProfile(profile, &seconds, &executions);
+
+    fprintf(file, "{\"executions\":%zu,\"time_ms\":%.6f,\"lines\":[", executions, seconds * 1000);
+    bool first = true;
+    for (size_t i = 1; i <= profile->lineCount; i++) {
+        const ProfileLine *line = &profile->lines[i];
+        if (line->executions == 0) continue;
+        fprintf(file, "%s\n  {\"line\":%zu,\"executions\":%zu,\"time_ms\":%.6f", first ? "" : ",", i, line->executions, line->seconds * 1000);
+        if (line->isLoop) fprintf(file, ",\"iterations\":%zu", line->iterations);
+        if (line->hasCondition) fprintf(file, ",\"true\":%zu,\"false\":%zu", line->conditionTrue, line->conditionFalse);
+        fputc('}', file);
+        first = false;
+    }
+    fputs("\n]}\n", file);
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+
+#include "interpreter.h"
+
+#ifndef KUMIR_PROFILE_H
+#define KUMIR_PROFILE_H
+
+
+// Per source line statistics of a run. Profiling swaps the interpreter's
+// step for an instrumented one, so runs without a profile pay nothing.
+// A profiled run steps through fused instructions one source instruction
+// at a time so that every line is counted; the results are the same,
+// only slower
+typedef struct ProfileLine {
+    size_t executions;
+    double seconds;
+    size_t conditionTrue;   // если, нц пока: outcomes of the condition
+    size_t conditionFalse;
+    size_t iterations;      // нц: times the body was entered
+    bool hasCondition;
+    bool isLoop;
+} ProfileLine;
+
+typedef struct Profile {
+    ProfileLine *lines;  // indexed by line number, lines[0] is unused
+    size_t lineCount;
+} Profile;
+
+Profile makeProfile(const Program *program);
+
+void freeProfile(Profile *profile);
+
+void setInterpreterProfile(Interpreter *interpreter, Profile *profile);
+
+// The hottest lines first, by time spent
+void printProfileReport(FILE *file, const Profile *profile);
+
+void writeProfileJson(FILE *file, const Profile *profile);
+
+
+#endif // !KUMIR_PROFILE_H
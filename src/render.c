@@ -0,0 +1,116 @@
+#include <raylib.h>
+
+#include "render.h"
+
+
+GridView makeGridView(const Grid *grid) {
+    return (GridView){
+        .cellSize = GRID_MAX_CELL_SIZE,
+        .backgroundColor = GREEN,
+        .filledBackgroundColor = PURPLE,
+        .wallColor = GRAY,
+        .gridColor = YELLOW,
+        .viewX = grid->width / 2,
+        .viewY = grid->height / 2
+    };
+}
+
+RobotStyle makeRobotStyle() {
+    return (RobotStyle){
+        .size = 15,
+        .color = GRAY,
+        .innerSize = 10,
+        .innerColor = LIGHTGRAY
+    };
+}
+
+void fitGridCellSize(GridView *view, const Grid *grid, int screenWidth, int screenHeight) {
+    int cellSize = screenWidth / grid->width;
+    if (screenHeight / grid->height < cellSize)
+        cellSize = screenHeight / grid->height;
+    if (cellSize > GRID_MAX_CELL_SIZE) cellSize = GRID_MAX_CELL_SIZE;
+    if (cellSize < GRID_MIN_CELL_SIZE) cellSize = GRID_MIN_CELL_SIZE;
+    view->cellSize = cellSize;
+}
+
+void getGridScreenOrigin(const GridView *view, const Grid *grid, int screenWidth, int screenHeight, int *xMin, int *yMin) {
+    long long fieldWidth = (long long)grid->width * view->cellSize;
+    long long fieldHeight = (long long)grid->height * view->cellSize;
+    if (fieldWidth <= screenWidth)
+        *xMin = (screenWidth - fieldWidth) / 2;
+    else
+        *xMin = screenWidth / 2 - (view->viewX * view->cellSize + view->cellSize / 2);
+    if (fieldHeight <= screenHeight)
+        *yMin = (screenHeight - fieldHeight) / 2;
+    else
+        *yMin = screenHeight / 2 - (view->viewY * view->cellSize + view->cellSize / 2);
+}
+
+void drawGrid(const GridView *view, const Grid *grid, int screenWidth, int screenHeight) {
+    int xMin, yMin;
+    getGridScreenOrigin(view, grid, screenWidth, screenHeight, &xMin, &yMin);
+
+    int xFirst = xMin < 0 ? -xMin / view->cellSize : 0;
+    int yFirst = yMin < 0 ? -yMin / view->cellSize : 0;
+    int xLast = (screenWidth - xMin) / view->cellSize + 1;
+    int yLast = (screenHeight - yMin) / view->cellSize + 1;
+    if (xLast > grid->width) xLast = grid->width;
+    if (yLast > grid->height) yLast = grid->height;
+
+    Color cellColor;
+    for (int y = yFirst, yPos = yMin + yFirst * view->cellSize; y < yLast; y++, yPos+=view->cellSize) {
+        for (int x = xFirst, xPos = xMin + xFirst * view->cellSize; x < xLast; x++, xPos+=view->cellSize) {
+            CellType type = getGridCell(grid, x, y);
+            if (type == GRID_CELL_EMPTY)
+                cellColor = view->backgroundColor;
+            else if (type == GRID_CELL_FILLED)
+                cellColor = view->filledBackgroundColor;
+            else if (type == GRID_CELL_WALL)
+                cellColor = view->wallColor;
+            DrawRectangle(xPos, yPos, view->cellSize, view->cellSize, cellColor);
+        }
+    }
+
+    int xStart = xMin + xFirst * view->cellSize, xEnd = xMin + xLast * view->cellSize;
+    int yStart = yMin + yFirst * view->cellSize, yEnd = yMin + yLast * view->cellSize;
+    for (int x = xStart; x <= xEnd; x+=view->cellSize)
+        DrawLineEx((Vector2){ x, yStart }, (Vector2){ x, yEnd }, 2, view->gridColor);
+    for (int y = yStart; y <= yEnd; y+=view->cellSize)
+        DrawLineEx((Vector2){ xStart, y }, (Vector2){ xEnd, y }, 2, view->gridColor);
+}
+
+void getGridMousePos(const GridView *view, const Grid *grid, int *x, int *y, int screenWidth, int screenHeight) {
+    Vector2 mousePos = GetMousePosition();
+
+    int xMin, yMin;
+    getGridScreenOrigin(view, grid, screenWidth, screenHeight, &xMin, &yMin);
+
+    mousePos.x -= xMin;
+    mousePos.y -= yMin;
+
+    mousePos.x /= view->cellSize;
+    mousePos.y /= view->cellSize;
+
+    int m_x = (int)mousePos.x;
+    int m_y = (int)mousePos.y;
+
+    if (0 <= m_x && m_x < grid->width &&
+        0 <= m_y && m_y < grid->height) {
+        *x = m_x;
+        *y = m_y;
+    } else {
+        *x = -1;
+        *y = -1;
+    }
+}
+
+void drawRobot(const RobotStyle *style, const Robot *robot, const GridView *view, const Grid *grid, int screenWidth, int screenHeight) {
+    int xMin, yMin;
+    getGridScreenOrigin(view, grid, screenWidth, screenHeight, &xMin, &yMin);
+    int posX = xMin + (robot->posX + 0.5f) * view->cellSize;
+    int posY = yMin + (robot->posY + 0.5f) * view->cellSize;
+
+    float scale = (float)view->cellSize / GRID_MAX_CELL_SIZE;
+    DrawCircle(posX, posY, style->size * scale, style->color);
+    DrawCircle(posX, posY, style->innerSize * scale, style->innerColor);
+}
@@ -0,0 +1,49 @@
+#include <raylib.h>
+
+#include "robot.h"
+
+#ifndef KUMIR_RENDER_H
+#define KUMIR_RENDER_H
+
+
+// Everything needed to draw a grid that is not part of the grid itself:
+// the core never sees colors or screen sizes, only the GUI does
+typedef struct GridView {
+    int cellSize;
+    Color backgroundColor;
+    Color filledBackgroundColor;
+    Color wallColor;
+    Color gridColor;
+    int viewX;
+    int viewY;
+} GridView;
+
+typedef struct RobotStyle {
+    float size;
+    Color color;
+    float innerSize;
+    Color innerColor;
+} RobotStyle;
+
+#define GRID_MAX_CELL_SIZE 50
+#define GRID_MIN_CELL_SIZE 4
+
+// Centered on the middle of the grid
+GridView makeGridView(const Grid *grid);
+
+RobotStyle makeRobotStyle(void);
+
+void fitGridCellSize(GridView *view, const Grid *grid, int screenWidth, int screenHeight);
+
+// Screen position of the top left corner of the field. A field larger
+// than the screen is scrolled so that the cell (viewX, viewY) is centered
+void getGridScreenOrigin(const GridView *view, const Grid *grid, int screenWidth, int screenHeight, int *xMin, int *yMin);
+
+void drawGrid(const GridView *view, const Grid *grid, int screenWidth, int screenHeight);
+
+void getGridMousePos(const GridView *view, const Grid *grid, int *x, int *y, int screenWidth, int screenHeight);
+
+void drawRobot(const RobotStyle *style, const Robot *robot, const GridView *view, const Grid *grid, int screenWidth, int screenHeight);
+
+
+#endif // !KUMIR_RENDER_H
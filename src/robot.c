@@ -0,0 +1,44 @@
+#include <stdlib.h>
+
+#include "robot.h"
+
+
+Robot makeRobot() {
+    return (Robot){ .posX = 0, .posY = 0 };
+}
+
+int robotGoUp(Robot *robot, const Grid *grid) {
+    if (robotCheckWall(robot, grid, DIRECTION_UP))
+        return EXIT_FAILURE;
+    robot->posY--;
+    return EXIT_SUCCESS;
+}
+
+int robotGoDown(Robot *robot, const Grid *grid) {
+    if (robotCheckWall(robot, grid, DIRECTION_DOWN))
+        return EXIT_FAILURE;
+    robot->posY++;
+    return EXIT_SUCCESS;
+}
+
+int robotGoLeft(Robot *robot, const Grid *grid) {
+    if (robotCheckWall(robot, grid, DIRECTION_LEFT))
+        return EXIT_FAILURE;
+    robot->posX--;
+    return EXIT_SUCCESS;
+}
+
+int robotGoRight(Robot *robot, const Grid *grid) {
+    if (robotCheckWall(robot, grid, DIRECTION_RIGHT))
+        return EXIT_FAILURE;
+    robot->posX++;
+    return EXIT_SUCCESS;
+}
+
+int robotSetPos(Robot *robot, const Grid *grid, int x, int y) {
+    if (isGridCellWall(grid, x, y))
+        return EXIT_FAILURE;
+    robot->posX = x;
+    robot->posY = y;
+    return EXIT_SUCCESS;
+}
@@ -7,53 +7,9 @@
 typedef struct Robot {
     int posX;
     int posY;
-    float size;
-    Color color;
-    float innerSize;
-    Color innerColor;
 } Robot;
 
-void drawRobot(Robot robot, Grid grid, int screenWidth, int screenHeight) {
-    int posX = (screenWidth - grid.width * grid.cellSize) / 2 + (robot.posX + 0.5f) * grid.cellSize;
-    int posY = (screenHeight - grid.height * grid.cellSize) / 2 + (robot.posY + 0.5f) * grid.cellSize;
-
-    DrawCircle(posX, posY, robot.size, robot.color);
-    DrawCircle(posX, posY, robot.innerSize, robot.innerColor);
-}
-
-int robotGoUp(Robot *robot, Grid grid) {
-    if (isGridCellWall(grid, robot->posX, robot->posY - 1))
-        return EXIT_FAILURE;
-    robot->posY--;
-    return EXIT_SUCCESS;
-}
-int robotGoDown(Robot *robot, Grid grid) {
-    if (isGridCellWall(grid, robot->posX, robot->posY + 1))
-        return EXIT_FAILURE;
-    robot->posY++;
-    return EXIT_SUCCESS;
-}
-int robotGoLeft(Robot *robot, Grid grid) {
-    if (isGridCellWall(grid, robot->posX - 1, robot->posY))
-        return EXIT_FAILURE;
-    robot->posX--;
-    return EXIT_SUCCESS;
-}
-
-int robotGoRight(Robot *robot, Grid grid) {
-    if (isGridCellWall(grid, robot->posX + 1, robot->posY))
-        return EXIT_FAILURE;
-    robot->posX++;
-    return EXIT_SUCCESS;
-}
-
-int robotSetPos(Robot *robot, Grid grid, int x, int y) {
-    if (isGridCellWall(grid, x, y))
-        return EXIT_FAILURE;
-    robot->posX = x;
-    robot->posY = y;
-    return EXIT_SUCCESS;
-}
+Robot makeRobot(void);
 
 typedef enum {
     DIRECTION_UP,
@@ -62,13 +18,27 @@ typedef enum {
     DIRECTION_RIGHT
 } Direction;
 
-bool robotCheckWall(Robot robot, Grid grid, Direction dir) {
-    if (dir == DIRECTION_UP) return isGridCellWall(grid, robot.posX, robot.posY - 1);
-    if (dir == DIRECTION_DOWN) return isGridCellWall(grid, robot.posX, robot.posY + 1);
-    if (dir == DIRECTION_LEFT) return isGridCellWall(grid, robot.posX - 1, robot.posY);
-    if (dir == DIRECTION_RIGHT) return isGridCellWall(grid, robot.posX + 1, robot.posY);
-    return false;
+static const int m_directionX[] = { 0, 0, -1, 1 };
+static const int m_directionY[] = { -1, 1, 0, 0 };
+
+static inline bool robotCheckWall(const Robot *robot, const Grid *grid, Direction dir) {
+    return getGridWallMask(grid, robot->posX, robot->posY) & (1 << dir);
 }
 
+int robotGoUp(Robot *robot, const Grid *grid);
+int robotGoDown(Robot *robot, const Grid *grid);
+int robotGoLeft(Robot *robot, const Grid *grid);
+int robotGoRight(Robot *robot, const Grid *grid);
+
+static inline int robotGo(Robot *robot, const Grid *grid, Direction dir) {
+    if (robotCheckWall(robot, grid, dir))
+        return EXIT_FAILURE;
+    robot->posX += m_directionX[dir];
+    robot->posY += m_directionY[dir];
+    return EXIT_SUCCESS;
+}
+
+int robotSetPos(Robot *robot, const Grid *grid, int x, int y);
+
 
 #endif // !KUMIR_ROBOT_H
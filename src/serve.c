@@ -0,0 +1,809 @@
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "json.h"
+#include "keywords.h"
+#include "parallel.h"
+#include "serve.h"
+
+
+// Answers are built in memory and written with one call, so the lines of
+// different workers never interleave
+typedef struct ServeBuffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+} ServeBuffer;
+
+static void _m_reserveBuffer(ServeBuffer *buffer, size_t extra) {
+    if (buffer->size + extra <= buffer->capacity)
+        return;
+    while (buffer->size + extra > buffer->capacity)
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+    buffer->data = (char *)realloc(buffer->data, buffer->capacity);
+}
+
+static void _m_appendBuffer(ServeBuffer *buffer, const char *data, size_t size) {
+    _m_reserveBuffer(buffer, size);
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static void _m_appendf(ServeBuffer *buffer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    _m_reserveBuffer(buffer, 64);
+    int length = vsnprintf(buffer->data + buffer->size, buffer->capacity - buffer->size, format, args);
+    va_end(args);
+    if (length < 0)
+        return;
+    if ((size_t)length >= buffer->capacity - buffer->size) {
+        _m_reserveBuffer(buffer, length + 1);
+        va_start(args, format);
+        vsnprintf(buffer->data + buffer->size, buffer->capacity - buffer->size, format, args);
+        va_end(args);
+    }
+    buffer->size += length;
+}
+
+static void _m_appendJsonString(ServeBuffer *buffer, const char *str) {
+    _m_appendBuffer(buffer, "\"", 1);
+    for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            _m_appendf(buffer, "\\%c", *c);
+        else if (*c < 0x20)
+            _m_appendf(buffer, "\\u%04x", *c);
+        else
+            _m_appendBuffer(buffer, (const char *)c, 1);
+    }
+    _m_appendBuffer(buffer, "\"", 1);
+}
+
+// Keys are compared whole, the hash only skips the obvious misses. An
+// entry in use is never evicted, so a cache can briefly hold more than
+// maxEntries
+typedef struct ServeCacheEntry {
+    uint64_t hash;
+    char *key;
+    size_t keyLength;
+    unsigned refs;
+    uint64_t lastUse;
+    void *value;
+} ServeCacheEntry;
+
+typedef void (*ServeValueFree)(void *value);
+
+typedef struct ServeCache {
+    pthread_mutex_t lock;
+    ServeCacheEntry **entries;
+    size_t count;
+    size_t capacity;
+    size_t maxEntries;
+    uint64_t clock;
+    ServeValueFree freeValue;
+} ServeCache;
+
+static void _m_initServeCache(ServeCache *cache, size_t maxEntries, ServeValueFree freeValue) {
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->entries = NULL;
+    cache->count = 0;
+    cache->capacity = 0;
+    cache->maxEntries = maxEntries > 0 ? maxEntries : 1;
+    cache->clock = 0;
+    cache->freeValue = freeValue;
+}
+
+static void _m_freeServeCacheEntry(ServeCache *cache, ServeCacheEntry *entry) {
+    cache->freeValue(entry->value);
+    free(entry->value);
+    free(entry->key);
+    free(entry);
+}
+
+static void _m_freeServeCache(ServeCache *cache) {
+    for (size_t i = 0; i < cache->count; i++)
+        _m_freeServeCacheEntry(cache, cache->entries[i]);
+    free(cache->entries);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+// FNV-1a
+static uint64_t _m_hashBytes(const char *data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Called with the lock held
+static ServeCacheEntry *_m_findServeCacheEntry(ServeCache *cache, uint64_t hash, const char *key, size_t keyLength) {
+    for (size_t i = 0; i < cache->count; i++) {
+        ServeCacheEntry *entry = cache->entries[i];
+        if (entry->hash != hash || entry->keyLength != keyLength || memcmp(entry->key, key, keyLength) != 0)
+            continue;
+        entry->refs++;
+        entry->lastUse = ++cache->clock;
+        return entry;
+    }
+    return NULL;
+}
+
+static ServeCacheEntry *_m_acquireServeCacheEntry(ServeCache *cache, const char *key, size_t keyLength) {
+    uint64_t hash = _m_hashBytes(key, keyLength);
+    pthread_mutex_lock(&cache->lock);
+    ServeCacheEntry *entry = _m_findServeCacheEntry(cache, hash, key, keyLength);
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+// Takes over key and value. Values are built outside the lock, so two
+// workers may build the same one at once; the first one in is kept
+static ServeCacheEntry *_m_insertServeCacheEntry(ServeCache *cache, char *key, size_t keyLength, void *value) {
+    uint64_t hash = _m_hashBytes(key, keyLength);
+    pthread_mutex_lock(&cache->lock);
+    ServeCacheEntry *entry = _m_findServeCacheEntry(cache, hash, key, keyLength);
+    if (entry != NULL) {
+        pthread_mutex_unlock(&cache->lock);
+        cache->freeValue(value);
+        free(value);
+        free(key);
+        return entry;
+    }
+
+    if (cache->count >= cache->maxEntries) {
+        size_t oldest = cache->count;
+        for (size_t i = 0; i < cache->count; i++) {
+            if (cache->entries[i]->refs == 0 && (oldest == cache->count || cache->entries[i]->lastUse < cache->entries[oldest]->lastUse))
+                oldest = i;
+        }
+        if (oldest < cache->count) {
+            _m_freeServeCacheEntry(cache, cache->entries[oldest]);
+            cache->entries[oldest] = cache->entries[--cache->count];
+        }
+    }
+    if (cache->count == cache->capacity) {
+        cache->capacity = cache->capacity ? cache->capacity * 2 : 16;
+        cache->entries = (ServeCacheEntry **)realloc(cache->entries, cache->capacity * sizeof(ServeCacheEntry *));
+    }
+    entry = mallocT(ServeCacheEntry);
+    *entry = (ServeCacheEntry){
+        .hash = hash,
+        .key = key,
+        .keyLength = keyLength,
+        .refs = 1,
+        .lastUse = ++cache->clock,
+        .value = value
+    };
+    cache->entries[cache->count++] = entry;
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+static void _m_releaseServeCacheEntry(ServeCache *cache, ServeCacheEntry *entry) {
+    pthread_mutex_lock(&cache->lock);
+    entry->refs--;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// A compile error is kept like a program, it comes out the same every time
+typedef struct ServeProgram {
+    InterpreterExitCode code;
+    size_t line;
+    Program program;
+} ServeProgram;
+
+static void _m_freeServeProgram(void *value) {
+    ServeProgram *program = value;
+    if (program->code == INTERPRETER_NORMAL)
+        freeProgram(&program->program);
+}
+
+typedef struct ServeGrid {
+    Grid grid;
+    int robotPosX;
+    int robotPosY;
+} ServeGrid;
+
+static void _m_freeServeGrid(void *value) {
+    freeGrid(&((ServeGrid *)value)->grid);
+}
+
+// The path with the modification time and size of the file, so an edited
+// file gets a new key and its old entry ages out. NULL if there is no file
+static char *_m_makeFileKey(char tag, Language lang, const char *path, size_t *keyLength) {
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return NULL;
+    long long nanoseconds = 0;
+#ifdef __linux__
+    nanoseconds = info.st_mtim.tv_nsec;
+#endif
+    size_t pathLength = strlen(path);
+    char *key = nmallocT(char, pathLength + 80);
+    int length = sprintf(key, "%c%d:%lld.%09lld:%lld:", tag, (int)lang, (long long)info.st_mtime, nanoseconds, (long long)info.st_size);
+    memcpy(key + length, path, pathLength);
+    *keyLength = length + pathLength;
+    return key;
+}
+
+static char *_m_makeSourceKey(Language lang, const char *source, size_t sourceLength, size_t *keyLength) {
+    char *key = nmallocT(char, sourceLength + 16);
+    int length = sprintf(key, "s%d:", (int)lang);
+    memcpy(key + length, source, sourceLength);
+    *keyLength = length + sourceLength;
+    return key;
+}
+
+// Every connection is shared by its reader and the jobs it queued; the
+// last one out closes it
+typedef struct ServeConnection {
+    FILE *in;
+    FILE *out;
+    bool ownsFiles;
+    pthread_mutex_t lock;
+    unsigned refs;
+} ServeConnection;
+
+typedef struct ServeJob {
+    ServeConnection *connection;
+    char *line;
+    size_t length;
+    struct ServeJob *next;
+} ServeJob;
+
+typedef struct Server {
+    const ServeOptions *options;
+    ServeCache programs;
+    ServeCache grids;
+    pthread_mutex_t lock;
+    pthread_cond_t hasJobs;
+    pthread_cond_t hasRoom;
+    ServeJob *head;
+    ServeJob *tail;
+    size_t queued;
+    bool closing;
+} Server;
+
+static ServeConnection *_m_makeServeConnection(FILE *in, FILE *out, bool ownsFiles) {
+    ServeConnection *connection = mallocT(ServeConnection);
+    connection->in = in;
+    connection->out = out;
+    connection->ownsFiles = ownsFiles;
+    pthread_mutex_init(&connection->lock, NULL);
+    connection->refs = 1;
+    return connection;
+}
+
+static void _m_retainServeConnection(ServeConnection *connection) {
+    pthread_mutex_lock(&connection->lock);
+    connection->refs++;
+    pthread_mutex_unlock(&connection->lock);
+}
+
+static void _m_releaseServeConnection(ServeConnection *connection) {
+    pthread_mutex_lock(&connection->lock);
+    bool last = --connection->refs == 0;
+    pthread_mutex_unlock(&connection->lock);
+    if (!last)
+        return;
+    if (connection->ownsFiles) {
+        fclose(connection->in);
+        fclose(connection->out);
+    }
+    pthread_mutex_destroy(&connection->lock);
+    free(connection);
+}
+
+static void _m_sendServeAnswer(ServeConnection *connection, const ServeBuffer *answer) {
+    pthread_mutex_lock(&connection->lock);
+    fwrite(answer->data, 1, answer->size, connection->out);
+    fflush(connection->out);
+    pthread_mutex_unlock(&connection->lock);
+}
+
+// Casting a number out of the range of int is undefined, so the range
+// is checked first
+static bool _m_getJsonInt(const JsonValue *value, int *result) {
+    if (value->type != JSON_NUMBER || !isfinite(value->number) || value->number < INT_MIN || value->number > INT_MAX ||
+        value->number != (double)(int)value->number)
+        return false;
+    *result = (int)value->number;
+    return true;
+}
+
+// A job can lower the limits of the server but not raise them
+static const char *_m_readServeLimits(const InterpreterLimits *defaults, const JsonValue *request, InterpreterLimits *limits) {
+    *limits = *defaults;
+    const JsonValue *member = getJsonMember(request, "max_steps");
+    if (member != NULL) {
+        if (member->type != JSON_NUMBER || member->number < 1)
+            return "\"max_steps\" must be a positive number";
+        size_t maxSteps = member->number >= (double)SIZE_MAX ? SIZE_MAX : (size_t)member->number;
+        if (defaults->maxSteps == 0 || maxSteps < defaults->maxSteps)
+            limits->maxSteps = maxSteps;
+    }
+    member = getJsonMember(request, "timeout");
+    if (member != NULL) {
+        if (member->type != JSON_NUMBER || member->number <= 0)
+            return "\"timeout\" must be a positive number of seconds";
+        if (defaults->maxSeconds == 0 || member->number < defaults->maxSeconds)
+            limits->maxSeconds = member->number;
+    }
+    member = getJsonMember(request, "loop_check");
+    if (member != NULL) {
+        if (member->type != JSON_BOOL)
+            return "\"loop_check\" must be true or false";
+        limits->detectLoops = member->boolean;
+    }
+    return NULL;
+}
+
+static const char *_m_acquireServeProgram(Server *server, const JsonValue *request, Language lang, ServeCacheEntry **entry) {
+    const JsonValue *source = getJsonMember(request, "source");
+    const JsonValue *path = getJsonMember(request, "program");
+    char *key;
+    size_t keyLength;
+    if (source != NULL) {
+        if (source->type != JSON_STRING)
+            return "\"source\" must be a string";
+        key = _m_makeSourceKey(lang, source->string, source->length, &keyLength);
+    } else if (path != NULL) {
+        if (path->type != JSON_STRING)
+            return "\"program\" must be a string";
+        key = _m_makeFileKey('p', lang, path->string, &keyLength);
+        if (key == NULL)
+            return "failed to open program";
+    } else {
+        return "no \"source\" or \"program\"";
+    }
+
+    *entry = _m_acquireServeCacheEntry(&server->programs, key, keyLength);
+    if (*entry != NULL) {
+        free(key);
+        return NULL;
+    }
+
+    ServeProgram *program = mallocT(ServeProgram);
+    if (source != NULL)
+        program->code = compileProgramBuffer(source->string, source->length, lang, &program->program, &program->line);
+    else
+        program->code = compileProgramFile(path->string, lang, &program->program, &program->line);
+    if (program->code == INTERPRETER_ERROR) {
+        free(program);
+        free(key);
+        return "failed to open program";
+    }
+    *entry = _m_insertServeCacheEntry(&server->programs, key, keyLength, program);
+    return NULL;
+}
+
+static const char *_m_addServeGridCells(Grid *grid, const JsonValue *data, const char *name, CellType type) {
+    const JsonValue *cells = getJsonMember(data, name);
+    if (cells == NULL)
+        return NULL;
+    if (cells->type != JSON_ARRAY)
+        return "grid cells must be arrays of [x, y]";
+    for (size_t i = 0; i < cells->count; i++) {
+        const JsonValue *cell = &cells->items[i];
+        int x, y;
+        if (cell->type != JSON_ARRAY || cell->count != 2 || !_m_getJsonInt(&cell->items[0], &x) || !_m_getJsonInt(&cell->items[1], &y))
+            return "grid cells must be arrays of [x, y]";
+        if (x < 0 || x >= grid->width || y < 0 || y >= grid->height)
+            return "grid cell out of bounds";
+        setGridCell(grid, x, y, type);
+    }
+    return NULL;
+}
+
+// Inline grids are built for the one job and not cached
+static const char *_m_buildServeGrid(const JsonValue *data, Grid *grid, Robot *robot) {
+    if (data->type != JSON_OBJECT)
+        return "\"grid_data\" must be an object";
+    int width = GRID_DEFAULT_SIZE;
+    int height = GRID_DEFAULT_SIZE;
+    const char *names[4] = { "width", "height", "x", "y" };
+    int *fields[4] = { &width, &height, &robot->posX, &robot->posY };
+    for (int i = 0; i < 4; i++) {
+        const JsonValue *member = getJsonMember(data, names[i]);
+        if (member != NULL && !_m_getJsonInt(member, fields[i]))
+            return "grid sizes and positions must be integers";
+    }
+    if (width <= 0 || width > GRID_MAX_SIZE || height <= 0 || height > GRID_MAX_SIZE)
+        return "invalid grid size";
+    if (robot->posX < 0 || robot->posX >= width || robot->posY < 0 || robot->posY >= height)
+        return "robot position out of bounds";
+
+    *grid = makeGrid();
+    grid->width = width;
+    grid->height = height;
+    generateGridData(grid);
+    const char *error = _m_addServeGridCells(grid, data, "walls", GRID_CELL_WALL);
+    if (error == NULL)
+        error = _m_addServeGridCells(grid, data, "painted", GRID_CELL_FILLED);
+    if (error == NULL && isGridCellWall(grid, robot->posX, robot->posY))
+        error = "robot position on a wall";
+    if (error != NULL)
+        freeGrid(grid);
+    return error;
+}
+
+// The job always gets a grid of its own to run on. Inline grids check
+// the robot here and files in loadGridFromFile, so no grid with the robot
+// off the field or on a wall reaches the cache
+static const char *_m_loadServeGrid(Server *server, const JsonValue *request, Grid *grid, Robot *robot) {
+    const JsonValue *data = getJsonMember(request, "grid_data");
+    if (data != NULL)
+        return _m_buildServeGrid(data, grid, robot);
+
+    const JsonValue *path = getJsonMember(request, "grid");
+    if (path == NULL)
+        return "no \"grid\" or \"grid_data\"";
+    if (path->type != JSON_STRING)
+        return "\"grid\" must be a string";
+    size_t keyLength;
+    char *key = _m_makeFileKey('g', 0, path->string, &keyLength);
+    if (key == NULL)
+        return "failed to load grid";
+
+    ServeCacheEntry *entry = _m_acquireServeCacheEntry(&server->grids, key, keyLength);
+    if (entry != NULL) {
+        free(key);
+    } else {
+        ServeGrid *loaded = mallocT(ServeGrid);
+        loaded->grid = makeGrid();
+        if (loadGridFromFile(&loaded->grid, path->string, &loaded->robotPosX, &loaded->robotPosY) == EXIT_FAILURE) {
+            free(loaded);
+            free(key);
+            return "failed to load grid";
+        }
+        entry = _m_insertServeCacheEntry(&server->grids, key, keyLength, loaded);
+    }
+    const ServeGrid *cached = entry->value;
+    copyGrid(grid, &cached->grid);
+    robot->posX = cached->robotPosX;
+    robot->posY = cached->robotPosY;
+    _m_releaseServeCacheEntry(&server->grids, entry);
+    return NULL;
+}
+
+// Same order as check: row by row
+static void _m_appendPainted(ServeBuffer *answer, const Grid *grid) {
+    _m_appendBuffer(answer, ",\"painted\":[", 12);
+    bool first = true;
+    for (int tileY = 0; tileY < grid->tilesY; tileY++) {
+        if (grid->tiles[tileY] == NULL) continue;
+        for (int y = tileY << GRID_TILE_SHIFT; y < grid->height && y < (tileY + 1) << GRID_TILE_SHIFT; y++) {
+            for (int tileX = 0; tileX < grid->tilesX; tileX++) {
+                const unsigned char *tile = getGridTile(grid, tileX, tileY);
+                if (tile == NULL) continue;
+                const unsigned char *cell = &tile[_m_gridTileIndex(0, y)];
+                for (int x = tileX << GRID_TILE_SHIFT, dx = 0; dx < GRID_TILE_SIZE; x++, dx++) {
+                    if ((cell[dx] & CELL_TYPE_MASK) != GRID_CELL_FILLED) continue;
+                    _m_appendf(answer, first ? "[%d,%d]" : ",[%d,%d]", x, y);
+                    first = false;
+                }
+            }
+        }
+    }
+    _m_appendBuffer(answer, "]", 1);
+}
+
+// Appends the verdict, or returns what is wrong with the request
+static const char *_m_answerServeJob(Server *server, const JsonValue *request, ServeBuffer *answer) {
+    if (request->type != JSON_OBJECT)
+        return "expected an object";
+
+    Language lang = getKeywordLanguage();
+    const JsonValue *member = getJsonMember(request, "lang");
+    if (member != NULL && (member->type != JSON_STRING || !parseLanguageName(member->string, &lang)))
+        return "unknown language, expected \"ru\" or \"en\"";
+
+    InterpreterLimits limits;
+    const char *error = _m_readServeLimits(&server->options->limits, request, &limits);
+    if (error != NULL)
+        return error;
+
+    bool reportPaint = true;
+    member = getJsonMember(request, "paint");
+    if (member != NULL) {
+        if (member->type != JSON_BOOL)
+            return "\"paint\" must be true or false";
+        reportPaint = member->boolean;
+    }
+
+    Grid grid;
+    Robot robot = makeRobot();
+    error = _m_loadServeGrid(server, request, &grid, &robot);
+    if (error != NULL)
+        return error;
+
+    ServeCacheEntry *entry;
+    error = _m_acquireServeProgram(server, request, lang, &entry);
+    if (error != NULL) {
+        freeGrid(&grid);
+        return error;
+    }
+
+    const ServeProgram *program = entry->value;
+    RunResult result = { .code = program->code, .line = program->line, .steps = 0 };
+    if (program->code == INTERPRETER_NORMAL) {
+        Interpreter interpreter;
+        initInterpreter(&interpreter, &program->program, &robot, &grid);
+        setInterpreterLimits(&interpreter, limits);
+        result = runInterpreter(&interpreter);
+        freeInterpreter(&interpreter);
+    }
+    _m_releaseServeCacheEntry(&server->programs, entry);
+
+    _m_appendf(answer, "\"code\":\"%s\",\"line\":%zu,\"steps\":%zu,\"x\":%d,\"y\":%d",
+               getErrcodeName(result.code), result.line, result.steps, robot.posX, robot.posY);
+    if (reportPaint)
+        _m_appendPainted(answer, &grid);
+    freeGrid(&grid);
+    return NULL;
+}
+
+static void _m_runServeJob(Server *server, ServeJob *job) {
+    double start = getTimeSeconds();
+    ServeBuffer answer = { .data = NULL, .size = 0, .capacity = 0 };
+    _m_appendBuffer(&answer, "{", 1);
+
+    JsonValue request;
+    const char *error;
+    if (parseJson(job->line, job->length, &request)) {
+        const JsonValue *id = getJsonMember(&request, "id");
+        if (id != NULL) {
+            _m_appendBuffer(&answer, "\"id\":", 5);
+            _m_appendBuffer(&answer, id->raw, id->rawLength);
+            _m_appendBuffer(&answer, ",", 1);
+        }
+        size_t mark = answer.size;
+        error = _m_answerServeJob(server, &request, &answer);
+        if (error != NULL)
+            answer.size = mark;
+        freeJson(&request);
+    } else {
+        error = "invalid JSON";
+    }
+
+    if (error != NULL) {
+        _m_appendBuffer(&answer, "\"error\":", 8);
+        _m_appendJsonString(&answer, error);
+        _m_appendBuffer(&answer, "}\n", 2);
+    } else {
+        _m_appendf(&answer, ",\"time_us\":%.1f}\n", (getTimeSeconds() - start) * 1e6);
+    }
+    _m_sendServeAnswer(job->connection, &answer);
+    free(answer.data);
+}
+
+static void _m_pushServeJob(Server *server, ServeJob *job) {
+    pthread_mutex_lock(&server->lock);
+    while (server->queued >= SERVE_QUEUE_LIMIT)
+        pthread_cond_wait(&server->hasRoom, &server->lock);
+    job->next = NULL;
+    if (server->tail != NULL)
+        server->tail->next = job;
+    else
+        server->head = job;
+    server->tail = job;
+    server->queued++;
+    pthread_cond_signal(&server->hasJobs);
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Workers only stop once the server is closing and the queue is empty
+static void *_m_serveWorker(void *arg) {
+    Server *server = arg;
+    while (true) {
+        pthread_mutex_lock(&server->lock);
+        while (server->head == NULL && !server->closing)
+            pthread_cond_wait(&server->hasJobs, &server->lock);
+        ServeJob *job = server->head;
+        if (job == NULL) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        server->head = job->next;
+        if (server->head == NULL)
+            server->tail = NULL;
+        server->queued--;
+        pthread_cond_signal(&server->hasRoom);
+        pthread_mutex_unlock(&server->lock);
+
+        _m_runServeJob(server, job);
+        _m_releaseServeConnection(job->connection);
+        free(job->line);
+        free(job);
+    }
+    return NULL;
+}
+
+// One line of any length without its line break, or NULL at the end
+static char *_m_readServeLine(FILE *file, size_t *length) {
+    size_t capacity = 256;
+    size_t size = 0;
+    char *line = nmallocT(char, capacity);
+    while (fgets(line + size, (int)(capacity - size), file) != NULL) {
+        size += strlen(line + size);
+        if (size > 0 && line[size - 1] == '\n')
+            break;
+        if (size + 1 == capacity) {
+            capacity *= 2;
+            line = (char *)realloc(line, capacity);
+        }
+    }
+    if (size == 0 && feof(file)) {
+        free(line);
+        return NULL;
+    }
+    while (size > 0 && (line[size - 1] == '\n' || line[size - 1] == '\r'))
+        size--;
+    line[size] = '\0';
+    *length = size;
+    return line;
+}
+
+static void _m_readServeJobs(Server *server, ServeConnection *connection) {
+    char *line;
+    size_t length;
+    while ((line = _m_readServeLine(connection->in, &length)) != NULL) {
+        if (length == 0) {
+            free(line);
+            continue;
+        }
+        ServeJob *job = mallocT(ServeJob);
+        job->connection = connection;
+        job->line = line;
+        job->length = length;
+        _m_retainServeConnection(connection);
+        _m_pushServeJob(server, job);
+    }
+    _m_releaseServeConnection(connection);
+}
+
+#ifndef _WIN32
+typedef struct ServeClient {
+    Server *server;
+    ServeConnection *connection;
+} ServeClient;
+
+static void *_m_serveClient(void *arg) {
+    ServeClient *client = arg;
+    _m_readServeJobs(client->server, client->connection);
+    free(client);
+    return NULL;
+}
+
+// Serves until accept fails. A socket left behind by an earlier server
+// is replaced, any other file at the path is not
+static int _m_listenServeSocket(Server *server, const char *path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        puts("Socket path is too long");
+        return EXIT_FAILURE;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(path);
+
+    // A client that hangs up early must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        puts("Failed to open socket");
+        if (listener >= 0) close(listener);
+        return EXIT_FAILURE;
+    }
+
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        int outFd = dup(fd);
+        FILE *in = fdopen(fd, "r");
+        FILE *out = outFd >= 0 ? fdopen(outFd, "w") : NULL;
+        if (in == NULL || out == NULL) {
+            if (in != NULL) fclose(in); else close(fd);
+            if (out != NULL) fclose(out); else if (outFd >= 0) close(outFd);
+            continue;
+        }
+        ServeClient *client = mallocT(ServeClient);
+        client->server = server;
+        client->connection = _m_makeServeConnection(in, out, true);
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, _m_serveClient, client) != 0) {
+            _m_releaseServeConnection(client->connection);
+            free(client);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    puts("Failed to accept a connection");
+    close(listener);
+    unlink(path);
+    return EXIT_FAILURE;
+}
+#endif
+
+int runServer(const ServeOptions *options) {
+    Server server = {
+        .options = options,
+        .head = NULL,
+        .tail = NULL,
+        .queued = 0,
+        .closing = false
+    };
+    size_t cacheEntries = options->cacheEntries > 0 ? options->cacheEntries : SERVE_DEFAULT_CACHE_ENTRIES;
+    _m_initServeCache(&server.programs, cacheEntries, _m_freeServeProgram);
+    _m_initServeCache(&server.grids, cacheEntries, _m_freeServeGrid);
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.hasJobs, NULL);
+    pthread_cond_init(&server.hasRoom, NULL);
+
+    int workerCount = options->threadCount > 0 ? options->threadCount : getCpuCount();
+    pthread_t *workers = nmallocT(pthread_t, workerCount);
+    for (int i = 0; i < workerCount; i++)
+        pthread_create(&workers[i], NULL, _m_serveWorker, &server);
+
+    int exitCode = EXIT_SUCCESS;
+    if (options->socketPath == NULL) {
+        // Answers get stdout to themselves
+        fflush(stdout);
+        FILE *out = fdopen(dup(fileno(stdout)), "w");
+        dup2(fileno(stderr), fileno(stdout));
+        _m_readServeJobs(&server, _m_makeServeConnection(stdin, out, false));
+
+        pthread_mutex_lock(&server.lock);
+        server.closing = true;
+        pthread_cond_broadcast(&server.hasJobs);
+        pthread_mutex_unlock(&server.lock);
+        for (int i = 0; i < workerCount; i++)
+            pthread_join(workers[i], NULL);
+        fclose(out);
+    } else {
+#ifdef _WIN32
+        puts("Sockets are not supported on this platform");
+        exitCode = EXIT_FAILURE;
+#else
+        exitCode = _m_listenServeSocket(&server, options->socketPath);
+#endif
+        // Connections may still be reading, so the workers are left to
+        // the exit of the process
+        free(workers);
+        return exitCode;
+    }
+
+    free(workers);
+    _m_freeServeCache(&server.programs);
+    _m_freeServeCache(&server.grids);
+    pthread_mutex_destroy(&server.lock);
+    pthread_cond_destroy(&server.hasJobs);
+    pthread_cond_destroy(&server.hasRoom);
+    return exitCode;
+}
@@ -0,0 +1,37 @@
+#include <stddef.h>
+
+#include "interpreter.h"
+
+#ifndef KUMIR_SERVE_H
+#define KUMIR_SERVE_H
+
+
+// A resident checker: jobs come in as one JSON object per line, on stdin
+// or over a Unix domain socket, and every job is answered with one JSON
+// line as soon as it is done, so answers may come out of order. A job is
+//     {"id": <any>, "source": "<program text>" or "program": "<path>",
+//      "grid": "<path>" or "grid_data": {"width", "height", "x", "y",
+//      "walls": [[x, y], ...], "painted": [[x, y], ...]},
+//      "lang": "ru"|"en", "max_steps", "timeout", "loop_check", "paint"}
+// and its answer is check's verdict plus the id and time_us, or
+// {"id": <id>, "error": "<message>"}. "paint": false leaves the painted
+// cells out of the answer. Compiled programs and loaded grids stay in
+// memory between jobs; a file is looked up by its path, modification
+// time and size, so an edited file is read again
+typedef struct ServeOptions {
+    InterpreterLimits limits;  // the defaults for every job, and the caps when set
+    const char *socketPath;    // NULL reads jobs from stdin
+    int threadCount;           // 0 means one per core
+    size_t cacheEntries;       // programs and grids kept each
+} ServeOptions;
+
+#define SERVE_DEFAULT_CACHE_ENTRIES 1024
+#define SERVE_QUEUE_LIMIT 4096
+
+// With jobs on stdin, returns once stdin is closed and every job is
+// answered; diagnostics the core prints to stdout then go to stderr, so
+// stdout only carries answers. With a socket it only returns on failure
+int runServer(const ServeOptions *options);
+
+
+#endif // !KUMIR_SERVE_H
@@ -0,0 +1,656 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sweep.h"
+
+
+// _m_checkLoopState on displacements: a robot is back at its position and
+// paint exactly when its group is back at its displacement and flips
+typedef struct SweepLoopCheck {
+    bool hasCheckpoint;
+    size_t pc;
+    int offsetX;
+    int offsetY;
+    uint64_t *flips;
+    size_t power;
+    size_t length;
+} SweepLoopCheck;
+
+typedef struct SweepGroup {
+    uint64_t *robots;
+    size_t count;
+    size_t pc;
+    size_t steps;
+    int offsetX;
+    int offsetY;
+    uint64_t *flips;  // a bit per displacement, set where the paint was flipped an odd number of times
+    SweepLoopCheck loopCheck;
+} SweepGroup;
+
+typedef struct SweepCondition {
+    Condition condition;
+    uint64_t *plane;
+} SweepCondition;
+
+typedef struct Sweeper {
+    const Program *program;
+    const Grid *grid;
+    InterpreterLimits limits;
+    size_t maxSteps;
+    double deadline;
+    size_t words;
+    int flipsWidth;  // displacements are laid out on a (2w-1)x(2h-1) plane, none in the middle
+    size_t flipWords;
+    uint64_t *masks;    // a plane per wall mask, of the free cells that have it
+    uint64_t *blocked;  // a plane per Direction, of the free cells with a wall that way
+    uint64_t *scratch;
+    uint64_t *starts;
+    size_t *startRanks;  // starts before each word of the starts plane
+    SweepCondition *conditions;
+    size_t conditionCount;
+    SweepGroup *pending;
+    size_t pendingCount;
+    size_t pendingCapacity;
+    Sweep *sweep;
+} Sweeper;
+
+static uint64_t *_m_makePlane(const Sweeper *sweeper) {
+    return (uint64_t *)calloc(sweeper->words, sizeof(uint64_t));
+}
+
+// The cells of all wall masks the condition holds for, built the first
+// time the condition is met
+static const uint64_t *_m_getConditionPlane(Sweeper *sweeper, Condition condition) {
+    for (size_t i = 0; i < sweeper->conditionCount; i++) {
+        if (sweeper->conditions[i].condition == condition)
+            return sweeper->conditions[i].plane;
+    }
+    uint64_t *plane = _m_makePlane(sweeper);
+    for (int mask = 0; mask < 16; mask++) {
+        if (!(condition >> mask & 1)) continue;
+        const uint64_t *cells = &sweeper->masks[mask * sweeper->words];
+        for (size_t i = 0; i < sweeper->words; i++)
+            plane[i] |= cells[i];
+    }
+    sweeper->conditions = (SweepCondition *)realloc(sweeper->conditions, (sweeper->conditionCount + 1) * sizeof(SweepCondition));
+    sweeper->conditions[sweeper->conditionCount++] = (SweepCondition){ .condition = condition, .plane = plane };
+    return plane;
+}
+
+// Moves every bit of the plane by shift places, towards the end for a
+// positive shift. Robots never cross the border, so nothing falls off
+static void _m_shiftPlane(uint64_t *plane, size_t words, long long shift) {
+    size_t wordShift = (size_t)(llabs(shift) >> 6);
+    int bitShift = (int)(llabs(shift) & 63);
+    if (shift > 0) {
+        for (size_t i = words; i-- > 0;) {
+            uint64_t word = 0;
+            if (i >= wordShift) {
+                word = plane[i - wordShift] << bitShift;
+                if (bitShift != 0 && i > wordShift)
+                    word |= plane[i - wordShift - 1] >> (64 - bitShift);
+            }
+            plane[i] = word;
+        }
+    } else {
+        for (size_t i = 0; i < words; i++) {
+            uint64_t word = 0;
+            if (i + wordShift < words) {
+                word = plane[i + wordShift] >> bitShift;
+                if (bitShift != 0 && i + wordShift + 1 < words)
+                    word |= plane[i + wordShift + 1] << (64 - bitShift);
+            }
+            plane[i] = word;
+        }
+    }
+}
+
+static SweepResult *_m_getStartResult(const Sweeper *sweeper, int startX, int startY) {
+    size_t index = (size_t)startY * sweeper->grid->width + startX;
+    uint64_t before = sweeper->starts[index >> 6] & (((uint64_t)1 << (index & 63)) - 1);
+    return &sweeper->sweep->results[sweeper->startRanks[index >> 6] + countWordBits(before)];
+}
+
+static size_t _m_getFlipIndex(const Sweeper *sweeper, int offsetX, int offsetY) {
+    return (size_t)(offsetY + sweeper->grid->height - 1) * sweeper->flipsWidth + offsetX + sweeper->grid->width - 1;
+}
+
+// x, y pairs of the displacements set in flips; returns their number
+static size_t _m_listFlips(const Sweeper *sweeper, const uint64_t *flips, int **offsets) {
+    size_t count = countGridPlaneBits(flips, sweeper->flipWords);
+    *offsets = count == 0 ? NULL : nmallocT(int, 2 * count);
+    size_t flip = 0;
+    for (size_t i = 0; i < sweeper->flipWords; i++) {
+        uint64_t word = flips[i];
+        while (word != 0) {
+            size_t index = i * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            (*offsets)[2 * flip] = (int)(index % sweeper->flipsWidth) - (sweeper->grid->width - 1);
+            (*offsets)[2 * flip + 1] = (int)(index / sweeper->flipsWidth) - (sweeper->grid->height - 1);
+            flip++;
+        }
+    }
+    return count;
+}
+
+// The start grid with the flips moved onto the robot that started at
+// (startX, startY)
+static void _m_makeRobotPaint(const Sweeper *sweeper, const uint64_t *flips, int startX, int startY, Grid *paint) {
+    copyGrid(paint, sweeper->grid);
+    int *offsets;
+    size_t count = _m_listFlips(sweeper, flips, &offsets);
+    for (size_t i = 0; i < count; i++)
+        flipGridColor(paint, startX + offsets[2 * i], startY + offsets[2 * i + 1]);
+    free(offsets);
+}
+
+static void _m_addFlip(SweepResult *result, size_t *capacity, int x, int y) {
+    if (result->flipCount == *capacity) {
+        *capacity = *capacity == 0 ? 16 : *capacity * 2;
+        result->flips = (int *)realloc(result->flips, *capacity * 2 * sizeof(int));
+    }
+    result->flips[2 * result->flipCount] = x;
+    result->flips[2 * result->flipCount + 1] = y;
+    result->flipCount++;
+}
+
+// Compares the paint a tile row at a time, see getGridTileRowMask
+static void _m_setPaintDiff(SweepResult *result, const Grid *before, const Grid *after) {
+    size_t capacity = 0;
+    for (int tileY = 0; tileY < after->tilesY; tileY++) {
+        for (int tileX = 0; tileX < after->tilesX; tileX++) {
+            const unsigned char *tileBefore = getGridTile(before, tileX, tileY);
+            const unsigned char *tileAfter = getGridTile(after, tileX, tileY);
+            if (tileAfter == NULL && tileBefore == NULL) continue;
+            for (int row = 0; row < GRID_TILE_SIZE; row++) {
+                uint64_t diff = (tileBefore == NULL ? 0 : getGridTileRowMask(tileBefore, row, GRID_CELL_FILLED))
+                              ^ (tileAfter == NULL ? 0 : getGridTileRowMask(tileAfter, row, GRID_CELL_FILLED));
+                while (diff != 0) {
+                    int x = (tileX << GRID_TILE_SHIFT) + __builtin_ctzll(diff);
+                    diff &= diff - 1;
+                    _m_addFlip(result, &capacity, x, (tileY << GRID_TILE_SHIFT) + row);
+                }
+            }
+        }
+    }
+}
+
+// Every robot of the plane stops with the code at pc, after the steps of
+// the group
+static void _m_finishRobots(Sweeper *sweeper, const SweepGroup *group, const uint64_t *robots, InterpreterExitCode code, size_t pc) {
+    int width = sweeper->grid->width;
+    int *offsets;
+    size_t flipCount = _m_listFlips(sweeper, group->flips, &offsets);
+
+    RunResult run = {
+        .code = code,
+        .line = getInstructionLine(sweeper->program, pc),
+        .steps = group->steps,
+        .pc = pc
+    };
+    for (size_t i = 0; i < sweeper->words; i++) {
+        uint64_t word = robots[i];
+        while (word != 0) {
+            size_t cellIndex = i * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            int x = (int)(cellIndex % width), y = (int)(cellIndex / width);
+            SweepResult *result = _m_getStartResult(sweeper, x - group->offsetX, y - group->offsetY);
+            result->run = run;
+            result->robotPosX = x;
+            result->robotPosY = y;
+            result->flipCount = flipCount;
+            if (flipCount == 0) continue;
+            result->flips = nmallocT(int, 2 * flipCount);
+            for (size_t flip = 0; flip < flipCount; flip++) {
+                result->flips[2 * flip] = result->startX + offsets[2 * flip];
+                result->flips[2 * flip + 1] = result->startY + offsets[2 * flip + 1];
+            }
+        }
+    }
+    free(offsets);
+}
+
+// After переместить all robots of the group stand on one cell and no
+// longer share a displacement, so each goes on alone in the interpreter
+// from the state it would have had there, loop checkpoint included
+static void _m_runRobots(Sweeper *sweeper, const SweepGroup *group) {
+    int width = sweeper->grid->width;
+    for (size_t i = 0; i < sweeper->words; i++) {
+        uint64_t word = group->robots[i];
+        while (word != 0) {
+            size_t cellIndex = i * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            Robot robot = { .posX = (int)(cellIndex % width), .posY = (int)(cellIndex / width) };
+            SweepResult *result = _m_getStartResult(sweeper, robot.posX - group->offsetX, robot.posY - group->offsetY);
+
+            Grid grid;
+            _m_makeRobotPaint(sweeper, group->flips, result->startX, result->startY, &grid);
+            InterpreterLimits limits = sweeper->limits;
+            if (sweeper->deadline > 0) {
+                limits.maxSeconds = sweeper->deadline - getTimeSeconds();
+                if (limits.maxSeconds <= 0)
+                    limits.maxSeconds = 1e-9;
+            }
+            Interpreter interpreter;
+            initInterpreter(&interpreter, sweeper->program, &robot, &grid);
+            setInterpreterLimits(&interpreter, limits);
+            interpreter.pc = group->pc;
+            interpreter.steps = group->steps;
+            const SweepLoopCheck *groupCheck = &group->loopCheck;
+            if (groupCheck->hasCheckpoint) {
+                LoopCheck *check = &interpreter.loopCheck;
+                check->hasCheckpoint = true;
+                check->pc = groupCheck->pc;
+                check->posX = result->startX + groupCheck->offsetX;
+                check->posY = result->startY + groupCheck->offsetY;
+                check->power = groupCheck->power;
+                check->length = groupCheck->length;
+                _m_makeRobotPaint(sweeper, groupCheck->flips, result->startX, result->startY, &check->paint);
+            }
+            result->run = runInterpreter(&interpreter);
+            freeInterpreter(&interpreter);
+
+            result->robotPosX = robot.posX;
+            result->robotPosY = robot.posY;
+            _m_setPaintDiff(result, sweeper->grid, &grid);
+            freeGrid(&grid);
+        }
+    }
+}
+
+static bool _m_isOverLimit(const Sweeper *sweeper, const SweepGroup *group) {
+    return group->steps >= sweeper->maxSteps && group->pc < sweeper->program->size;
+}
+
+static void _m_freeGroup(SweepGroup *group) {
+    free(group->robots);
+    free(group->flips);
+    free(group->loopCheck.flips);
+}
+
+static uint64_t *_m_copyPlane(const uint64_t *plane, size_t words) {
+    uint64_t *copy = nmallocT(uint64_t, words);
+    memcpy(copy, plane, words * sizeof(uint64_t));
+    return copy;
+}
+
+// The robots of the plane take the jump to pc as a group of their own,
+// one step after the group
+static void _m_forkGroup(Sweeper *sweeper, const SweepGroup *group, const uint64_t *robots, size_t count, size_t pc) {
+    SweepGroup fork = *group;
+    fork.robots = (uint64_t *)robots;
+    fork.count = count;
+    fork.pc = pc;
+    fork.steps = group->steps + 1;
+    if (_m_isOverLimit(sweeper, &fork)) {
+        _m_finishRobots(sweeper, &fork, robots, INTERPRETER_STEP_LIMIT, group->pc);
+        return;
+    }
+
+    fork.robots = _m_copyPlane(robots, sweeper->words);
+    fork.flips = _m_copyPlane(group->flips, sweeper->flipWords);
+    if (group->loopCheck.hasCheckpoint)
+        fork.loopCheck.flips = _m_copyPlane(group->loopCheck.flips, sweeper->flipWords);
+    if (sweeper->pendingCount == sweeper->pendingCapacity) {
+        sweeper->pendingCapacity = sweeper->pendingCapacity == 0 ? 16 : sweeper->pendingCapacity * 2;
+        sweeper->pending = (SweepGroup *)realloc(sweeper->pending, sweeper->pendingCapacity * sizeof(SweepGroup));
+    }
+    sweeper->pending[sweeper->pendingCount++] = fork;
+}
+
+// Robots for which the condition is false go on from target as a group
+// of their own. Returns false when none of the robots are left, and the
+// whole group takes the jump
+static bool _m_splitGroup(Sweeper *sweeper, SweepGroup *group, Condition condition, size_t target) {
+    const uint64_t *holds = _m_getConditionPlane(sweeper, condition);
+    uint64_t *failed = sweeper->scratch;
+    size_t failedCount = 0;
+    for (size_t i = 0; i < sweeper->words; i++) {
+        failed[i] = group->robots[i] & ~holds[i];
+        failedCount += countWordBits(failed[i]);
+    }
+    if (failedCount == 0)
+        return true;
+    if (failedCount == group->count)
+        return false;
+    for (size_t i = 0; i < sweeper->words; i++)
+        group->robots[i] &= holds[i];
+    group->count -= failedCount;
+    _m_forkGroup(sweeper, group, failed, failedCount, target);
+    return true;
+}
+
+// Robots with a wall that way stop with an error where they are and the
+// rest move. Returns false when none are left
+static bool _m_moveGroup(Sweeper *sweeper, SweepGroup *group, Direction dir) {
+    const uint64_t *blocked = &sweeper->blocked[dir * sweeper->words];
+    uint64_t *stuck = sweeper->scratch;
+    size_t stuckCount = 0;
+    for (size_t i = 0; i < sweeper->words; i++) {
+        stuck[i] = group->robots[i] & blocked[i];
+        stuckCount += countWordBits(stuck[i]);
+    }
+    if (stuckCount != 0) {
+        _m_finishRobots(sweeper, group, stuck, INTERPRETER_ERROR, group->pc);
+        if (stuckCount == group->count)
+            return false;
+        for (size_t i = 0; i < sweeper->words; i++)
+            group->robots[i] &= ~blocked[i];
+        group->count -= stuckCount;
+    }
+    _m_shiftPlane(group->robots, sweeper->words, m_directionX[dir] + (long long)m_directionY[dir] * sweeper->grid->width);
+    group->offsetX += m_directionX[dir];
+    group->offsetY += m_directionY[dir];
+    return true;
+}
+
+static void _m_paintGroup(const Sweeper *sweeper, SweepGroup *group) {
+    size_t index = _m_getFlipIndex(sweeper, group->offsetX, group->offsetY);
+    group->flips[index >> 6] ^= (uint64_t)1 << (index & 63);
+}
+
+static void _m_flipGroupSpan(const Sweeper *sweeper, SweepGroup *group, int offsetX, int offsetY, int dx, int dy, size_t count) {
+    size_t index = _m_getFlipIndex(sweeper, offsetX, offsetY);
+    long long stride = dx + (long long)dy * sweeper->flipsWidth;
+    for (size_t i = 0; i < count; i++, index += stride)
+        group->flips[index >> 6] ^= (uint64_t)1 << (index & 63);
+}
+
+// Moves the robot of a group of one by (dx, dy) times moves
+static void _m_moveLoneRobot(const Sweeper *sweeper, SweepGroup *group, int dx, int dy, int moves) {
+    size_t i = 0;
+    while (group->robots[i] == 0)
+        i++;
+    size_t cellIndex = i * 64 + __builtin_ctzll(group->robots[i]);
+    group->robots[i] = 0;
+    cellIndex += (long long)(dx + (long long)dy * sweeper->grid->width) * moves;
+    group->robots[cellIndex >> 6] |= (uint64_t)1 << (cellIndex & 63);
+    group->offsetX += dx * moves;
+    group->offsetY += dy * moves;
+}
+
+static void _m_findLoneRobot(const Sweeper *sweeper, const SweepGroup *group, int *x, int *y) {
+    size_t i = 0;
+    while (group->robots[i] == 0)
+        i++;
+    size_t cellIndex = i * 64 + __builtin_ctzll(group->robots[i]);
+    *x = (int)(cellIndex % sweeper->grid->width);
+    *y = (int)(cellIndex / sweeper->grid->width);
+}
+
+// Once a group is down to one robot there is nothing left to do a plane
+// at a time, so fused instructions are run whole like _m_runSlide and
+// _m_runMoveRun do, with the same fallback to stepping near the step
+// limit
+static bool _m_runLoneSlide(const Sweeper *sweeper, SweepGroup *group, const Instruction *instr) {
+    int x, y, dx = m_directionX[instr->x], dy = m_directionY[instr->x];
+    _m_findLoneRobot(sweeper, group, &x, &y);
+    int moves = getGridFreeRun(sweeper->grid, x, y, dx, dy);
+    size_t bodySteps = instr->y == FUSED_PAINT_NONE ? 1 : 2;
+    size_t steps = (size_t)moves * (bodySteps + 1) + 1;
+    if (sweeper->limits.maxSteps && group->steps + steps > sweeper->limits.maxSteps)
+        return false;
+
+    if (instr->y == FUSED_PAINT_BEFORE)
+        _m_flipGroupSpan(sweeper, group, group->offsetX, group->offsetY, dx, dy, moves);
+    else if (instr->y == FUSED_PAINT_AFTER)
+        _m_flipGroupSpan(sweeper, group, group->offsetX + dx, group->offsetY + dy, dx, dy, moves);
+    _m_moveLoneRobot(sweeper, group, dx, dy, moves);
+    group->steps += steps;
+    group->pc = instr->target;
+    return true;
+}
+
+// A run that hits a wall stops the robot with an error at the pc of the
+// failing move, then *failed is set
+static bool _m_runLoneMoveRun(Sweeper *sweeper, SweepGroup *group, const Instruction *instr, bool *failed) {
+    int x, y, dx = m_directionX[instr->x], dy = m_directionY[instr->x];
+    _m_findLoneRobot(sweeper, group, &x, &y);
+    size_t length = instr->target - group->pc;
+    size_t moves = instr->y == FUSED_PAINT_NONE ? length
+                 : instr->y == FUSED_PAINT_BEFORE ? length / 2
+                 : (length + 1) / 2;
+    size_t freeRun = getGridFreeRun(sweeper->grid, x, y, dx, dy);
+
+    size_t executed = length;
+    *failed = false;
+    if (freeRun < moves) {
+        moves = freeRun;
+        executed = instr->y == FUSED_PAINT_NONE ? moves
+                 : instr->y == FUSED_PAINT_BEFORE ? 2 * moves + 1
+                 : 2 * moves;
+        *failed = true;
+    }
+    if (sweeper->limits.maxSteps && group->steps + executed >= sweeper->limits.maxSteps)
+        return false;
+
+    size_t paints = executed - moves;
+    if (paints > 0) {
+        int offset = instr->y == FUSED_PAINT_AFTER ? 1 : 0;
+        _m_flipGroupSpan(sweeper, group, group->offsetX + dx * offset, group->offsetY + dy * offset, dx, dy, paints);
+    }
+    _m_moveLoneRobot(sweeper, group, dx, dy, (int)moves);
+    group->steps += executed;
+    group->pc += executed;
+    if (*failed)
+        _m_finishRobots(sweeper, group, group->robots, INTERPRETER_ERROR, group->pc);
+    return true;
+}
+
+static bool _m_checkGroupLoop(const Sweeper *sweeper, SweepGroup *group) {
+    SweepLoopCheck *check = &group->loopCheck;
+    size_t flipBytes = sweeper->flipWords * sizeof(uint64_t);
+    if (check->hasCheckpoint) {
+        if (check->pc == group->pc && check->offsetX == group->offsetX && check->offsetY == group->offsetY
+            && memcmp(check->flips, group->flips, flipBytes) == 0)
+            return true;
+        if (++check->length < check->power)
+            return false;
+        check->power *= 2;
+    } else {
+        check->power = 1;
+        check->flips = nmallocT(uint64_t, sweeper->flipWords);
+    }
+    check->hasCheckpoint = true;
+    check->length = 0;
+    check->pc = group->pc;
+    check->offsetX = group->offsetX;
+    check->offsetY = group->offsetY;
+    memcpy(check->flips, group->flips, flipBytes);
+    return false;
+}
+
+// Steps the group the way stepInterpreter steps each of its robots until
+// all of them have stopped or gone to groups of their own. Fused
+// instructions are taken one source instruction at a time while the
+// group has robots that may part on the way
+static void _m_runGroup(Sweeper *sweeper, SweepGroup *group) {
+    const Program *program = sweeper->program;
+    size_t nextClock = group->steps + INTERPRETER_CLOCK_INTERVAL;
+    while (true) {
+        size_t pc = group->pc;
+        if (pc >= program->size) {
+            _m_finishRobots(sweeper, group, group->robots, INTERPRETER_FINISHED, pc);
+            return;
+        }
+        const Instruction *instr = &program->code[pc];
+        size_t next = pc + 1;
+        bool failed, fused = false;
+        switch (instr->op) {
+        case OP_GO_UP:
+        case OP_GO_DOWN:
+        case OP_GO_LEFT:
+        case OP_GO_RIGHT:
+            // The moves are in the order of Direction
+            if (!_m_moveGroup(sweeper, group, (Direction)(instr->op - OP_GO_UP))) return;
+            break;
+        case OP_PAINT:
+            _m_paintGroup(sweeper, group);
+            break;
+        case OP_SETPOS:
+            _m_runRobots(sweeper, group);
+            return;
+        case OP_MOVE_RUN:
+            if (group->count == 1 && _m_runLoneMoveRun(sweeper, group, instr, &failed)) {
+                if (failed) return;
+                fused = true;
+            } else if (instr->y == FUSED_PAINT_BEFORE) {
+                _m_paintGroup(sweeper, group);
+            } else if (!_m_moveGroup(sweeper, group, (Direction)instr->x)) {
+                return;
+            }
+            break;
+        case OP_SLIDE:
+            if (group->count == 1 && _m_runLoneSlide(sweeper, group, instr))
+                fused = true;
+            else if (!_m_splitGroup(sweeper, group, instr->condition, instr->target))
+                next = instr->target;
+            break;
+        case OP_LOOP:
+            if (sweeper->limits.detectLoops && _m_checkGroupLoop(sweeper, group)) {
+                _m_finishRobots(sweeper, group, group->robots, INTERPRETER_INFINITE_LOOP, pc);
+                return;
+            }
+            // fallthrough
+        case OP_IF:
+            if (!_m_splitGroup(sweeper, group, instr->condition, instr->target))
+                next = instr->target;
+            break;
+        case OP_ENDLOOP:
+        case OP_EXITLOOP:
+            next = instr->target;
+            break;
+        case OP_EXIT:
+            _m_finishRobots(sweeper, group, group->robots, INTERPRETER_FORCE_EXIT, pc);
+            return;
+        }
+        if (!fused) {
+            group->pc = next;
+            if (instr->op != OP_ENDLOOP)
+                group->steps++;
+        }
+
+        if (_m_isOverLimit(sweeper, group)) {
+            _m_finishRobots(sweeper, group, group->robots, INTERPRETER_STEP_LIMIT, pc);
+            return;
+        }
+        if (sweeper->deadline > 0 && group->steps >= nextClock) {
+            nextClock = group->steps + INTERPRETER_CLOCK_INTERVAL;
+            if (getTimeSeconds() > sweeper->deadline) {
+                _m_finishRobots(sweeper, group, group->robots, INTERPRETER_TIMEOUT, pc);
+                return;
+            }
+        }
+    }
+}
+
+static void _m_freeSweeper(Sweeper *sweeper) {
+    free(sweeper->masks);
+    free(sweeper->blocked);
+    free(sweeper->scratch);
+    free(sweeper->starts);
+    free(sweeper->startRanks);
+    for (size_t i = 0; i < sweeper->conditionCount; i++)
+        free(sweeper->conditions[i].plane);
+    free(sweeper->conditions);
+    free(sweeper->pending);
+}
+
+int sweepProgram(Sweep *sweep, const Program *program, const Grid *grid, const uint64_t *starts, InterpreterLimits limits) {
+    sweep->results = NULL;
+    sweep->count = 0;
+    if ((size_t)grid->width * grid->height > SWEEP_MAX_CELLS)
+        return EXIT_FAILURE;
+
+    Sweeper sweeper = {
+        .program = program,
+        .grid = grid,
+        .limits = limits,
+        .maxSteps = limits.maxSteps ? limits.maxSteps : SIZE_MAX,
+        .deadline = limits.maxSeconds > 0 ? getTimeSeconds() + limits.maxSeconds : 0,
+        .words = getGridPlaneWords(grid->width, grid->height),
+        .flipsWidth = 2 * grid->width - 1,
+        .flipWords = getGridPlaneWords(2 * grid->width - 1, 2 * grid->height - 1),
+        .conditions = NULL,
+        .conditionCount = 0,
+        .pending = NULL,
+        .pendingCount = 0,
+        .pendingCapacity = 0,
+        .sweep = sweep
+    };
+    size_t words = sweeper.words;
+    sweeper.masks = (uint64_t *)calloc(16 * words, sizeof(uint64_t));
+    sweeper.blocked = (uint64_t *)calloc(4 * words, sizeof(uint64_t));
+    sweeper.scratch = _m_makePlane(&sweeper);
+    sweeper.starts = _m_makePlane(&sweeper);
+    sweeper.startRanks = nmallocT(size_t, words);
+
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            if (getGridCell(grid, x, y) == GRID_CELL_WALL) continue;
+            setGridPlaneBit(&sweeper.masks[getGridWallMask(grid, x, y) * words], grid->width, x, y);
+            if (starts == NULL || getGridPlaneBit(starts, grid->width, x, y))
+                setGridPlaneBit(sweeper.starts, grid->width, x, y);
+        }
+    }
+    for (int dir = 0; dir < 4; dir++) {
+        uint64_t *blocked = &sweeper.blocked[dir * words];
+        for (int mask = 0; mask < 16; mask++) {
+            if (!(mask >> dir & 1)) continue;
+            for (size_t i = 0; i < words; i++)
+                blocked[i] |= sweeper.masks[mask * words + i];
+        }
+    }
+    for (size_t i = 0; i < words; i++) {
+        sweeper.startRanks[i] = sweep->count;
+        sweep->count += countWordBits(sweeper.starts[i]);
+    }
+
+    sweep->results = (SweepResult *)calloc(sweep->count, sizeof(SweepResult));
+    size_t result = 0;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t word = sweeper.starts[i];
+        while (word != 0) {
+            size_t cellIndex = i * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            sweep->results[result].startX = (int)(cellIndex % grid->width);
+            sweep->results[result].startY = (int)(cellIndex / grid->width);
+            result++;
+        }
+    }
+
+    SweepGroup group = {
+        .robots = _m_copyPlane(sweeper.starts, words),
+        .count = sweep->count,
+        .pc = 0,
+        .steps = 0,
+        .offsetX = 0,
+        .offsetY = 0,
+        .flips = (uint64_t *)calloc(sweeper.flipWords, sizeof(uint64_t)),
+        .loopCheck = { .hasCheckpoint = false, .flips = NULL }
+    };
+    if (sweep->count > 0)
+        _m_runGroup(&sweeper, &group);
+    _m_freeGroup(&group);
+
+    while (sweeper.pendingCount > 0) {
+        group = sweeper.pending[--sweeper.pendingCount];
+        _m_runGroup(&sweeper, &group);
+        _m_freeGroup(&group);
+    }
+    _m_freeSweeper(&sweeper);
+    return EXIT_SUCCESS;
+}
+
+void applySweepPaint(const SweepResult *result, Grid *grid) {
+    for (size_t i = 0; i < result->flipCount; i++)
+        flipGridColor(grid, result->flips[2 * i], result->flips[2 * i + 1]);
+}
+
+void freeSweep(Sweep *sweep) {
+    for (size_t i = 0; i < sweep->count; i++)
+        free(sweep->results[i].flips);
+    free(sweep->results);
+    sweep->results = NULL;
+    sweep->count = 0;
+}
@@ -0,0 +1,60 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "interpreter.h"
+
+#ifndef KUMIR_SWEEP_H
+#define KUMIR_SWEEP_H
+
+
+// Runs a program from every start cell of a grid at once. Walls never
+// change and conditions only look at walls, so the robots that have
+// taken the same branches so far make one group: they are at the same
+// pc after the same number of steps, all the same displacement away from
+// their starts, and their positions are one bit plane of the field. A
+// move masks the plane with the cells that have a wall that way (those
+// robots stop with an error) and shifts it, and a condition that holds
+// for some robots and not for others splits the group in two.
+//
+// закрасить flips the bit of the group's displacement on a plane of
+// displacements, which is each robot's own paint moved by its start. Two
+// states of a group then match for every robot or for none, so loop
+// checks work on the group as well. Only переместить breaks the shared
+// displacement: a group that reaches it goes on one robot at a time in
+// the plain interpreter. A group down to one robot stays a group but
+// takes fused slides and move runs whole, as the interpreter does.
+//
+// Every start ends with the code, line, steps, position and paint the
+// interpreter would give it
+typedef struct SweepResult {
+    int startX;
+    int startY;
+    RunResult run;
+    int robotPosX;
+    int robotPosY;
+    int *flips;  // x, y pairs of the cells whose paint the run flipped
+    size_t flipCount;
+} SweepResult;
+
+typedef struct Sweep {
+    SweepResult *results;  // one per start, by row and then by column
+    size_t count;
+} Sweep;
+
+// Every group keeps a bit per cell for its positions and four for its
+// displacements, twice over with a loop checkpoint
+#define SWEEP_MAX_CELLS (1 << 16)
+
+// starts is a plane of the field (see GridPlanes) with the cells to start
+// from, NULL for all; walls are never started from. Fails on a field of
+// more than SWEEP_MAX_CELLS cells
+int sweepProgram(Sweep *sweep, const Program *program, const Grid *grid, const uint64_t *starts, InterpreterLimits limits);
+
+// Flips the cells of the result on grid, which starts as a copy of the
+// grid that was swept
+void applySweepPaint(const SweepResult *result, Grid *grid);
+
+void freeSweep(Sweep *sweep);
+
+
+#endif // !KUMIR_SWEEP_H
@@ -0,0 +1,118 @@
+#include <math.h>
+#include <string.h>
+
+#include "png.h"
+#include "thumbnail.h"
+
+
+// raylib's GREEN, PURPLE, GRAY, YELLOW, GRAY and LIGHTGRAY, as in render.c
+static const PngColor m_thumbnailPalette[THUMBNAIL_COLOR_COUNT] = {
+    { 0, 228, 48 },
+    { 200, 122, 255 },
+    { 130, 130, 130 },
+    { 253, 249, 0 },
+    { 130, 130, 130 },
+    { 200, 200, 200 }
+};
+
+static void _m_fillThumbnailRect(Thumbnail *thumbnail, int x, int y, int width, int height, ThumbnailColor color) {
+    if (x < 0) { width += x; x = 0; }
+    if (y < 0) { height += y; y = 0; }
+    if (x + width > thumbnail->width) width = thumbnail->width - x;
+    if (y + height > thumbnail->height) height = thumbnail->height - y;
+    if (width <= 0 || height <= 0) return;
+    for (int row = y; row < y + height; row++)
+        memset(thumbnail->pixels + (size_t)row * thumbnail->width + x, color, width);
+}
+
+// Pixel centers inside the circle
+static void _m_fillThumbnailCircle(Thumbnail *thumbnail, float centerX, float centerY, float radius, ThumbnailColor color) {
+    for (int y = (int)floorf(centerY - radius); y <= (int)ceilf(centerY + radius); y++) {
+        float dy = y + 0.5f - centerY;
+        if (dy * dy > radius * radius) continue;
+        float halfWidth = sqrtf(radius * radius - dy * dy);
+        int xStart = (int)ceilf(centerX - halfWidth - 0.5f);
+        int xEnd = (int)floorf(centerX + halfWidth - 0.5f);
+        _m_fillThumbnailRect(thumbnail, xStart, y, xEnd - xStart + 1, 1, color);
+    }
+}
+
+// Several cells per pixel
+static void _m_renderShrunkThumbnail(Thumbnail *thumbnail, const Grid *grid, const Robot *robot, int cellsPerPixel) {
+    thumbnail->width = (grid->width + cellsPerPixel - 1) / cellsPerPixel;
+    thumbnail->height = (grid->height + cellsPerPixel - 1) / cellsPerPixel;
+    thumbnail->pixels = (unsigned char *)malloc((size_t)thumbnail->width * thumbnail->height);
+    memset(thumbnail->pixels, THUMBNAIL_BACKGROUND, (size_t)thumbnail->width * thumbnail->height);
+
+    GridCellIterator it = makeGridCellIterator();
+    int x, y;
+    CellType type;
+    while (nextGridMarkedCell(grid, &it, &x, &y, &type)) {
+        unsigned char *pixel = &thumbnail->pixels[(size_t)(y / cellsPerPixel) * thumbnail->width + x / cellsPerPixel];
+        if (type == GRID_CELL_FILLED)
+            *pixel = THUMBNAIL_FILLED;
+        else if (*pixel == THUMBNAIL_BACKGROUND)
+            *pixel = THUMBNAIL_WALL;
+    }
+    _m_fillThumbnailRect(thumbnail, robot->posX / cellsPerPixel - 1, robot->posY / cellsPerPixel - 1, 3, 3, THUMBNAIL_ROBOT);
+}
+
+void renderThumbnail(Thumbnail *thumbnail, const Grid *grid, const Robot *robot, int cellSize) {
+    if (cellSize < 1) cellSize = 1;
+    if (cellSize > THUMBNAIL_MAX_CELL_SIZE) cellSize = THUMBNAIL_MAX_CELL_SIZE;
+    int side = grid->width > grid->height ? grid->width : grid->height;
+    if ((long long)side * cellSize > THUMBNAIL_MAX_SIDE)
+        cellSize = THUMBNAIL_MAX_SIDE / side;
+    if (cellSize == 0) {
+        _m_renderShrunkThumbnail(thumbnail, grid, robot, (side + THUMBNAIL_MAX_SIDE - 1) / THUMBNAIL_MAX_SIDE);
+        return;
+    }
+
+    // Lines lie on the cell borders, so the image is one line wider than
+    // the cells and the cells start half a line in
+    int lineWidth = cellSize >= 24 ? 2 : cellSize >= 8 ? 1 : 0;
+    int origin = lineWidth / 2;
+    thumbnail->width = grid->width * cellSize + lineWidth;
+    thumbnail->height = grid->height * cellSize + lineWidth;
+    thumbnail->pixels = (unsigned char *)malloc((size_t)thumbnail->width * thumbnail->height);
+    memset(thumbnail->pixels, THUMBNAIL_BACKGROUND, (size_t)thumbnail->width * thumbnail->height);
+
+    GridCellIterator it = makeGridCellIterator();
+    int x, y;
+    CellType type;
+    while (nextGridMarkedCell(grid, &it, &x, &y, &type)) {
+        _m_fillThumbnailRect(thumbnail, origin + x * cellSize, origin + y * cellSize, cellSize, cellSize,
+                             type == GRID_CELL_FILLED ? THUMBNAIL_FILLED : THUMBNAIL_WALL);
+    }
+
+    if (lineWidth > 0) {
+        for (int row = 0; row <= grid->height; row++)
+            _m_fillThumbnailRect(thumbnail, 0, origin + row * cellSize - lineWidth / 2, thumbnail->width, lineWidth, THUMBNAIL_GRID);
+        for (int column = 0; column <= grid->width; column++)
+            _m_fillThumbnailRect(thumbnail, origin + column * cellSize - lineWidth / 2, 0, lineWidth, thumbnail->height, THUMBNAIL_GRID);
+    }
+
+    // The sizes of the window's robot, relative to its largest cells
+    float centerX = origin + (robot->posX + 0.5f) * cellSize;
+    float centerY = origin + (robot->posY + 0.5f) * cellSize;
+    float scale = (float)cellSize / THUMBNAIL_MAX_CELL_SIZE;
+    if (15 * scale < 1.5f) {
+        _m_fillThumbnailRect(thumbnail, origin + robot->posX * cellSize, origin + robot->posY * cellSize, cellSize, cellSize, THUMBNAIL_ROBOT);
+        return;
+    }
+    _m_fillThumbnailCircle(thumbnail, centerX, centerY, 15 * scale, THUMBNAIL_ROBOT);
+    _m_fillThumbnailCircle(thumbnail, centerX, centerY, 10 * scale, THUMBNAIL_ROBOT_INNER);
+}
+
+void freeThumbnail(Thumbnail *thumbnail) {
+    free(thumbnail->pixels);
+    thumbnail->pixels = NULL;
+}
+
+unsigned char *encodeThumbnail(const Thumbnail *thumbnail, size_t *size) {
+    return encodePng(thumbnail->pixels, thumbnail->width, thumbnail->height, m_thumbnailPalette, THUMBNAIL_COLOR_COUNT, size);
+}
+
+int saveThumbnail(const Thumbnail *thumbnail, const char *filename) {
+    return writePng(filename, thumbnail->pixels, thumbnail->width, thumbnail->height, m_thumbnailPalette, THUMBNAIL_COLOR_COUNT);
+}
@@ -0,0 +1,47 @@
+#include "robot.h"
+
+#ifndef KUMIR_THUMBNAIL_H
+#define KUMIR_THUMBNAIL_H
+
+
+// Pictures of a field for reports, in the colors of the window but drawn
+// on the CPU: no window, GPU or raylib is needed, and any number of
+// thumbnails can be drawn at once on different threads
+typedef enum {
+    THUMBNAIL_BACKGROUND,
+    THUMBNAIL_FILLED,
+    THUMBNAIL_WALL,
+    THUMBNAIL_GRID,
+    THUMBNAIL_ROBOT,
+    THUMBNAIL_ROBOT_INNER,
+    THUMBNAIL_COLOR_COUNT
+} ThumbnailColor;
+
+// One ThumbnailColor per pixel, row by row
+typedef struct Thumbnail {
+    int width;
+    int height;
+    unsigned char *pixels;
+} Thumbnail;
+
+#define THUMBNAIL_DEFAULT_CELL_SIZE 16
+#define THUMBNAIL_MAX_CELL_SIZE 50
+#define THUMBNAIL_MAX_SIDE 4096
+#define THUMBNAIL_EXTENSION "png"
+
+// cellSize pixels per cell, with grid lines once cells are big enough to
+// show them. A field that would come out wider or taller than
+// THUMBNAIL_MAX_SIDE gets smaller cells, down to several cells per pixel,
+// where a pixel with any paint in it shows paint. Only allocated tiles are
+// looked at, so the cost follows the image size and the marked cells
+void renderThumbnail(Thumbnail *thumbnail, const Grid *grid, const Robot *robot, int cellSize);
+
+void freeThumbnail(Thumbnail *thumbnail);
+
+// The PNG file in memory, to be freed by the caller
+unsigned char *encodeThumbnail(const Thumbnail *thumbnail, size_t *size);
+
+int saveThumbnail(const Thumbnail *thumbnail, const char *filename);
+
+
+#endif // !KUMIR_THUMBNAIL_H
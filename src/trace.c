@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+
+static void _m_writeVarint(FILE *file, unsigned long long value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+static unsigned long long _m_zigzag(long long value) {
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static long long _m_unzigzag(unsigned long long value) {
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+static void _m_writeEventByte(FILE *file, int kind, long long lineDelta) {
+    unsigned long long zigzag = _m_zigzag(lineDelta);
+    if (zigzag < TRACE_LINE_ESCAPE) {
+        fputc(kind | (int)(zigzag << TRACE_KIND_BITS), file);
+        return;
+    }
+    fputc(kind | (TRACE_LINE_ESCAPE << TRACE_KIND_BITS), file);
+    _m_writeVarint(file, zigzag);
+}
+
+static void _m_writeEvent(TraceRecorder *recorder, const TraceEvent *event) {
+    _m_writeEventByte(recorder->file, event->kind, event->lineDelta);
+    if (event->kind == TRACE_SETPOS) {
+        _m_writeVarint(recorder->file, _m_zigzag(event->x));
+        _m_writeVarint(recorder->file, _m_zigzag(event->y));
+    }
+}
+
+static void _m_writeControl(TraceRecorder *recorder, TraceControl control) {
+    fputc(TRACE_CONTROL | (control << TRACE_KIND_BITS), recorder->file);
+}
+
+int startTraceRecorder(TraceRecorder *recorder, const char *filename, const Grid *grid, int robotPosX, int robotPosY) {
+    *recorder = (TraceRecorder){
+        .line = 0,
+        .robotPosX = robotPosX,
+        .robotPosY = robotPosY
+    };
+    recorder->file = fopen(filename, "wb");
+    if (recorder->file == NULL)
+        return EXIT_FAILURE;
+
+    // The size of the grid is only known once it is written
+    TraceFileHeader header = { .version = TRACE_FILE_VERSION };
+    memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, recorder->file) != 1 ||
+        writeGrid(grid, recorder->file, robotPosX, robotPosY) == EXIT_FAILURE)
+        goto fail;
+    long end = ftell(recorder->file);
+    header.gridSize = end - (long)sizeof(header);
+    if (fseek(recorder->file, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, recorder->file) != 1 ||
+        fseek(recorder->file, end, SEEK_SET) != 0)
+        goto fail;
+    return EXIT_SUCCESS;
+
+fail:
+    fclose(recorder->file);
+    recorder->file = NULL;
+    return EXIT_FAILURE;
+}
+
+static bool _m_isSameEvent(const TraceEvent *a, const TraceEvent *b) {
+    return a->kind == b->kind && a->lineDelta == b->lineDelta &&
+           (a->kind != TRACE_SETPOS || (a->x == b->x && a->y == b->y));
+}
+
+// ago = 1 is the newest event
+static const TraceEvent *_m_getHistoryEvent(const TraceRecorder *recorder, size_t ago) {
+    return &recorder->history[(recorder->historyCount - ago) % (TRACE_MAX_PERIOD * 2)];
+}
+
+static void _m_flushPending(TraceRecorder *recorder) {
+    for (size_t i = 0; i < recorder->pendingCount; i++)
+        _m_writeEvent(recorder, &recorder->pending[i]);
+    recorder->pendingCount = 0;
+}
+
+// Writes the whole periods matched so far; the events of an unfinished
+// period go back to being literals
+static void _m_flushRepeat(TraceRecorder *recorder) {
+    size_t period = recorder->period;
+    size_t rest = recorder->matched % period;
+    _m_writeControl(recorder, TRACE_REPEAT);
+    _m_writeVarint(recorder->file, period);
+    _m_writeVarint(recorder->file, recorder->matched / period);
+    for (size_t ago = rest; ago > 0; ago--)
+        recorder->pending[recorder->pendingCount++] = *_m_getHistoryEvent(recorder, ago);
+    recorder->period = 0;
+    recorder->matched = 0;
+}
+
+static void _m_addEvent(TraceRecorder *recorder, const TraceEvent *event) {
+    recorder->events++;
+    if (recorder->period > 0) {
+        if (_m_isSameEvent(event, _m_getHistoryEvent(recorder, recorder->period))) {
+            recorder->history[recorder->historyCount++ % (TRACE_MAX_PERIOD * 2)] = *event;
+            recorder->matched++;
+            return;
+        }
+        _m_flushRepeat(recorder);
+    }
+
+    recorder->history[recorder->historyCount++ % (TRACE_MAX_PERIOD * 2)] = *event;
+    if (recorder->pendingCount == TRACE_MAX_PERIOD) {
+        _m_writeEvent(recorder, &recorder->pending[0]);
+        memmove(recorder->pending, recorder->pending + 1, (TRACE_MAX_PERIOD - 1) * sizeof(TraceEvent));
+        recorder->pendingCount--;
+    }
+    recorder->pending[recorder->pendingCount++] = *event;
+
+    // The newer copy of the period has to be unwritten to become a repeat
+    for (size_t period = 1; period <= recorder->pendingCount && 2 * period <= recorder->historyCount; period++) {
+        size_t i = 1;
+        while (i <= period && _m_isSameEvent(_m_getHistoryEvent(recorder, i), _m_getHistoryEvent(recorder, i + period)))
+            i++;
+        if (i <= period) continue;
+        recorder->pendingCount -= period;
+        _m_flushPending(recorder);
+        recorder->period = period;
+        recorder->matched = period;
+        return;
+    }
+}
+
+void recordTraceEvent(TraceRecorder *recorder, TraceEventKind kind, size_t line, int x, int y) {
+    TraceEvent event = {
+        .kind = kind,
+        .lineDelta = (long long)line - (long long)recorder->line,
+        .x = x,
+        .y = y
+    };
+    recorder->line = line;
+    _m_addEvent(recorder, &event);
+}
+
+int finishTraceRecorder(TraceRecorder *recorder, const RunResult *result) {
+    if (recorder->period > 0)
+        _m_flushRepeat(recorder);
+    _m_flushPending(recorder);
+    _m_writeControl(recorder, TRACE_END);
+    _m_writeVarint(recorder->file, result->code);
+    _m_writeVarint(recorder->file, result->line);
+    _m_writeVarint(recorder->file, result->steps);
+    bool failed = ferror(recorder->file);
+    if (fclose(recorder->file) != 0)
+        failed = true;
+    recorder->file = NULL;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// A step is told apart by what it changed: a finished step leaves
+// interpreter->steps one higher, кц and failing instructions leave it
+// as it was and are not recorded
+static InterpreterExitCode _m_stepRecorded(Interpreter *interpreter) {
+    if (interpreter->pc >= interpreter->program->size)
+        return stepInterpreter(interpreter);
+    const Instruction *instr = &interpreter->program->code[interpreter->pc];
+    Robot *robot = interpreter->robot;
+    int posX = robot->posX, posY = robot->posY;
+    uint64_t paintHash = interpreter->grid->paintHash;
+    size_t steps = interpreter->steps;
+
+    InterpreterExitCode code = stepInterpreter(interpreter);
+    if (interpreter->steps == steps)
+        return code;
+
+    TraceRecorder *recorder = interpreter->trace;
+    TraceEventKind kind = TRACE_TICK;
+    if (instr->op == OP_SETPOS) kind = TRACE_SETPOS;
+    else if (robot->posY < posY) kind = TRACE_MOVE_UP;
+    else if (robot->posY > posY) kind = TRACE_MOVE_DOWN;
+    else if (robot->posX < posX) kind = TRACE_MOVE_LEFT;
+    else if (robot->posX > posX) kind = TRACE_MOVE_RIGHT;
+    else if (interpreter->grid->paintHash != paintHash) kind = TRACE_PAINT;
+    recordTraceEvent(recorder, kind, instr->line, robot->posX - posX, robot->posY - posY);
+    return code;
+}
+
+void setInterpreterTrace(Interpreter *interpreter, TraceRecorder *recorder) {
+    interpreter->trace = recorder;
+    interpreter->step = recorder != NULL ? _m_stepRecorded : stepInterpreter;
+    if (recorder != NULL)
+        interpreter->stepFused = true;
+}
+
+static bool _m_readVarint(TraceReader *reader, unsigned long long *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->pos >= reader->size)
+            return false;
+        unsigned char byte = reader->data[reader->pos++];
+        *value |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+int openTraceReader(TraceReader *reader, const char *filename, Grid *grid, int *robotPosX, int *robotPosY) {
+    *reader = (TraceReader){ .finished = false, .damaged = false };
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        puts("Failed to open file");
+        return EXIT_FAILURE;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    reader->data = nmallocT(unsigned char, size > 0 ? size : 1);
+    reader->size = fread(reader->data, 1, size > 0 ? size : 0, file);
+    fclose(file);
+
+    TraceFileHeader header = { .version = 0 };
+    if (reader->size >= sizeof(header))
+        memcpy(&header, reader->data, sizeof(header));
+    if (memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic)) || header.version != TRACE_FILE_VERSION ||
+        header.gridSize > reader->size - sizeof(header)) {
+        puts("Invalid trace file");
+        closeTraceReader(reader);
+        return EXIT_FAILURE;
+    }
+    if (loadGridFromMemory(grid, reader->data + sizeof(header), header.gridSize, robotPosX, robotPosY) == EXIT_FAILURE) {
+        closeTraceReader(reader);
+        return EXIT_FAILURE;
+    }
+    reader->pos = sizeof(header) + header.gridSize;
+    return EXIT_SUCCESS;
+}
+
+// A damaged trace must not pass for a run that ended by itself, so it
+// ends with an error rather than with any code a program can reach
+static bool _m_finishTrace(TraceReader *reader, bool valid) {
+    reader->finished = true;
+    if (!valid)
+        markTraceDamaged(reader);
+    return false;
+}
+
+void markTraceDamaged(TraceReader *reader) {
+    reader->finished = true;
+    reader->damaged = true;
+    reader->result = (RunResult){ .code = INTERPRETER_ERROR, .line = reader->line };
+}
+
+bool nextTraceEvent(TraceReader *reader, TraceEvent *event, size_t *line) {
+    while (!reader->finished) {
+        if (reader->repeatLeft > 0) {
+            *event = reader->history[(reader->historyCount - reader->period) % TRACE_MAX_PERIOD];
+            reader->repeatLeft--;
+        } else {
+            if (reader->pos >= reader->size)
+                return _m_finishTrace(reader, false);
+            unsigned char byte = reader->data[reader->pos++];
+            unsigned long long value = byte >> TRACE_KIND_BITS;
+            TraceEventKind kind = byte & ((1 << TRACE_KIND_BITS) - 1);
+
+            if (kind == TRACE_CONTROL) {
+                unsigned long long a, b, c;
+                if (value == TRACE_END) {
+                    if (!_m_readVarint(reader, &a) || !_m_readVarint(reader, &b) || !_m_readVarint(reader, &c) ||
+                        a > INTERPRETER_INFINITE_LOOP)
+                        return _m_finishTrace(reader, false);
+                    reader->result = (RunResult){ .code = (InterpreterExitCode)a, .line = b, .steps = c };
+                    return _m_finishTrace(reader, true);
+                }
+                if (value != TRACE_REPEAT || !_m_readVarint(reader, &a) || !_m_readVarint(reader, &b) ||
+                    a == 0 || a > TRACE_MAX_PERIOD || a > reader->historyCount)
+                    return _m_finishTrace(reader, false);
+                reader->period = a;
+                reader->repeatLeft = a * b;
+                continue;
+            }
+
+            if (value == TRACE_LINE_ESCAPE && !_m_readVarint(reader, &value))
+                return _m_finishTrace(reader, false);
+            *event = (TraceEvent){ .kind = kind, .lineDelta = _m_unzigzag(value) };
+            if (kind == TRACE_SETPOS) {
+                unsigned long long x, y;
+                if (!_m_readVarint(reader, &x) || !_m_readVarint(reader, &y))
+                    return _m_finishTrace(reader, false);
+                event->x = (int)_m_unzigzag(x);
+                event->y = (int)_m_unzigzag(y);
+            }
+        }
+        reader->history[reader->historyCount++ % TRACE_MAX_PERIOD] = *event;
+        reader->line += event->lineDelta;
+        *line = reader->line;
+        return true;
+    }
+    return false;
+}
+
+void closeTraceReader(TraceReader *reader) {
+    free(reader->data);
+    reader->data = NULL;
+    reader->size = 0;
+}
@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "interpreter.h"
+
+#ifndef KUMIR_TRACE_H
+#define KUMIR_TRACE_H
+
+
+// A trace is everything needed to replay a run without the program: the
+// grid as it was at the start, one event per step and the result. The
+// file is a TraceFileHeader, the grid in the grid file format, then the
+// events. Each event is one byte, the TraceEventKind in the low three
+// bits and the zigzag-encoded change of the source line in the high five
+// (TRACE_LINE_ESCAPE: a varint follows). TRACE_SETPOS carries the target
+// cell as two zigzag varints relative to the robot. A TRACE_REPEAT event
+// repeats the last `period` events `count` times, so loops cost a few
+// bytes whatever the number of iterations, and TRACE_END carries the
+// exit code, line and step count
+#define TRACE_FILE_MAGIC "KUMT"
+#define TRACE_FILE_VERSION 1
+#define TRACE_EXTENSION "kum_trace"
+
+typedef struct TraceFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t gridSize;
+} TraceFileHeader;
+
+// The moves share their values with Direction
+typedef enum {
+    TRACE_MOVE_UP,
+    TRACE_MOVE_DOWN,
+    TRACE_MOVE_LEFT,
+    TRACE_MOVE_RIGHT,
+    TRACE_PAINT,     // закрасить on the robot's cell
+    TRACE_TICK,      // a step that changes nothing visible (если, нц, прервать)
+    TRACE_SETPOS,
+    TRACE_CONTROL    // the line bits hold a TraceControl instead
+} TraceEventKind;
+
+typedef enum {
+    TRACE_REPEAT,
+    TRACE_END
+} TraceControl;
+
+#define TRACE_KIND_BITS 3
+#define TRACE_LINE_ESCAPE 31
+#define TRACE_MAX_PERIOD 8
+
+typedef struct TraceEvent {
+    TraceEventKind kind;
+    long long lineDelta;
+    int x;  // TRACE_SETPOS: the move relative to the robot
+    int y;
+} TraceEvent;
+
+// Repeats are found online: the last few events are held back, and once
+// the newest `period` of them equal the `period` before they turn into a
+// repeat that grows as long as the run keeps matching
+typedef struct TraceRecorder {
+    FILE *file;
+    size_t line;
+    int robotPosX;
+    int robotPosY;
+    TraceEvent history[TRACE_MAX_PERIOD * 2];
+    size_t historyCount;
+    TraceEvent pending[TRACE_MAX_PERIOD];
+    size_t pendingCount;
+    size_t period;
+    size_t matched;
+    size_t events;
+} TraceRecorder;
+
+// Writes the header and the grid the run starts on
+int startTraceRecorder(TraceRecorder *recorder, const char *filename, const Grid *grid, int robotPosX, int robotPosY);
+
+void recordTraceEvent(TraceRecorder *recorder, TraceEventKind kind, size_t line, int x, int y);
+
+// Writes the result and closes the file
+int finishTraceRecorder(TraceRecorder *recorder, const RunResult *result);
+
+// Records every step of the run. Like profiling, tracing steps through
+// fused instructions one source instruction at a time
+void setInterpreterTrace(Interpreter *interpreter, TraceRecorder *recorder);
+
+typedef struct TraceReader {
+    unsigned char *data;
+    size_t size;
+    size_t pos;
+    size_t line;
+    TraceEvent history[TRACE_MAX_PERIOD];
+    size_t historyCount;
+    size_t period;
+    size_t repeatLeft;  // events still to replay from history
+    bool finished;
+    bool damaged;  // the trace broke off or held an impossible event
+    RunResult result;
+} TraceReader;
+
+// Loads the whole trace and the grid and robot it starts with
+int openTraceReader(TraceReader *reader, const char *filename, Grid *grid, int *robotPosX, int *robotPosY);
+
+// The next step and its source line; false once the trace has ended,
+// with reader->result holding the result of the run. A damaged trace
+// ends with INTERPRETER_ERROR at the last line it got to
+bool nextTraceEvent(TraceReader *reader, TraceEvent *event, size_t *line);
+
+// For an event the reader can't judge by itself, such as a move into a
+// wall: the trace ends there as damaged
+void markTraceDamaged(TraceReader *reader);
+
+void closeTraceReader(TraceReader *reader);
+
+
+#endif // !KUMIR_TRACE_H
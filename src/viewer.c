@@ -0,0 +1,375 @@
+#include <raylib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+#include "render.h"
+#include "trace.h"
+#include "viewer.h"
+
+
+#define SECONDS_PER_STEP_DEFAULT 0.05
+#define VIEWER_FRAME_BUDGET 0.012
+#define VIEWER_CLOCK_INTERVAL 256
+#define VIEWER_SEEK_JUMP 1000
+#define VIEWER_BAR_HEIGHT 12
+#define VIEWER_STATUS_SIZE 20
+
+int runProgram(int argc, const char **argv) {
+    if (argc == 1) {
+        puts("No filename found");
+        return -1;
+    } else if (argc == 2) {
+        puts("No grid data filename found");
+        return -1;
+    }
+    if (!isProgramFile(argv[1])) return EXIT_FAILURE;
+
+    Program program;
+    size_t currentLine;
+    InterpreterExitCode interpreterCode = compileProgram(argv[1], &program, &currentLine);
+    if (interpreterCode == INTERPRETER_ERROR) {
+        puts("Failed to open file");
+        return EXIT_FAILURE;
+    }
+    if (interpreterCode != INTERPRETER_NORMAL) {
+        printErrcode(interpreterCode, currentLine);
+        return EXIT_FAILURE;
+    }
+
+    Grid grid = makeGrid();
+    Robot robot = makeRobot();
+
+    if (loadGridFromFile(&grid, argv[2], &robot.posX, &robot.posY) == EXIT_FAILURE) return EXIT_FAILURE;
+
+    float secondsPerLineCycle;
+    bool isInstant = false;
+    if (argc == 3)
+        secondsPerLineCycle = SECONDS_PER_STEP_DEFAULT;
+    else {
+        secondsPerLineCycle = atof(argv[3]);
+        if (secondsPerLineCycle > 0.f)
+            secondsPerLineCycle = 1.f / secondsPerLineCycle;
+        else
+            isInstant = true;
+    }
+
+    // Steps run one source instruction at a time so that every one of
+    // them is drawn; instant runs and seeks go through the history, which
+    // runs the fused instructions
+    Interpreter interpreter;
+    initInterpreter(&interpreter, &program, &robot, &grid);
+    interpreter.stepFused = true;
+    RunHistory history;
+    initRunHistory(&history, &interpreter);
+    GridView view = makeGridView(&grid);
+    RobotStyle style = makeRobotStyle();
+    fitGridCellSize(&view, &grid, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    float secondsSinceLineCycle = 0;
+    bool paused = false;
+    bool fastForward = isInstant;
+    bool reported = false;
+    char status[64];
+
+    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Kumar");
+
+    while (!WindowShouldClose()) {
+        // Space pauses, the arrows step back and forth by one step or by
+        // VIEWER_SEEK_JUMP, Home goes to the start, End runs to the end
+        // and a click on the bar seeks to any step reached so far
+        size_t seekTarget = interpreter.steps;
+        bool seeking = false;
+        if (IsKeyPressed(KEY_SPACE)) {
+            paused = !paused || fastForward;
+            fastForward = !paused && isInstant;
+        }
+        if (IsKeyPressed(KEY_END)) fastForward = true;
+        if (IsKeyPressed(KEY_HOME)) {
+            seekTarget = 0;
+            seeking = true;
+        }
+        if (IsKeyPressed(KEY_LEFT) || IsKeyPressedRepeat(KEY_LEFT)) {
+            seekTarget = seekTarget > 0 ? seekTarget - 1 : 0;
+            seeking = true;
+        }
+        if (IsKeyPressed(KEY_RIGHT) || IsKeyPressedRepeat(KEY_RIGHT)) {
+            seekTarget++;
+            seeking = true;
+        }
+        if (IsKeyPressed(KEY_DOWN) || IsKeyPressedRepeat(KEY_DOWN)) {
+            seekTarget = seekTarget > VIEWER_SEEK_JUMP ? seekTarget - VIEWER_SEEK_JUMP : 0;
+            seeking = true;
+        }
+        if (IsKeyPressed(KEY_UP) || IsKeyPressedRepeat(KEY_UP)) {
+            seekTarget += VIEWER_SEEK_JUMP;
+            seeking = true;
+        }
+        Vector2 mousePos = GetMousePosition();
+        if (IsMouseButtonDown(MOUSE_BUTTON_LEFT) && mousePos.y >= SCREEN_HEIGHT - VIEWER_BAR_HEIGHT) {
+            float position = mousePos.x / SCREEN_WIDTH;
+            if (position < 0.f) position = 0.f;
+            if (position > 1.f) position = 1.f;
+            seekTarget = (size_t)(position * history.furthestSteps + 0.5f);
+            seeking = true;
+        }
+        if (seeking) {
+            paused = true;
+            fastForward = false;
+            seekRunHistory(&history, seekTarget);
+        }
+
+        // Every step that is due by now runs in this frame, but for no
+        // longer than VIEWER_FRAME_BUDGET so the window keeps redrawing;
+        // a backlog beyond that is dropped rather than carried over
+        bool atEnd = history.finished && interpreter.steps == history.result.steps;
+        if (fastForward && !atEnd) {
+            double frameStart = getTimeSeconds();
+            while (!history.finished && getTimeSeconds() - frameStart < VIEWER_FRAME_BUDGET)
+                seekRunHistory(&history, interpreter.steps + history.interval);
+            if (history.finished)
+                seekRunHistory(&history, history.result.steps);
+        } else if (!paused && !atEnd) {
+            secondsSinceLineCycle += GetFrameTime();
+            double frameStart = getTimeSeconds();
+            for (size_t count = 1; secondsSinceLineCycle >= secondsPerLineCycle; count++) {
+                InterpreterExitCode code = stepRunHistory(&history);
+                if (code != INTERPRETER_NORMAL && code != INTERPRETER_SKIP_LINE)
+                    break;
+                // кц only jumps back and does not take a step of its own
+                if (code != INTERPRETER_SKIP_LINE)
+                    secondsSinceLineCycle -= secondsPerLineCycle;
+                if (count % VIEWER_CLOCK_INTERVAL == 0 && getTimeSeconds() - frameStart > VIEWER_FRAME_BUDGET) {
+                    secondsSinceLineCycle = 0;
+                    break;
+                }
+            }
+        }
+        atEnd = history.finished && interpreter.steps == history.result.steps;
+        if (atEnd) {
+            fastForward = false;
+            if (!reported)
+                printErrcode(history.result.code, history.result.line);
+            reported = true;
+        }
+
+        view.viewX = robot.posX;
+        view.viewY = robot.posY;
+        snprintf(status, sizeof(status), "step %zu / %zu%s", interpreter.steps, history.furthestSteps,
+                 paused && !atEnd ? "  (paused)" : "");
+        float progress = history.furthestSteps > 0 ? (float)interpreter.steps / history.furthestSteps : 1.f;
+
+        BeginDrawing();
+            ClearBackground(BLACK);
+            drawGrid(&view, &grid, SCREEN_WIDTH, SCREEN_HEIGHT);
+            drawRobot(&style, &robot, &view, &grid, SCREEN_WIDTH, SCREEN_HEIGHT);
+            DrawRectangle(0, SCREEN_HEIGHT - VIEWER_BAR_HEIGHT, SCREEN_WIDTH, VIEWER_BAR_HEIGHT, DARKGRAY);
+            DrawRectangle(0, SCREEN_HEIGHT - VIEWER_BAR_HEIGHT, (int)(progress * SCREEN_WIDTH), VIEWER_BAR_HEIGHT, LIGHTGRAY);
+            DrawText(status, 10, 10, VIEWER_STATUS_SIZE, RED);
+        EndDrawing();
+    }
+
+    CloseWindow();
+
+    freeRunHistory(&history);
+    freeInterpreter(&interpreter);
+    freeProgram(&program);
+    freeGrid(&grid);
+    return EXIT_SUCCESS;
+}
+
+static void _m_printTraceEnd(const TraceReader *reader, size_t steps) {
+    if (reader->damaged)
+        printf("\033[31mThe trace is damaged after line %zu, step %zu\033[0m\n", reader->result.line, steps);
+    else
+        printErrcode(reader->result.code, reader->result.line);
+}
+
+// Plays a trace back on its own starting grid; the speed works as in
+// runProgram, and the line of the last step is shown in the corner
+int runReplay(int argc, const char **argv) {
+    if (argc == 1) {
+        puts("No trace filename found");
+        return EXIT_FAILURE;
+    }
+    Grid grid = makeGrid();
+    Robot robot = makeRobot();
+    TraceReader reader;
+    if (openTraceReader(&reader, argv[1], &grid, &robot.posX, &robot.posY) == EXIT_FAILURE) return EXIT_FAILURE;
+
+    float secondsPerStep = SECONDS_PER_STEP_DEFAULT;
+    bool isInstant = false;
+    if (argc >= 3) {
+        secondsPerStep = atof(argv[2]);
+        if (secondsPerStep > 0.f)
+            secondsPerStep = 1.f / secondsPerStep;
+        else
+            isInstant = true;
+    }
+
+    GridView view = makeGridView(&grid);
+    RobotStyle style = makeRobotStyle();
+    fitGridCellSize(&view, &grid, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    float secondsSinceStep = 0;
+    size_t line = 0, steps = 0;
+    char status[64];
+
+    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Kumar (replay)");
+
+    while (!WindowShouldClose()) {
+        if (!reader.finished) {
+            if (!isInstant)
+                secondsSinceStep += GetFrameTime();
+            double frameStart = getTimeSeconds();
+            TraceEvent event;
+            for (size_t count = 1; isInstant || secondsSinceStep >= secondsPerStep; count++) {
+                if (!nextTraceEvent(&reader, &event, &line)) {
+                    _m_printTraceEnd(&reader, steps);
+                    line = reader.result.line;
+                    break;
+                }
+                // A trace of a real run never leaves the field or walks
+                // into a wall
+                int posX = robot.posX, posY = robot.posY;
+                if (event.kind <= TRACE_MOVE_RIGHT) {
+                    posX += m_directionX[event.kind];
+                    posY += m_directionY[event.kind];
+                } else if (event.kind == TRACE_SETPOS) {
+                    posX += event.x;
+                    posY += event.y;
+                }
+                if (isGridCellWall(&grid, posX, posY)) {
+                    markTraceDamaged(&reader);
+                    _m_printTraceEnd(&reader, steps);
+                    break;
+                }
+                robot.posX = posX;
+                robot.posY = posY;
+                if (event.kind == TRACE_PAINT)
+                    flipGridColor(&grid, robot.posX, robot.posY);
+                steps++;
+                secondsSinceStep -= secondsPerStep;
+                if (count % VIEWER_CLOCK_INTERVAL == 0 && getTimeSeconds() - frameStart > VIEWER_FRAME_BUDGET) {
+                    secondsSinceStep = 0;
+                    break;
+                }
+            }
+        }
+
+        view.viewX = robot.posX;
+        view.viewY = robot.posY;
+        snprintf(status, sizeof(status), "line %zu  step %zu%s", line, steps, reader.damaged ? "  trace damaged" : "");
+
+        BeginDrawing();
+            ClearBackground(BLACK);
+            drawGrid(&view, &grid, SCREEN_WIDTH, SCREEN_HEIGHT);
+            drawRobot(&style, &robot, &view, &grid, SCREEN_WIDTH, SCREEN_HEIGHT);
+            DrawText(status, 10, 10, VIEWER_STATUS_SIZE, RED);
+        EndDrawing();
+    }
+
+    CloseWindow();
+
+    closeTraceReader(&reader);
+    freeGrid(&grid);
+    return EXIT_SUCCESS;
+}
+
+#define ROBOT_HOLD_SCALE_FACTOR 1.2f
+#define ROBOT_HOLD_ALPHA 200
+
+int runGridEditor(int argc, const char **argv) {
+    if (argc == 1) {
+        puts("No filename found");
+        return EXIT_FAILURE;
+    }
+    char *filename = strdup(argv[1]);
+    char *fileExt = getFileExt(filename);
+    if (fileExt[0] == '\0' || !streq(fileExt, GRID_EXTENSION)) {
+        puts("Incorrect file extension. Expected \"*." GRID_EXTENSION "\"");
+        return EXIT_FAILURE;
+    }
+
+    Grid grid = makeGrid();
+    Robot robot = makeRobot();
+
+    if (fileExists(filename)) {
+        if (loadGridFromFile(&grid, filename, &robot.posX, &robot.posY) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+    } else {
+        if (argc >= 4) {
+            grid.width = atoi(argv[2]);
+            grid.height = atoi(argv[3]);
+        }
+        if (grid.width <= 0 || grid.width > GRID_MAX_SIZE || grid.height <= 0 || grid.height > GRID_MAX_SIZE) {
+            puts("Invalid grid size");
+            return EXIT_FAILURE;
+        }
+        generateGridData(&grid);
+    }
+    GridView view = makeGridView(&grid);
+    RobotStyle style = makeRobotStyle();
+    fitGridCellSize(&view, &grid, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    int selectedX, selectedY;
+    bool holdingRobot = false;
+
+    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Kumar (grid editor)");
+
+    while (!WindowShouldClose()) {
+        if (IsKeyDown(KEY_UP) && view.viewY > 0) view.viewY--;
+        if (IsKeyDown(KEY_DOWN) && view.viewY < grid.height - 1) view.viewY++;
+        if (IsKeyDown(KEY_LEFT) && view.viewX > 0) view.viewX--;
+        if (IsKeyDown(KEY_RIGHT) && view.viewX < grid.width - 1) view.viewX++;
+
+        getGridMousePos(&view, &grid, &selectedX, &selectedY, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+        if (selectedX != robot.posX || selectedY != robot.posY) {
+            if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+                if (selectedX != -1) {
+                    if (getGridCell(&grid, selectedX, selectedY) != GRID_CELL_WALL)
+                        setGridCell(&grid, selectedX, selectedY, GRID_CELL_WALL);
+                    else
+                        setGridCell(&grid, selectedX, selectedY, GRID_CELL_EMPTY);
+                }
+            } else if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT)) {
+                if (selectedX != -1) {
+                    if (getGridCell(&grid, selectedX, selectedY) != GRID_CELL_FILLED)
+                        setGridCell(&grid, selectedX, selectedY, GRID_CELL_FILLED);
+                    else
+                        setGridCell(&grid, selectedX, selectedY, GRID_CELL_EMPTY);
+                }
+            }
+        } else if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+            if (!holdingRobot) {
+                style.color.a = ROBOT_HOLD_ALPHA;
+                style.innerColor.a = ROBOT_HOLD_ALPHA;
+                style.innerSize *= ROBOT_HOLD_SCALE_FACTOR;
+                style.size *= ROBOT_HOLD_SCALE_FACTOR;
+            }
+            holdingRobot = true;
+        } if (holdingRobot) {
+            robotSetPos(&robot, &grid, selectedX, selectedY);
+            if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
+                holdingRobot = false;
+                style.color.a = 255;
+                style.innerColor.a = 255;
+                style.innerSize /= ROBOT_HOLD_SCALE_FACTOR;
+                style.size /= ROBOT_HOLD_SCALE_FACTOR;
+            }
+        }
+
+        BeginDrawing();
+            ClearBackground(BLACK);
+            drawGrid(&view, &grid, SCREEN_WIDTH, SCREEN_HEIGHT);
+            drawRobot(&style, &robot, &view, &grid, SCREEN_WIDTH, SCREEN_HEIGHT);
+        EndDrawing();
+    }
+
+    CloseWindow();
+    dumpGrid(&grid, filename, robot.posX, robot.posY);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,23 @@
+#include "interpreter.h"
+
+#ifndef KUMIR_VIEWER_H
+#define KUMIR_VIEWER_H
+
+
+// The raylib windows: the program viewer and the grid editor. They are
+// only built with KUMAR_GUI, everything else runs without a display
+#define SCREEN_WIDTH 800
+#define SCREEN_HEIGHT 800
+
+// kumar run <file> <grid file> [steps per second]. The run can be paused,
+// stepped back and forth and sought to any step it has reached
+int runProgram(int argc, const char **argv);
+
+// kumar grid <grid file> [width height]
+int runGridEditor(int argc, const char **argv);
+
+// kumar replay <trace file> [steps per second]
+int runReplay(int argc, const char **argv);
+
+
+#endif // !KUMIR_VIEWER_H
@@ -0,0 +1,121 @@
+#include <stdint.h>
+
+#include "cache.h"
+#include "test.h"
+
+// Cache entries are files anyone can edit, so every damaged entry has to
+// be a miss that leaves the robot and the grid alone
+#define CACHE_TEST_DIR "cache_test_entries"
+
+typedef struct CacheTestEntry {
+    CacheFileHeader header;
+    int32_t cells[2][2];
+} CacheTestEntry;
+
+Program m_cacheProgram;
+Grid m_cacheGrid;
+CacheKey m_cacheKey;
+char m_cachePath[256];
+
+bool loadTestEntry(Robot *robot, Grid *grid, RunResult *result) {
+    *robot = (Robot){ .posX = 0, .posY = 0 };
+    copyGrid(grid, &m_cacheGrid);
+    return loadCachedRun(CACHE_TEST_DIR, &m_cacheKey, &m_cacheProgram, robot, grid, result);
+}
+
+// Writes a changed copy of the good entry, size bytes of it, and expects
+// it to miss without touching anything
+void expectMiss(const CacheTestEntry *entry, size_t size) {
+    writeTestFile(m_cachePath, entry, size);
+    Robot robot;
+    Grid grid;
+    RunResult result = { .code = INTERPRETER_NORMAL };
+    EXPECT(!loadTestEntry(&robot, &grid, &result));
+    EXPECT(robot.posX == 0 && robot.posY == 0);
+    EXPECT(result.code == INTERPRETER_NORMAL);
+    EXPECT(countGridCells(&grid, GRID_CELL_FILLED) == 0);
+    EXPECT(getGridCell(&grid, 3, 3) == GRID_CELL_WALL);
+    freeGrid(&grid);
+}
+
+int main() {
+    size_t lineNum;
+    EXPECT(compileProgramSource("закрасить\nвправо\nзакрасить\n", LANG_RU, &m_cacheProgram, &lineNum) == INTERPRETER_NORMAL);
+    m_cacheGrid = makeGrid();
+    m_cacheGrid.width = 5;
+    m_cacheGrid.height = 5;
+    generateGridData(&m_cacheGrid);
+    setGridCell(&m_cacheGrid, 3, 3, GRID_CELL_WALL);
+
+    InterpreterLimits limits = makeDefaultLimits();
+    CacheKey gridKey = makeGridCacheKey(&m_cacheGrid, 0, 0);
+    m_cacheKey = makeRunCacheKey(&m_cacheProgram, &gridKey, &limits);
+    snprintf(m_cachePath, sizeof(m_cachePath), "%s/%016llx%016llx." CACHE_FILE_EXTENSION, CACHE_TEST_DIR,
+             (unsigned long long)m_cacheKey.hash[0], (unsigned long long)m_cacheKey.hash[1]);
+    remove(m_cachePath);
+
+    Robot robot = { .posX = 0, .posY = 0 };
+    Grid grid;
+    copyGrid(&grid, &m_cacheGrid);
+    Interpreter interpreter;
+    initInterpreter(&interpreter, &m_cacheProgram, &robot, &grid);
+    setInterpreterLimits(&interpreter, limits);
+    RunResult run = runInterpreter(&interpreter);
+    freeInterpreter(&interpreter);
+    EXPECT(run.code == INTERPRETER_FINISHED);
+
+    RunResult result;
+    Robot cachedRobot;
+    Grid cachedGrid;
+    EXPECT(!loadTestEntry(&cachedRobot, &cachedGrid, &result));
+    freeGrid(&cachedGrid);
+    storeCachedRun(CACHE_TEST_DIR, &m_cacheKey, &robot, &grid, &run);
+    EXPECT(loadTestEntry(&cachedRobot, &cachedGrid, &result));
+    EXPECT(result.code == run.code && result.line == run.line && result.steps == run.steps);
+    EXPECT(cachedRobot.posX == 1 && cachedRobot.posY == 0);
+    EXPECT(isGridPaintEqual(&cachedGrid, &grid));
+    freeGrid(&cachedGrid);
+    freeGrid(&grid);
+
+    CacheTestEntry good;
+    FILE *file = fopen(m_cachePath, "rb");
+    EXPECT(file != NULL && fread(&good, sizeof(good), 1, file) == 1);
+    if (file != NULL)
+        fclose(file);
+    EXPECT(good.header.paintedCount == 2);
+
+    CacheTestEntry entry = good;
+    expectMiss(&entry, sizeof(entry) - sizeof(int32_t));
+    expectMiss(&entry, sizeof(entry.header));
+    entry.header.paintedCount = 1000000000000ull;
+    expectMiss(&entry, sizeof(entry));
+    entry = good;
+    entry.header.paintedCount = 3;
+    expectMiss(&entry, sizeof(entry));
+    entry = good;
+    entry.cells[1][0] = 3;
+    entry.cells[1][1] = 3;
+    expectMiss(&entry, sizeof(entry));
+    entry = good;
+    entry.cells[0][0] = -1;
+    expectMiss(&entry, sizeof(entry));
+    entry = good;
+    entry.header.robotPosX = 1000;
+    entry.header.robotPosY = 1000;
+    expectMiss(&entry, sizeof(entry));
+    entry = good;
+    entry.header.robotPosX = 3;
+    entry.header.robotPosY = 3;
+    expectMiss(&entry, sizeof(entry));
+    entry = good;
+    entry.header.code = 1000;
+    expectMiss(&entry, sizeof(entry));
+    entry = good;
+    entry.header.code = INTERPRETER_TIMEOUT;
+    expectMiss(&entry, sizeof(entry));
+
+    remove(m_cachePath);
+    freeGrid(&m_cacheGrid);
+    freeProgram(&m_cacheProgram);
+    return finishTest();
+}
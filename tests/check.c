@@ -0,0 +1,285 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "interpreter.h"
+#include "profile.h"
+#include "sweep.h"
+
+// kumar_check [bench corpus dir] [check corpus dir] [cache dir]
+//
+// Runs the programs of both corpora from every start cell of grids
+// generated from fixed seeds and compares every other way of taking a
+// run against a plain run: a profiled run (which steps through fused
+// instructions one source instruction at a time), a run without the
+// loop check, a sweep of all starts and a run stored in and loaded back
+// from the cache. Each difference is printed on a line of its own and
+// fails the check
+#ifndef KUMAR_BENCH_CORPUS
+#define KUMAR_BENCH_CORPUS "bench/corpus"
+#endif
+#ifndef KUMAR_CHECK_CORPUS
+#define KUMAR_CHECK_CORPUS "tests/corpus"
+#endif
+#ifndef KUMAR_CHECK_CACHE
+#define KUMAR_CHECK_CACHE "kumar_check_cache"
+#endif
+
+// Only every this many starts go through the cache, one file each
+#define CHECK_CACHE_STRIDE 7
+
+typedef struct CheckGrid {
+    const char *name;
+    int width;
+    int height;
+    size_t wallCount;
+    size_t paintCount;  // cells painted before the run
+    uint64_t seed;
+    Grid grid;
+} CheckGrid;
+
+typedef struct CheckProgram {
+    const char *filename;
+    bool fromBench;  // in the bench corpus rather than the check corpus
+    Program program;
+} CheckProgram;
+
+// The final state of one run, which is all that check prints
+typedef struct CheckRun {
+    RunResult result;
+    int robotPosX;
+    int robotPosY;
+    Grid grid;
+} CheckRun;
+
+CheckGrid m_checkGrids[] = {
+    { .name = "small", .width = 15, .height = 15, .wallCount = 25, .paintCount = 10, .seed = 1 },
+    { .name = "rooms", .width = 40, .height = 25, .wallCount = 150, .paintCount = 40, .seed = 2 },
+    { .name = "open", .width = 24, .height = 24, .wallCount = 0, .paintCount = 0, .seed = 3 }
+};
+
+CheckProgram m_checkPrograms[] = {
+    { .filename = "straight.kum", .fromBench = true },
+    { .filename = "nested.kum", .fromBench = true },
+    { .filename = "scan.kum", .fromBench = true },
+    { .filename = "setpos.kum" },
+    { .filename = "strides.kum" },
+    { .filename = "cycles.kum" },
+    { .filename = "exit.kum" }
+};
+
+// Step limits small enough to cut runs short at many different points
+InterpreterLimits m_checkLimits[] = {
+    { .maxSteps = 10000, .detectLoops = true },
+    { .maxSteps = 37, .detectLoops = true },
+    { .maxSteps = 500, .detectLoops = false }
+};
+
+const char *m_checkCache = KUMAR_CHECK_CACHE;
+size_t m_checkCount = 0;
+size_t m_checkFailures = 0;
+
+#define countof(array) (sizeof(array) / sizeof((array)[0]))
+
+uint64_t checkRandom(uint64_t *state) {
+    *state += 0x9E3779B97F4A7C15ull;
+    uint64_t z = *state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void generateCheckGrid(CheckGrid *check) {
+    check->grid = makeGrid();
+    check->grid.width = check->width;
+    check->grid.height = check->height;
+    generateGridData(&check->grid);
+    uint64_t state = check->seed;
+    for (size_t i = 0; i < check->wallCount + check->paintCount; i++) {
+        int x = checkRandom(&state) % check->width;
+        int y = checkRandom(&state) % check->height;
+        setGridCell(&check->grid, x, y, i < check->wallCount ? GRID_CELL_WALL : GRID_CELL_FILLED);
+    }
+}
+
+CheckRun runCheckStart(const Program *program, const Grid *grid, int x, int y, InterpreterLimits limits, bool profiled) {
+    CheckRun run;
+    copyGrid(&run.grid, grid);
+    Robot robot = { .posX = x, .posY = y };
+    Profile profile;
+    Interpreter interpreter;
+    initInterpreter(&interpreter, program, &robot, &run.grid);
+    setInterpreterLimits(&interpreter, limits);
+    if (profiled) {
+        profile = makeProfile(program);
+        setInterpreterProfile(&interpreter, &profile);
+    }
+    run.result = runInterpreter(&interpreter);
+    freeInterpreter(&interpreter);
+    if (profiled)
+        freeProfile(&profile);
+    run.robotPosX = robot.posX;
+    run.robotPosY = robot.posY;
+    return run;
+}
+
+// A miss leaves run without a grid
+bool loadCheckRun(const CacheKey *key, const Program *program, const Grid *grid, int x, int y, CheckRun *run) {
+    copyGrid(&run->grid, grid);
+    Robot robot = { .posX = x, .posY = y };
+    if (!loadCachedRun(m_checkCache, key, program, &robot, &run->grid, &run->result)) {
+        freeGrid(&run->grid);
+        return false;
+    }
+    run->robotPosX = robot.posX;
+    run->robotPosY = robot.posY;
+    return true;
+}
+
+bool isSameRun(const CheckRun *a, const CheckRun *b) {
+    return a->result.code == b->result.code && a->result.line == b->result.line && a->result.steps == b->result.steps &&
+           a->robotPosX == b->robotPosX && a->robotPosY == b->robotPosY && isGridPaintEqual(&a->grid, &b->grid);
+}
+
+void printCheckRun(const CheckRun *run) {
+    printf("%s line %zu, %zu steps, robot at %d %d, %zu painted", getErrcodeName(run->result.code), run->result.line,
+           run->result.steps, run->robotPosX, run->robotPosY, countGridCells(&run->grid, GRID_CELL_FILLED));
+}
+
+void reportMismatch(const CheckProgram *program, const CheckGrid *grid, size_t limits, int x, int y, const char *way,
+                    const CheckRun *expected, const CheckRun *actual) {
+    m_checkFailures++;
+    printf("%s on %s, limits %zu, start %d %d: plain run gives ", program->filename, grid->name, limits, x, y);
+    printCheckRun(expected);
+    printf(", %s gives ", way);
+    printCheckRun(actual);
+    putchar('\n');
+}
+
+void expectSameRun(const CheckProgram *program, const CheckGrid *grid, size_t limits, int x, int y, const char *way,
+                   const CheckRun *expected, const CheckRun *actual) {
+    m_checkCount++;
+    if (!isSameRun(expected, actual))
+        reportMismatch(program, grid, limits, x, y, way, expected, actual);
+}
+
+// Without the loop check a run that loops goes on to the step limit and
+// every other run ends the same
+void expectSameWithoutLoopCheck(const CheckProgram *program, const CheckGrid *grid, size_t limits, int x, int y,
+                                const CheckRun *expected, const CheckRun *actual) {
+    m_checkCount++;
+    bool same = expected->result.code == INTERPRETER_INFINITE_LOOP ? actual->result.code == INTERPRETER_STEP_LIMIT
+                                                                   : isSameRun(expected, actual);
+    if (!same)
+        reportMismatch(program, grid, limits, x, y, "no loop check", expected, actual);
+}
+
+void checkCachedRun(const CheckProgram *program, const CheckGrid *grid, size_t limits, int x, int y, const CheckRun *plain) {
+    CacheKey gridKey = makeGridCacheKey(&grid->grid, x, y);
+    CacheKey key = makeRunCacheKey(&program->program, &gridKey, &m_checkLimits[limits]);
+    CheckRun cached;
+    if (!loadCheckRun(&key, &program->program, &grid->grid, x, y, &cached)) {
+        Robot robot = { .posX = plain->robotPosX, .posY = plain->robotPosY };
+        storeCachedRun(m_checkCache, &key, &robot, &plain->grid, &plain->result);
+        if (!loadCheckRun(&key, &program->program, &grid->grid, x, y, &cached)) {
+            m_checkCount++;
+            m_checkFailures++;
+            printf("%s on %s, limits %zu, start %d %d: stored run not found in the cache\n", program->filename, grid->name,
+                   limits, x, y);
+            return;
+        }
+    }
+    expectSameRun(program, grid, limits, x, y, "cache", plain, &cached);
+    freeGrid(&cached.grid);
+}
+
+void checkProgram(const CheckProgram *program, const CheckGrid *grid, size_t limits) {
+    InterpreterLimits plainLimits = m_checkLimits[limits];
+    InterpreterLimits noLoopLimits = plainLimits;
+    noLoopLimits.detectLoops = false;
+
+    Sweep sweep;
+    if (sweepProgram(&sweep, &program->program, &grid->grid, NULL, plainLimits) == EXIT_FAILURE) {
+        m_checkFailures++;
+        printf("%s on %s, limits %zu: sweep failed\n", program->filename, grid->name, limits);
+        return;
+    }
+
+    size_t index = 0;
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            if (isGridCellWall(&grid->grid, x, y)) continue;
+            CheckRun plain = runCheckStart(&program->program, &grid->grid, x, y, plainLimits, false);
+
+            CheckRun profiled = runCheckStart(&program->program, &grid->grid, x, y, plainLimits, true);
+            expectSameRun(program, grid, limits, x, y, "profiled run", &plain, &profiled);
+            freeGrid(&profiled.grid);
+
+            if (plainLimits.detectLoops) {
+                CheckRun noLoops = runCheckStart(&program->program, &grid->grid, x, y, noLoopLimits, false);
+                expectSameWithoutLoopCheck(program, grid, limits, x, y, &plain, &noLoops);
+                freeGrid(&noLoops.grid);
+            }
+
+            const SweepResult *result = index < sweep.count ? &sweep.results[index++] : NULL;
+            if (result == NULL || result->startX != x || result->startY != y) {
+                m_checkCount++;
+                m_checkFailures++;
+                printf("%s on %s, limits %zu, start %d %d: not swept\n", program->filename, grid->name, limits, x, y);
+            } else {
+                CheckRun swept = { .result = result->run, .robotPosX = result->robotPosX, .robotPosY = result->robotPosY };
+                copyGrid(&swept.grid, &grid->grid);
+                applySweepPaint(result, &swept.grid);
+                expectSameRun(program, grid, limits, x, y, "sweep", &plain, &swept);
+                freeGrid(&swept.grid);
+            }
+
+            if ((y * grid->width + x) % CHECK_CACHE_STRIDE == 0)
+                checkCachedRun(program, grid, limits, x, y, &plain);
+            freeGrid(&plain.grid);
+        }
+    }
+    freeSweep(&sweep);
+}
+
+int main(int argc, const char **argv) {
+    const char *benchCorpus = argc > 1 ? argv[1] : KUMAR_BENCH_CORPUS;
+    const char *checkCorpus = argc > 2 ? argv[2] : KUMAR_CHECK_CORPUS;
+    if (argc > 3)
+        m_checkCache = argv[3];
+
+    for (size_t i = 0; i < countof(m_checkPrograms); i++) {
+        CheckProgram *check = &m_checkPrograms[i];
+        const char *dir = check->fromBench ? benchCorpus : checkCorpus;
+        size_t pathLength = strlen(dir) + strlen(check->filename) + 2;
+        char *path = nmallocT(char, pathLength);
+        snprintf(path, pathLength, "%s/%s", dir, check->filename);
+        size_t lineNum;
+        InterpreterExitCode code = compileProgramFile(path, LANG_RU, &check->program, &lineNum);
+        if (code != INTERPRETER_NORMAL) {
+            printf("%s: ", path);
+            printErrcode(code, lineNum);
+            free(path);
+            return EXIT_FAILURE;
+        }
+        free(path);
+    }
+    for (size_t i = 0; i < countof(m_checkGrids); i++)
+        generateCheckGrid(&m_checkGrids[i]);
+
+    for (size_t i = 0; i < countof(m_checkPrograms); i++) {
+        for (size_t j = 0; j < countof(m_checkGrids); j++) {
+            for (size_t k = 0; k < countof(m_checkLimits); k++)
+                checkProgram(&m_checkPrograms[i], &m_checkGrids[j], k);
+        }
+    }
+    printf("%zu comparisons, %zu mismatches\n", m_checkCount, m_checkFailures);
+
+    for (size_t i = 0; i < countof(m_checkPrograms); i++)
+        freeProgram(&m_checkPrograms[i].program);
+    for (size_t i = 0; i < countof(m_checkGrids); i++)
+        freeGrid(&m_checkGrids[i].grid);
+    return m_checkFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,144 @@
+#include "grade.h"
+#include "test.h"
+
+// Spec files, every verdict of verifyOutcome and the exact CSV and JSON
+// that kumar grade writes
+#define GRADE_TEST_SPEC "grade_test_spec.txt"
+
+const char *m_gradeSpecText =
+    "# поле        x y   клетки\n"
+    "a.kum_grid    2 0   0,0 1,0\n"
+    "\n"
+    "any.kum_grid  - -\n"
+    "far.kum_grid  - -   99,99\n"
+    "big.kum_grid  - -   1,1 150,150\n";
+
+Grid makeGradeTestGrid(int width, int height) {
+    Grid grid = makeGrid();
+    grid.width = width;
+    grid.height = height;
+    generateGridData(&grid);
+    return grid;
+}
+
+GradeVerdict gradeTestRun(const GradeSpec *spec, InterpreterExitCode code, int robotPosX, int robotPosY, const Grid *grid,
+                          int *mismatchX, int *mismatchY) {
+    GradeTarget target;
+    if (spec != NULL)
+        makeGradeTarget(&target, spec, grid->width, grid->height);
+    Robot robot = { .posX = robotPosX, .posY = robotPosY };
+    GradeVerdict verdict = verifyOutcome(spec, &target, code, &robot, grid, mismatchX, mismatchY);
+    if (spec != NULL)
+        freeGradeTarget(&target);
+    return verdict;
+}
+
+// What writer puts in a file, as one string to free
+char *writeGradeTestReport(GradeReportWriter writer, const GradeResult *results, size_t count) {
+    FILE *file = tmpfile();
+    writer(file, results, count);
+    long size = ftell(file);
+    rewind(file);
+    char *text = nmallocT(char, size + 1);
+    text[fread(text, 1, size, file)] = '\0';
+    fclose(file);
+    return text;
+}
+
+void checkSpecs() {
+    writeTestFile(GRADE_TEST_SPEC, m_gradeSpecText, strlen(m_gradeSpecText));
+    GradeSpec *specs;
+    size_t count;
+    EXPECT(loadGradeSpecs(GRADE_TEST_SPEC, &specs, &count) == EXIT_SUCCESS);
+    EXPECT(count == 4);
+    const GradeSpec *a = findGradeSpec(specs, count, "grids/a.kum_grid");
+    EXPECT(a != NULL && a->checkPos && a->posX == 2 && a->posY == 0 && a->cellCount == 2);
+    const GradeSpec *any = findGradeSpec(specs, count, "any.kum_grid");
+    EXPECT(any != NULL && !any->checkPos && any->cellCount == 0);
+    EXPECT(findGradeSpec(specs, count, "b.kum_grid") == NULL);
+    EXPECT(findGradeSpec(specs, count, "A.kum_grid") == NULL);
+
+    int mismatchX, mismatchY;
+    Grid grid = makeGradeTestGrid(5, 5);
+    setGridCell(&grid, 0, 0, GRID_CELL_FILLED);
+    setGridCell(&grid, 1, 0, GRID_CELL_FILLED);
+    EXPECT(gradeTestRun(a, INTERPRETER_FINISHED, 2, 0, &grid, &mismatchX, &mismatchY) == GRADE_PASS);
+    EXPECT(mismatchX == -1 && mismatchY == -1);
+    EXPECT(gradeTestRun(a, INTERPRETER_FORCE_EXIT, 2, 0, &grid, &mismatchX, &mismatchY) == GRADE_PASS);
+    EXPECT(gradeTestRun(a, INTERPRETER_ERROR, 2, 0, &grid, &mismatchX, &mismatchY) == GRADE_RUNTIME_ERROR);
+    EXPECT(gradeTestRun(a, INTERPRETER_STEP_LIMIT, 2, 0, &grid, &mismatchX, &mismatchY) == GRADE_RUNTIME_ERROR);
+    EXPECT(gradeTestRun(a, INTERPRETER_FINISHED, 3, 0, &grid, &mismatchX, &mismatchY) == GRADE_WRONG_POSITION);
+    // A grid the spec doesn't name passes nothing, even a clean finish
+    EXPECT(gradeTestRun(NULL, INTERPRETER_FINISHED, 2, 0, &grid, &mismatchX, &mismatchY) == GRADE_NO_SPEC);
+    EXPECT_STR(getGradeVerdictName(GRADE_NO_SPEC), "no_spec");
+
+    setGridCell(&grid, 4, 4, GRID_CELL_FILLED);
+    EXPECT(gradeTestRun(a, INTERPRETER_FINISHED, 2, 0, &grid, &mismatchX, &mismatchY) == GRADE_WRONG_PAINT);
+    EXPECT(mismatchX == 4 && mismatchY == 4);
+    setGridCell(&grid, 4, 4, GRID_CELL_EMPTY);
+    setGridCell(&grid, 1, 0, GRID_CELL_EMPTY);
+    EXPECT(gradeTestRun(a, INTERPRETER_FINISHED, 2, 0, &grid, &mismatchX, &mismatchY) == GRADE_WRONG_PAINT);
+    EXPECT(mismatchX == 1 && mismatchY == 0);
+    EXPECT(gradeTestRun(any, INTERPRETER_FINISHED, 4, 4, &grid, &mismatchX, &mismatchY) == GRADE_WRONG_PAINT);
+    setGridCell(&grid, 0, 0, GRID_CELL_EMPTY);
+    EXPECT(gradeTestRun(any, INTERPRETER_FINISHED, 4, 4, &grid, &mismatchX, &mismatchY) == GRADE_PASS);
+    EXPECT(gradeTestRun(findGradeSpec(specs, count, "far.kum_grid"), INTERPRETER_FINISHED, 0, 0, &grid, &mismatchX, &mismatchY) ==
+           GRADE_WRONG_PAINT);
+    freeGrid(&grid);
+
+    // A wanted cell in a tile the run never touched
+    const GradeSpec *big = findGradeSpec(specs, count, "big.kum_grid");
+    grid = makeGradeTestGrid(200, 200);
+    setGridCell(&grid, 1, 1, GRID_CELL_FILLED);
+    EXPECT(gradeTestRun(big, INTERPRETER_FINISHED, 0, 0, &grid, &mismatchX, &mismatchY) == GRADE_WRONG_PAINT);
+    EXPECT(mismatchX == 150 && mismatchY == 150);
+    setGridCell(&grid, 150, 150, GRID_CELL_FILLED);
+    EXPECT(gradeTestRun(big, INTERPRETER_FINISHED, 0, 0, &grid, &mismatchX, &mismatchY) == GRADE_PASS);
+    freeGrid(&grid);
+    freeGradeSpecs(specs, count);
+
+    const char *invalid = "a.kum_grid 1\nb.kum_grid - - 1;2\n";
+    writeTestFile(GRADE_TEST_SPEC, invalid, strlen(invalid));
+    EXPECT(loadGradeSpecs(GRADE_TEST_SPEC, &specs, &count) == EXIT_FAILURE);
+    remove(GRADE_TEST_SPEC);
+}
+
+void checkReports() {
+    GradeResult results[] = {
+        { .submission = "a.kum", .grid = "a.kum_grid", .verdict = GRADE_PASS,
+          .run = { .code = INTERPRETER_FINISHED, .line = 3, .steps = 5 },
+          .robotPosX = 2, .robotPosY = 0, .mismatchX = -1, .mismatchY = -1, .seconds = 0.0015 },
+        { .submission = "b,\"x\".kum", .grid = "a.kum_grid", .verdict = GRADE_WRONG_PAINT,
+          .run = { .code = INTERPRETER_FORCE_EXIT, .line = 7, .steps = 12 },
+          .robotPosX = 1, .robotPosY = 4, .mismatchX = 1, .mismatchY = 0, .seconds = 0 },
+        { .submission = "a.kum", .grid = "typo.kum_grid", .verdict = GRADE_NO_SPEC,
+          .run = { .code = INTERPRETER_FINISHED, .line = 3, .steps = 5 },
+          .robotPosX = 2, .robotPosY = 0, .mismatchX = -1, .mismatchY = -1, .seconds = 0 }
+    };
+
+    char *csv = writeGradeTestReport(writeGradeCsv, results, countof(results));
+    EXPECT_STR(csv,
+        "submission,grid,result,reason,code,line,steps,x,y,time_ms\n"
+        "a.kum,a.kum_grid,pass,ok,finished,3,5,2,0,1.500\n"
+        "\"b,\"\"x\"\".kum\",a.kum_grid,fail,wrong_paint,force_exit,7,12,1,4,0.000\n"
+        "a.kum,typo.kum_grid,fail,no_spec,finished,3,5,2,0,0.000\n");
+    free(csv);
+
+    char *json = writeGradeTestReport(writeGradeJson, results, countof(results));
+    EXPECT_STR(json,
+        "[\n"
+        "  {\"submission\":\"a.kum\",\"grid\":\"a.kum_grid\",\"pass\":true,\"reason\":\"ok\",\"code\":\"finished\","
+        "\"line\":3,\"steps\":5,\"x\":2,\"y\":0,\"time_ms\":1.500},\n"
+        "  {\"submission\":\"b,\\\"x\\\".kum\",\"grid\":\"a.kum_grid\",\"pass\":false,\"reason\":\"wrong_paint\","
+        "\"code\":\"force_exit\",\"line\":7,\"steps\":12,\"x\":1,\"y\":4,\"mismatch\":[1,0],\"time_ms\":0.000},\n"
+        "  {\"submission\":\"a.kum\",\"grid\":\"typo.kum_grid\",\"pass\":false,\"reason\":\"no_spec\",\"code\":\"finished\","
+        "\"line\":3,\"steps\":5,\"x\":2,\"y\":0,\"time_ms\":0.000}\n"
+        "]\n");
+    free(json);
+}
+
+int main() {
+    checkSpecs();
+    checkReports();
+    return finishTest();
+}
@@ -0,0 +1,206 @@
+#include <stdint.h>
+
+#include "grid.h"
+#include "test.h"
+
+// Grids written with writeGrid and read back with loadGridFromMemory, in
+// both layouts, files from before the header, and damaged files, which
+// have to fail rather than load part of a field
+
+// The bytes writeGrid puts in a file, to free
+unsigned char *writeGridToMemory(const Grid *grid, int robotPosX, int robotPosY, size_t *size) {
+    FILE *file = tmpfile();
+    EXPECT(writeGrid(grid, file, robotPosX, robotPosY) == EXIT_SUCCESS);
+    *size = ftell(file);
+    rewind(file);
+    unsigned char *data = nmallocT(unsigned char, *size);
+    EXPECT(fread(data, 1, *size, file) == *size);
+    fclose(file);
+    return data;
+}
+
+// Equal counts and every marked cell of a found in b mean equal fields
+void expectSameGrid(const Grid *a, const Grid *b) {
+    EXPECT(a->width == b->width && a->height == b->height);
+    EXPECT(countGridCells(a, GRID_CELL_WALL) == countGridCells(b, GRID_CELL_WALL));
+    EXPECT(countGridCells(a, GRID_CELL_FILLED) == countGridCells(b, GRID_CELL_FILLED));
+    GridCellIterator it = makeGridCellIterator();
+    int x, y;
+    CellType type;
+    bool same = true;
+    while (nextGridMarkedCell(a, &it, &x, &y, &type)) {
+        if (getGridCell(b, x, y) != type)
+            same = false;
+    }
+    EXPECT(same);
+    EXPECT(isGridPaintEqual(a, b));
+}
+
+void checkRoundTrip(const Grid *grid, int robotPosX, int robotPosY, int version) {
+    size_t size;
+    unsigned char *data = writeGridToMemory(grid, robotPosX, robotPosY, &size);
+    GridFileHeader header;
+    EXPECT(size >= sizeof(header));
+    memcpy(&header, data, sizeof(header));
+    EXPECT(memcmp(header.magic, GRID_FILE_MAGIC, sizeof(header.magic)) == 0 && header.version == version);
+
+    Grid loaded = makeGrid();
+    int loadedX = -1, loadedY = -1;
+    EXPECT(loadGridFromMemory(&loaded, data, size, &loadedX, &loadedY) == EXIT_SUCCESS);
+    EXPECT(loadedX == robotPosX && loadedY == robotPosY);
+    expectSameGrid(grid, &loaded);
+    freeGrid(&loaded);
+    free(data);
+}
+
+void expectLoadFails(const void *data, size_t size) {
+    Grid grid = makeGrid();
+    int robotPosX, robotPosY;
+    EXPECT(loadGridFromMemory(&grid, (const unsigned char *)data, size, &robotPosX, &robotPosY) == EXIT_FAILURE);
+}
+
+Grid makeGridTestGrid(int width, int height) {
+    Grid grid = makeGrid();
+    grid.width = width;
+    grid.height = height;
+    generateGridData(&grid);
+    return grid;
+}
+
+void checkPlanes() {
+    // Neither side a multiple of the tile or word size
+    Grid grid = makeGridTestGrid(37, 23);
+    for (int y = 0; y < grid.height; y++) {
+        for (int x = 0; x < grid.width; x++) {
+            if ((x * 7 + y * 3) % 11 == 0)
+                setGridCell(&grid, x, y, GRID_CELL_WALL);
+            else if ((x + y) % 4 == 0)
+                setGridCell(&grid, x, y, GRID_CELL_FILLED);
+        }
+    }
+    setGridCell(&grid, 36, 22, GRID_CELL_FILLED);
+    setGridCell(&grid, 1, 0, GRID_CELL_EMPTY);
+    checkRoundTrip(&grid, 1, 0, GRID_FILE_VERSION_PLANES);
+
+    size_t size;
+    unsigned char *data = writeGridToMemory(&grid, 1, 0, &size);
+    expectLoadFails(data, size - 1);
+    // A bit past the last cell, in the padding of the paint plane
+    size_t past = (size_t)grid.width * grid.height + 1;
+    EXPECT(past < getGridPlaneWords(grid.width, grid.height) * 64);
+    data[size - sizeof(uint64_t) + past % 64 / 8] |= 1 << past % 8;
+    expectLoadFails(data, size);
+    free(data);
+
+    // The robot on a wall
+    data = writeGridToMemory(&grid, 0, 0, &size);
+    expectLoadFails(data, size);
+    free(data);
+    freeGrid(&grid);
+
+    // An empty field is a header and no records
+    grid = makeGridTestGrid(GRID_DEFAULT_SIZE, GRID_DEFAULT_SIZE);
+    checkRoundTrip(&grid, 14, 14, GRID_FILE_VERSION_RECORDS);
+    freeGrid(&grid);
+}
+
+void checkRecords() {
+    // Huge and almost empty: records, and only the tiles they touch
+    Grid grid = makeGridTestGrid(20000, 30000);
+    setGridCell(&grid, 0, 0, GRID_CELL_FILLED);
+    setGridCell(&grid, 19999, 29999, GRID_CELL_WALL);
+    setGridCell(&grid, 12345, 6789, GRID_CELL_FILLED);
+    setGridCell(&grid, 12346, 6789, GRID_CELL_WALL);
+    checkRoundTrip(&grid, 12345, 6790, GRID_FILE_VERSION_RECORDS);
+
+    size_t size;
+    unsigned char *data = writeGridToMemory(&grid, 12345, 6790, &size);
+    EXPECT(size == sizeof(GridFileHeader) + 4 * sizeof(GridFileRecord));
+    expectLoadFails(data, size - 1);
+    GridFileRecord record;
+    memcpy(&record, data + sizeof(GridFileHeader), sizeof(record));
+    record.x = 20000;
+    memcpy(data + sizeof(GridFileHeader), &record, sizeof(record));
+    expectLoadFails(data, size);
+    record.x = 0;
+    record.type = (CellType)7;
+    memcpy(data + sizeof(GridFileHeader), &record, sizeof(record));
+    expectLoadFails(data, size);
+    free(data);
+    freeGrid(&grid);
+}
+
+// Files from before the header: the robot, then records, on 15x15
+void checkLegacy() {
+    struct {
+        int robotPosX;
+        int robotPosY;
+        GridFileRecord records[4];
+    } legacy = {
+        .robotPosX = 3,
+        .robotPosY = 14,
+        .records = {
+            { GRID_CELL_WALL, 0, 0 },
+            { GRID_CELL_FILLED, 14, 14 },
+            { GRID_CELL_FILLED, 5, 5 },
+            { GRID_CELL_EMPTY, 5, 5 }  // a later record wins
+        }
+    };
+    Grid grid = makeGrid();
+    int robotPosX, robotPosY;
+    EXPECT(loadGridFromMemory(&grid, (const unsigned char *)&legacy, sizeof(legacy), &robotPosX, &robotPosY) == EXIT_SUCCESS);
+    EXPECT(grid.width == GRID_LEGACY_SIZE && grid.height == GRID_LEGACY_SIZE);
+    EXPECT(robotPosX == 3 && robotPosY == 14);
+    EXPECT(getGridCell(&grid, 0, 0) == GRID_CELL_WALL);
+    EXPECT(getGridCell(&grid, 14, 14) == GRID_CELL_FILLED);
+    EXPECT(getGridCell(&grid, 5, 5) == GRID_CELL_EMPTY);
+    EXPECT(countGridCells(&grid, GRID_CELL_WALL) == 1 && countGridCells(&grid, GRID_CELL_FILLED) == 1);
+
+    // Written back it gets a header, and loads the same
+    checkRoundTrip(&grid, robotPosX, robotPosY, GRID_FILE_VERSION_RECORDS);
+    freeGrid(&grid);
+
+    legacy.robotPosX = 15;
+    expectLoadFails(&legacy, sizeof(legacy));
+    legacy.robotPosX = 0;
+    legacy.robotPosY = 0;
+    expectLoadFails(&legacy, sizeof(legacy));
+    legacy.robotPosY = 1;
+    legacy.records[1].y = 15;
+    expectLoadFails(&legacy, sizeof(legacy));
+    expectLoadFails(&legacy, sizeof(int));
+}
+
+void checkHeaders() {
+    GridFileHeader header = { .version = GRID_FILE_VERSION_RECORDS, .width = 10, .height = 10, .robotPosX = 9, .robotPosY = 9 };
+    memcpy(header.magic, GRID_FILE_MAGIC, sizeof(header.magic));
+    Grid grid = makeGrid();
+    int robotPosX, robotPosY;
+    EXPECT(loadGridFromMemory(&grid, (const unsigned char *)&header, sizeof(header), &robotPosX, &robotPosY) == EXIT_SUCCESS);
+    EXPECT(grid.width == 10 && grid.height == 10 && robotPosX == 9 && robotPosY == 9);
+    freeGrid(&grid);
+
+    GridFileHeader bad = header;
+    bad.version = 3;
+    expectLoadFails(&bad, sizeof(bad));
+    bad = header;
+    bad.width = 0;
+    expectLoadFails(&bad, sizeof(bad));
+    bad = header;
+    bad.height = GRID_MAX_SIZE + 1;
+    expectLoadFails(&bad, sizeof(bad));
+    bad = header;
+    bad.robotPosY = -1;
+    expectLoadFails(&bad, sizeof(bad));
+    bad = header;
+    bad.version = GRID_FILE_VERSION_PLANES;
+    expectLoadFails(&bad, sizeof(bad));
+}
+
+int main() {
+    checkPlanes();
+    checkRecords();
+    checkLegacy();
+    checkHeaders();
+    return finishTest();
+}
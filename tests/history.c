@@ -0,0 +1,168 @@
+#include <stdint.h>
+
+#include "history.h"
+#include "test.h"
+
+// Seeks a run back and forth through its snapshots and expects the state
+// a plain run has at each step: the pc, the robot, the paint and, at the
+// end, the result. The run is long enough for the snapshots to thin out
+// and ends in a loop, so the loop check has to come back with them
+#define HISTORY_TEST_SIZE 400
+
+const char *m_historySource =
+    "нц\n"
+    "    нц пока справа свободно\n"
+    "        закрасить\n"
+    "        вправо\n"
+    "    кц\n"
+    "    закрасить\n"
+    "    если не снизу свободно то\n"
+    "        прервать\n"
+    "    все\n"
+    "    вниз\n"
+    "    нц пока слева свободно\n"
+    "        закрасить\n"
+    "        влево\n"
+    "    кц\n"
+    "    закрасить\n"
+    "    если не снизу свободно то\n"
+    "        прервать\n"
+    "    все\n"
+    "    вниз\n"
+    "кц\n"
+    "нц\n"
+    "    вверх\n"
+    "    вниз\n"
+    "кц\n";
+
+typedef struct HistoryTestState {
+    size_t steps;
+    size_t pc;
+    Robot robot;
+    Grid grid;
+} HistoryTestState;
+
+// Steps of the plain run to compare at, in order; the end is added
+size_t m_historySteps[] = { 0, 1, 1023, 1024, 1025, 4097, 65536, 100001, 262143, 262144, 300000 };
+HistoryTestState m_historyStates[countof(m_historySteps) + 1];
+RunResult m_historyResult;
+
+Program m_historyProgram;
+
+Grid makeHistoryTestGrid() {
+    Grid grid = makeGrid();
+    grid.width = HISTORY_TEST_SIZE;
+    grid.height = HISTORY_TEST_SIZE;
+    generateGridData(&grid);
+    setGridCell(&grid, 200, 150, GRID_CELL_WALL);
+    return grid;
+}
+
+void saveHistoryTestState(HistoryTestState *state, const Interpreter *interpreter) {
+    state->steps = interpreter->steps;
+    state->pc = interpreter->pc;
+    state->robot = *interpreter->robot;
+    copyGrid(&state->grid, interpreter->grid);
+}
+
+// The plain run, one source instruction at a time
+void recordPlainRun() {
+    Grid grid = makeHistoryTestGrid();
+    Robot robot = { .posX = 0, .posY = 0 };
+    Interpreter interpreter;
+    initInterpreter(&interpreter, &m_historyProgram, &robot, &grid);
+    interpreter.stepFused = true;
+    InterpreterExitCode code = INTERPRETER_NORMAL;
+    size_t pc = 0;
+    for (size_t i = 0; i < countof(m_historySteps); i++) {
+        while (interpreter.steps < m_historySteps[i] && (code == INTERPRETER_NORMAL || code == INTERPRETER_SKIP_LINE)) {
+            pc = interpreter.pc;
+            code = stepInterpreter(&interpreter);
+        }
+        EXPECT(interpreter.steps == m_historySteps[i]);
+        saveHistoryTestState(&m_historyStates[i], &interpreter);
+    }
+    while (code == INTERPRETER_NORMAL || code == INTERPRETER_SKIP_LINE) {
+        pc = interpreter.pc;
+        code = stepInterpreter(&interpreter);
+    }
+    m_historyResult = (RunResult){ .code = code, .line = getInstructionLine(&m_historyProgram, pc), .steps = interpreter.steps };
+    saveHistoryTestState(&m_historyStates[countof(m_historySteps)], &interpreter);
+    freeInterpreter(&interpreter);
+    freeGrid(&grid);
+}
+
+// At the last step the plain run stopped where it found the loop, while a
+// seek stops on its step limit at a jump next to it; how the run ended is
+// compared through the history's result instead
+bool isSameHistoryState(const Interpreter *interpreter, const HistoryTestState *state) {
+    bool samePc = interpreter->pc == state->pc || state->steps == m_historyResult.steps;
+    return interpreter->steps == state->steps && samePc && interpreter->robot->posX == state->robot.posX &&
+           interpreter->robot->posY == state->robot.posY && interpreter->grid->paintHash == state->grid.paintHash &&
+           isGridPaintEqual(interpreter->grid, &state->grid);
+}
+
+void expectSeek(RunHistory *history, size_t index) {
+    const HistoryTestState *state = &m_historyStates[index];
+    seekRunHistory(history, state->steps);
+    if (!isSameHistoryState(history->interpreter, state)) {
+        m_testFailures++;
+        printf("%s:%d: seeking to step %zu reached step %zu at %d, %d\n", __FILE__, __LINE__, state->steps,
+               history->interpreter->steps, history->interpreter->robot->posX, history->interpreter->robot->posY);
+    }
+    m_testCount++;
+}
+
+int main() {
+    size_t lineNum;
+    EXPECT(compileProgramSource(m_historySource, LANG_RU, &m_historyProgram, &lineNum) == INTERPRETER_NORMAL);
+    recordPlainRun();
+    EXPECT(m_historyResult.code == INTERPRETER_INFINITE_LOOP);
+    EXPECT(m_historyResult.steps > HISTORY_FIRST_INTERVAL * HISTORY_MAX_SNAPSHOTS);
+
+    Grid grid = makeHistoryTestGrid();
+    Robot robot = { .posX = 0, .posY = 0 };
+    Interpreter interpreter;
+    initInterpreter(&interpreter, &m_historyProgram, &robot, &grid);
+    RunHistory history;
+    initRunHistory(&history, &interpreter);
+
+    // Forward in uneven jumps, the way the viewer's slider goes
+    expectSeek(&history, 3);
+    expectSeek(&history, 5);
+    expectSeek(&history, 6);
+    EXPECT(!history.finished);
+
+    // To the end: the whole run, with the snapshots thinned out
+    EXPECT(seekRunHistory(&history, SIZE_MAX) == m_historyResult.code);
+    EXPECT(history.finished && history.furthestSteps == m_historyResult.steps);
+    EXPECT(history.result.code == m_historyResult.code && history.result.steps == m_historyResult.steps &&
+           history.result.line == m_historyResult.line);
+    EXPECT(history.interval > HISTORY_FIRST_INTERVAL && history.snapshotCount <= HISTORY_MAX_SNAPSHOTS);
+    EXPECT(isSameHistoryState(&interpreter, &m_historyStates[countof(m_historySteps)]));
+
+    // Back and forth, across snapshots and within one
+    size_t order[] = { 0, 10, 2, 1, 9, 8, 4, 3, 7, 6, 7, 0, 11, 5 };
+    for (size_t i = 0; i < countof(order); i++)
+        expectSeek(&history, order[i]);
+    EXPECT(seekRunHistory(&history, m_historyResult.steps + 1000) == INTERPRETER_NORMAL);
+    EXPECT(interpreter.steps == m_historyResult.steps);
+
+    // From a restored snapshot, stepping on has to end the same way,
+    // loop check and all
+    expectSeek(&history, 9);
+    InterpreterExitCode code;
+    do {
+        code = stepRunHistory(&history);
+    } while (code == INTERPRETER_NORMAL || code == INTERPRETER_SKIP_LINE);
+    EXPECT(code == m_historyResult.code);
+    EXPECT(isSameHistoryState(&interpreter, &m_historyStates[countof(m_historySteps)]));
+
+    freeRunHistory(&history);
+    freeInterpreter(&interpreter);
+    freeGrid(&grid);
+    for (size_t i = 0; i < countof(m_historyStates); i++)
+        freeGrid(&m_historyStates[i].grid);
+    freeProgram(&m_historyProgram);
+    return finishTest();
+}
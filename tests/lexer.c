@@ -0,0 +1,142 @@
+#include "interpreter.h"
+#include "lexer.h"
+#include "test.h"
+
+// Tokens of single lines in both languages: every keyword, the multi-word
+// ones, keywords that are prefixes of others, numbers and comments; then
+// one program written in both languages has to run the same
+#define LEXER_TEST_MAX_TOKENS 8
+
+typedef struct LexerTestCase {
+    const char *line;
+    Language lang;
+    Token tokens[LEXER_TEST_MAX_TOKENS];  // TOKEN_END after the listed ones, unless all are listed
+} LexerTestCase;
+
+#define KW(name) { .type = TOKEN_KEYWORD, .keyword = KEYWORD_##name }
+#define NUM(value) { .type = TOKEN_NUMBER, .number = value }
+#define COMMA { .type = TOKEN_COMMA }
+#define INVALID { .type = TOKEN_INVALID }
+#define END { .type = TOKEN_END }
+
+LexerTestCase m_lexerCases[] = {
+    { "go up", LANG_EN, { KW(GO_UP), END } },
+    { "\tgo right  # go left", LANG_EN, { KW(GO_RIGHT), END } },
+    { "go left\r\n", LANG_EN, { KW(GO_LEFT), END } },
+    { "if not upwards free and leftwards free then", LANG_EN,
+      { KW(IF), KW(NOT), KW(CHECK_UP), KW(CHECK_CLEAR), KW(AND), KW(CHECK_LEFT), KW(CHECK_CLEAR), KW(THEN) } },
+    { "loop while downwards free or rightwards free", LANG_EN,
+      { KW(LOOP), KW(WHILE), KW(CHECK_DOWN), KW(CHECK_CLEAR), KW(OR), KW(CHECK_RIGHT), KW(CHECK_CLEAR), END } },
+    { "goto 3, -4", LANG_EN, { KW(SETPOS), NUM(3), COMMA, NUM(-4), END } },
+    { "goto 3,4", LANG_EN, { KW(SETPOS), NUM(3), COMMA, NUM(4), END } },
+    // A multi-word keyword is one token or nothing
+    { "go", LANG_EN, { INVALID, END } },
+    { "go  up", LANG_EN, { INVALID, INVALID, END } },
+    { "go upwards", LANG_EN, { INVALID, KW(CHECK_UP), END } },
+    { "go up paint", LANG_EN, { KW(GO_UP), KW(PAINT), END } },
+    { "endloop endif exit break", LANG_EN, { KW(ENDLOOP), KW(ENDIF), KW(EXIT), KW(EXITLOOP), END } },
+    { "loops", LANG_EN, { INVALID, END } },
+    { "вверх", LANG_EN, { INVALID, END } },
+
+    { "нц пока справа свободно", LANG_RU, { KW(LOOP), KW(WHILE), KW(CHECK_RIGHT), KW(CHECK_CLEAR), END } },
+    // и, или and иные share their first letter; не and нц theirs
+    { "если не сверху свободно и снизу свободно или слева свободно то", LANG_RU,
+      { KW(IF), KW(NOT), KW(CHECK_UP), KW(CHECK_CLEAR), KW(AND), KW(CHECK_DOWN), KW(CHECK_CLEAR), KW(OR) } },
+    { "иные", LANG_RU, { INVALID, END } },
+    { "все кц конец прервать", LANG_RU, { KW(ENDIF), KW(ENDLOOP), KW(EXIT), KW(EXITLOOP), END } },
+    { "вверх вниз влево вправо закрасить", LANG_RU, { KW(GO_UP), KW(GO_DOWN), KW(GO_LEFT), KW(GO_RIGHT), KW(PAINT), END } },
+    { "переместить 0,-1#", LANG_RU, { KW(SETPOS), NUM(0), COMMA, NUM(-1), END } },
+    { "переместить 2147483647, 2147483648", LANG_RU, { KW(SETPOS), NUM(2147483647), COMMA, INVALID, END } },
+    { "переместить -, 5", LANG_RU, { KW(SETPOS), INVALID, COMMA, NUM(5), END } },
+    { "вправо2", LANG_RU, { INVALID, END } },
+    { "go up", LANG_RU, { INVALID, INVALID, END } },
+    { "", LANG_RU, { END } }
+};
+
+bool isSameToken(Token actual, Token expected) {
+    if (actual.type != expected.type)
+        return false;
+    if (actual.type == TOKEN_KEYWORD)
+        return actual.keyword == expected.keyword;
+    if (actual.type == TOKEN_NUMBER)
+        return actual.number == expected.number;
+    return true;
+}
+
+void checkLexerCase(const LexerTestCase *test) {
+    Lexer lexer = makeLexer(test->line, test->lang);
+    for (size_t i = 0; i < LEXER_TEST_MAX_TOKENS; i++) {
+        Token token = lexNextToken(&lexer);
+        if (!isSameToken(token, test->tokens[i])) {
+            m_testFailures++;
+            printf("%s:%d: token %zu of \"%s\" is %d (keyword %d, number %d), expected %d\n", __FILE__, __LINE__, i, test->line,
+                   token.type, token.keyword, token.number, test->tokens[i].type);
+        }
+        m_testCount++;
+        if (test->tokens[i].type == TOKEN_END)
+            break;
+    }
+}
+
+// Every keyword alone, in both languages
+void checkEveryKeyword() {
+    for (int lang = 0; lang < LANG_COUNT; lang++) {
+        for (int keyword = KEYWORD_NONE + 1; keyword < KEYWORD_COUNT; keyword++) {
+            Lexer lexer = makeLexer(m_keywordStrings[lang][keyword], (Language)lang);
+            Token token = lexNextToken(&lexer);
+            EXPECT(token.type == TOKEN_KEYWORD && token.keyword == (Keyword)keyword);
+            EXPECT(lexNextToken(&lexer).type == TOKEN_END);
+        }
+    }
+}
+
+const char *m_lexerPrograms[LANG_COUNT] = {
+    [LANG_RU] = "нц пока справа свободно\n    если не снизу свободно или сверху свободно то\n        закрасить\n    все\n"
+                "    вправо\nкц\nпереместить 0, 2\nнц\n    если не снизу свободно то\n        прервать\n    все\n    вниз\nкц\n",
+    [LANG_EN] = "loop while rightwards free\n    if not downwards free or upwards free then\n        paint\n    endif\n"
+                "    go right\nendloop\ngoto 0, 2\nloop\n    if not downwards free then\n        break\n    endif\n    go down\nendloop\n"
+};
+
+void checkPrograms() {
+    Grid grids[LANG_COUNT];
+    Robot robots[LANG_COUNT];
+    RunResult results[LANG_COUNT];
+    for (int lang = 0; lang < LANG_COUNT; lang++) {
+        Program program;
+        size_t lineNum;
+        EXPECT(compileProgramSource(m_lexerPrograms[lang], (Language)lang, &program, &lineNum) == INTERPRETER_NORMAL);
+        grids[lang] = makeGrid();
+        grids[lang].width = 9;
+        grids[lang].height = 6;
+        generateGridData(&grids[lang]);
+        setGridCell(&grids[lang], 4, 1, GRID_CELL_WALL);
+        robots[lang] = (Robot){ .posX = 0, .posY = 0 };
+        Interpreter interpreter;
+        initInterpreter(&interpreter, &program, &robots[lang], &grids[lang]);
+        results[lang] = runInterpreter(&interpreter);
+        freeInterpreter(&interpreter);
+        freeProgram(&program);
+    }
+    EXPECT(results[LANG_RU].code == INTERPRETER_FINISHED);
+    EXPECT(results[LANG_RU].code == results[LANG_EN].code && results[LANG_RU].steps == results[LANG_EN].steps);
+    EXPECT(robots[LANG_RU].posX == 0 && robots[LANG_RU].posY == 5);
+    EXPECT(robots[LANG_EN].posX == 0 && robots[LANG_EN].posY == 5);
+    EXPECT(getGridCell(&grids[LANG_RU], 4, 0) == GRID_CELL_FILLED && countGridCells(&grids[LANG_RU], GRID_CELL_FILLED) == 1);
+    EXPECT(isGridPaintEqual(&grids[LANG_RU], &grids[LANG_EN]));
+    for (int lang = 0; lang < LANG_COUNT; lang++)
+        freeGrid(&grids[lang]);
+
+    // The same program in the other language doesn't compile
+    Program program;
+    size_t lineNum;
+    EXPECT(compileProgramSource(m_lexerPrograms[LANG_EN], LANG_RU, &program, &lineNum) != INTERPRETER_NORMAL);
+    EXPECT(lineNum == 1);
+}
+
+int main() {
+    for (size_t i = 0; i < countof(m_lexerCases); i++)
+        checkLexerCase(&m_lexerCases[i]);
+    checkEveryKeyword();
+    checkPrograms();
+    return finishTest();
+}
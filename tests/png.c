@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "png.h"
+#include "test.h"
+
+// Encodes images and decodes them back with zlib: every chunk CRC, the
+// header, the palette and every pixel have to come out as they went in
+#define PNG_TEST_FILE "png_test.png"
+#define PNG_TEST_THREADS 4
+
+typedef struct PngTestImage {
+    unsigned char *pixels;
+    int width;
+    int height;
+} PngTestImage;
+
+PngColor m_pngPalette[256];
+
+uint32_t readPngUint32(const unsigned char *data) {
+    return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+}
+
+PngTestImage makePngTestImage(int width, int height) {
+    PngTestImage image = { .pixels = (unsigned char *)calloc((size_t)width * height, 1), .width = width, .height = height };
+    return image;
+}
+
+// Undoes the row filters the encoder may use (none, sub and up) in place
+// and packs the rows together
+bool unfilterPng(unsigned char *data, int width, int height) {
+    size_t stride = (size_t)width + 1;
+    for (int y = 0; y < height; y++) {
+        unsigned char *row = data + y * stride;
+        const unsigned char *above = y > 0 ? data + (y - 1) * stride : NULL;
+        for (int x = 1; x <= width; x++) {
+            if (row[0] == 1 && x > 1)
+                row[x] += row[x - 1];
+            else if (row[0] == 2 && above != NULL)
+                row[x] += above[x];
+            else if (row[0] > 2)
+                return false;
+        }
+    }
+    for (int y = 0; y < height; y++)
+        memmove(data + (size_t)y * width, data + y * stride + 1, width);
+    return true;
+}
+
+void checkDecodes(const unsigned char *png, size_t size, const PngTestImage *image, int paletteSize) {
+    EXPECT(size > 8 && memcmp(png, "\x89PNG\r\n\x1a\n", 8) == 0);
+    size_t stride = (size_t)image->width + 1;
+    unsigned char *idat = NULL;
+    size_t idatSize = 0;
+    bool header = false, palette = false, end = false, crcs = true;
+    for (size_t at = 8; at + 12 <= size && !end;) {
+        uint32_t length = readPngUint32(png + at);
+        if (at + 12 + length > size)
+            break;
+        const unsigned char *type = png + at + 4, *body = png + at + 8;
+        if (crc32(0, type, length + 4) != readPngUint32(body + length))
+            crcs = false;
+        if (memcmp(type, "IHDR", 4) == 0) {
+            header = length == 13 && readPngUint32(body) == (uint32_t)image->width && readPngUint32(body + 4) == (uint32_t)image->height &&
+                     memcmp(body + 8, "\x08\x03\x00\x00\x00", 5) == 0;
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            palette = length == 3 * (uint32_t)paletteSize && memcmp(body, m_pngPalette, length) == 0;
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            idat = (unsigned char *)realloc(idat, idatSize + length);
+            memcpy(idat + idatSize, body, length);
+            idatSize += length;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            end = at + 12 == size;
+        }
+        at += 12 + length;
+    }
+    EXPECT(crcs);
+    EXPECT(header);
+    EXPECT(palette);
+    EXPECT(end);
+
+    // One spare byte, so data that inflates to more than the image fails
+    uLongf rawSize = stride * image->height + 1;
+    unsigned char *raw = (unsigned char *)malloc(rawSize);
+    EXPECT(idat != NULL && uncompress(raw, &rawSize, idat, idatSize) == Z_OK);
+    EXPECT(rawSize == stride * image->height);
+    EXPECT(unfilterPng(raw, image->width, image->height));
+    EXPECT(memcmp(raw, image->pixels, (size_t)image->width * image->height) == 0);
+    free(raw);
+    free(idat);
+}
+
+void checkImage(const PngTestImage *image, int paletteSize) {
+    size_t size;
+    unsigned char *png = encodePng(image->pixels, image->width, image->height, m_pngPalette, paletteSize, &size);
+    checkDecodes(png, size, image, paletteSize);
+    free(png);
+}
+
+void *encodeInThread(void *arg) {
+    const PngTestImage *image = (const PngTestImage *)arg;
+    size_t size;
+    return encodePng(image->pixels, image->width, image->height, m_pngPalette, 256, &size);
+}
+
+int main() {
+    for (int i = 0; i < 256; i++)
+        m_pngPalette[i] = (PngColor){ (unsigned char)i, (unsigned char)(255 - i), (unsigned char)(i * 7) };
+
+    // Noise: all 256 values, most of them 9-bit literals, and no runs
+    PngTestImage noise = makePngTestImage(331, 97);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < (size_t)noise.width * noise.height; i++) {
+        seed = seed * 1103515245u + 12345u;
+        noise.pixels[i] = (unsigned char)(seed >> 16);
+    }
+
+    // The first encodes, so the CRC table is built while they race
+    pthread_t threads[PNG_TEST_THREADS];
+    for (int i = 0; i < PNG_TEST_THREADS; i++)
+        pthread_create(&threads[i], NULL, encodeInThread, &noise);
+    for (int i = 0; i < PNG_TEST_THREADS; i++) {
+        unsigned char *png;
+        pthread_join(threads[i], (void **)&png);
+        size_t size;
+        unsigned char *expected = encodePng(noise.pixels, noise.width, noise.height, m_pngPalette, 256, &size);
+        EXPECT(memcmp(png, expected, size) == 0);
+        free(expected);
+        free(png);
+    }
+    checkImage(&noise, 256);
+
+    // Noise of every width up to 200, so some buffer ends right where a
+    // 5-byte flush of the bit writer lands
+    for (int width = 1; width <= 200; width++) {
+        PngTestImage image = { .pixels = noise.pixels, .width = width, .height = 40 };
+        checkImage(&image, 256);
+    }
+
+    PngTestImage pixel = makePngTestImage(1, 1);
+    pixel.pixels[0] = 1;
+    checkImage(&pixel, 2);
+
+    // Runs around the longest match, where the encoder splits them
+    int runs[] = { 1, 2, 3, 4, 5, 257, 258, 259, 260, 261, 262, 516, 517, 518, 519, 1000 };
+    int width = 0;
+    for (size_t i = 0; i < countof(runs); i++)
+        width += runs[i];
+    PngTestImage flat = makePngTestImage(width, 7);
+    for (int y = 0; y < flat.height; y++) {
+        unsigned char *row = flat.pixels + (size_t)y * width;
+        for (size_t i = 0, x = 0; i < countof(runs); x += runs[i], i++)
+            memset(row + x, (int)(i + y / 3) % 5, runs[i]);
+    }
+    checkImage(&flat, 5);
+
+    // Bands of equal rows, like a rendered field
+    PngTestImage bands = makePngTestImage(300, 200);
+    for (int y = 0; y < bands.height; y++)
+        for (int x = 0; x < bands.width; x++)
+            bands.pixels[y * bands.width + x] = y % 20 == 0 || x % 20 == 0 ? 2 : (x / 20 + y / 20) % 2;
+    checkImage(&bands, 3);
+
+    EXPECT(writePng(PNG_TEST_FILE, bands.pixels, bands.width, bands.height, m_pngPalette, 3) == EXIT_SUCCESS);
+    size_t size;
+    unsigned char *expected = encodePng(bands.pixels, bands.width, bands.height, m_pngPalette, 3, &size);
+    unsigned char *written = (unsigned char *)malloc(size + 1);
+    FILE *file = fopen(PNG_TEST_FILE, "rb");
+    EXPECT(file != NULL && fread(written, 1, size + 1, file) == size && memcmp(written, expected, size) == 0);
+    if (file != NULL)
+        fclose(file);
+    remove(PNG_TEST_FILE);
+    free(written);
+    free(expected);
+
+    free(noise.pixels);
+    free(pixel.pixels);
+    free(flat.pixels);
+    free(bands.pixels);
+    return finishTest();
+}
@@ -0,0 +1,208 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "serve.h"
+#include "test.h"
+
+// The request parser on its own, then a server fed a file of jobs on
+// stdin: every job gets its answer, in order with one worker, and every
+// malformed job gets the error that names what is wrong with it
+#define SERVE_TEST_JOBS "serve_test_jobs.txt"
+#define SERVE_TEST_ANSWERS "serve_test_answers.txt"
+#define SERVE_TEST_GRID "serve_test." GRID_EXTENSION
+#define SERVE_TEST_PROGRAM "serve_test.kum"
+
+const char *m_validJson[] = {
+    "null", " true ", "false", "0", "-12.5e3", "\"\"", "[]", "{}", "[1, [2, [3]], {\"a\": null}]",
+    "{\"a\": 1, \"b\": \"x\", \"c\": [true, false]}"
+};
+
+const char *m_invalidJson[] = {
+    "", " ", "nul", "tru", "1.2.3", "1e", "-", "0x10", "\"abc", "\"\\x\"", "\"\\u12\"", "\"a\tb\"", "[1,]", "[1 2]",
+    "{\"a\"}", "{\"a\": }", "{a: 1}", "{\"a\": 1,}", "{\"a\": 1} x", "[1]]", "{\"a\": 1"
+};
+
+void checkJson() {
+    JsonValue value;
+    for (size_t i = 0; i < countof(m_validJson); i++) {
+        bool parsed = parseJson(m_validJson[i], strlen(m_validJson[i]), &value);
+        if (!parsed)
+            printf("%s:%d: failed to parse %s\n", __FILE__, __LINE__, m_validJson[i]);
+        EXPECT(parsed);
+        if (parsed)
+            freeJson(&value);
+    }
+    for (size_t i = 0; i < countof(m_invalidJson); i++) {
+        bool parsed = parseJson(m_invalidJson[i], strlen(m_invalidJson[i]), &value);
+        if (parsed) {
+            printf("%s:%d: parsed %s\n", __FILE__, __LINE__, m_invalidJson[i]);
+            freeJson(&value);
+        }
+        EXPECT(!parsed);
+    }
+
+    // Nesting is bounded, so a deep request can't exhaust the stack
+    char deep[2 * (JSON_MAX_DEPTH + 2) + 1];
+    memset(deep, '[', JSON_MAX_DEPTH + 2);
+    memset(deep + JSON_MAX_DEPTH + 2, ']', JSON_MAX_DEPTH + 2);
+    EXPECT(!parseJson(deep, 2 * (JSON_MAX_DEPTH + 2), &value));
+    EXPECT(parseJson(deep + 2, 2 * JSON_MAX_DEPTH, &value));
+    freeJson(&value);
+
+    const char *text = "{ \"s\": \"a\\\"b\\\\\\/\\n\\u00e9\\u0432\\ud83d\\ude00\", \"n\": -7, \"id\" : [1, {\"x\": \"y\"}] }";
+    EXPECT(parseJson(text, strlen(text), &value));
+    EXPECT(value.type == JSON_OBJECT && value.count == 3);
+    const JsonValue *s = getJsonMember(&value, "s");
+    EXPECT(s != NULL && s->type == JSON_STRING);
+    if (s != NULL) {
+        EXPECT_STR(s->string, "a\"b\\/\n\xc3\xa9\xd0\xb2\xf0\x9f\x98\x80");
+        EXPECT(s->length == 14);
+    }
+    const JsonValue *n = getJsonMember(&value, "n");
+    EXPECT(n != NULL && n->type == JSON_NUMBER && n->number == -7);
+    const JsonValue *id = getJsonMember(&value, "id");
+    EXPECT(id != NULL && id->rawLength == strlen("[1, {\"x\": \"y\"}]") && memcmp(id->raw, "[1, {\"x\": \"y\"}]", id->rawLength) == 0);
+    EXPECT(getJsonMember(&value, "x") == NULL);
+    EXPECT(id == NULL || getJsonMember(id, "x") == NULL);
+    freeJson(&value);
+}
+
+typedef struct ServeTestJob {
+    const char *request;
+    const char *answer;  // without time_us
+} ServeTestJob;
+
+ServeTestJob m_serveJobs[] = {
+    { "{\"id\": 1, \"source\": \"вправо\\nзакрасить\\n\", \"grid_data\": {\"width\": 5, \"height\": 3}}",
+      "{\"id\":1,\"code\":\"finished\",\"line\":2,\"steps\":2,\"x\":1,\"y\":0,\"painted\":[[1,0]]}" },
+    { "{\"id\": \"en\", \"lang\": \"en\", \"source\": \"go down\\npaint\\ngo right\\npaint\", \"grid_data\": {\"x\": 2, \"y\": 2}, "
+      "\"paint\": true}",
+      "{\"id\":\"en\",\"code\":\"finished\",\"line\":4,\"steps\":4,\"x\":3,\"y\":3,\"painted\":[[2,3],[3,3]]}" },
+    // The id comes back as it was written
+    { "{\"id\": [1, {\"a\": \"\\u0432\"}], \"source\": \"\\u0432\\u043d\\u0438\\u0437\", \"grid_data\": {}, \"paint\": false}",
+      "{\"id\":[1, {\"a\": \"\\u0432\"}],\"code\":\"finished\",\"line\":1,\"steps\":1,\"x\":0,\"y\":1}" },
+    { "{\"id\": 4, \"source\": \"нц\\n    вправо\\n    влево\\nкц\", \"grid_data\": {\"width\": 1000}, \"max_steps\": 10, "
+      "\"loop_check\": false, \"paint\": false}",
+      "{\"id\":4,\"code\":\"step_limit\",\"line\":1,\"steps\":10,\"x\":0,\"y\":0}" },
+    { "{\"id\": 5, \"source\": \"нц\\n    вправо\\n    влево\\nкц\", \"grid_data\": {}, \"paint\": false}",
+      "{\"id\":5,\"code\":\"infinite_loop\",\"line\":1,\"steps\":3,\"x\":0,\"y\":0}" },
+    { "{\"id\": 6, \"source\": \"вправо\\nвправо 1\\n\", \"grid_data\": {}}",
+      "{\"id\":6,\"code\":\"syntax_error\",\"line\":2,\"steps\":0,\"x\":0,\"y\":0,\"painted\":[]}" },
+    { "{\"id\": 7, \"grid\": \"" SERVE_TEST_GRID "\", \"program\": \"" SERVE_TEST_PROGRAM "\"}",
+      "{\"id\":7,\"code\":\"error\",\"line\":3,\"steps\":4,\"x\":2,\"y\":1,\"painted\":[[1,1]]}" },
+    // The same files again, now from the caches
+    { "{\"id\": 8, \"grid\": \"" SERVE_TEST_GRID "\", \"program\": \"" SERVE_TEST_PROGRAM "\", \"paint\": false}",
+      "{\"id\":8,\"code\":\"error\",\"line\":3,\"steps\":4,\"x\":2,\"y\":1}" },
+    { "", NULL },
+
+    { "not json", "{\"error\":\"invalid JSON\"}" },
+    { "{\"id\": 9, \"source\": \"вправо\"} trailing", "{\"error\":\"invalid JSON\"}" },
+    { "[1, 2]", "{\"error\":\"expected an object\"}" },
+    { "{\"id\": 10, \"source\": \"вправо\"}", "{\"id\":10,\"error\":\"no \\\"grid\\\" or \\\"grid_data\\\"\"}" },
+    { "{\"id\": 11, \"grid_data\": {}}", "{\"id\":11,\"error\":\"no \\\"source\\\" or \\\"program\\\"\"}" },
+    { "{\"id\": 12, \"source\": 5, \"grid_data\": {}}", "{\"id\":12,\"error\":\"\\\"source\\\" must be a string\"}" },
+    { "{\"id\": 13, \"lang\": \"de\", \"source\": \"\", \"grid_data\": {}}",
+      "{\"id\":13,\"error\":\"unknown language, expected \\\"ru\\\" or \\\"en\\\"\"}" },
+    { "{\"id\": 14, \"source\": \"\", \"grid_data\": {}, \"max_steps\": 0}",
+      "{\"id\":14,\"error\":\"\\\"max_steps\\\" must be a positive number\"}" },
+    { "{\"id\": 15, \"source\": \"\", \"grid_data\": {}, \"timeout\": \"1\"}",
+      "{\"id\":15,\"error\":\"\\\"timeout\\\" must be a positive number of seconds\"}" },
+    { "{\"id\": 16, \"source\": \"\", \"grid_data\": {}, \"loop_check\": 1}",
+      "{\"id\":16,\"error\":\"\\\"loop_check\\\" must be true or false\"}" },
+    { "{\"id\": 17, \"source\": \"\", \"grid_data\": {}, \"paint\": \"no\"}",
+      "{\"id\":17,\"error\":\"\\\"paint\\\" must be true or false\"}" },
+    { "{\"id\": 18, \"source\": \"\", \"grid_data\": []}", "{\"id\":18,\"error\":\"\\\"grid_data\\\" must be an object\"}" },
+    { "{\"id\": 19, \"source\": \"\", \"grid_data\": {\"width\": 1.5}}",
+      "{\"id\":19,\"error\":\"grid sizes and positions must be integers\"}" },
+    { "{\"id\": 20, \"source\": \"\", \"grid_data\": {\"height\": 2147483648}}",
+      "{\"id\":20,\"error\":\"grid sizes and positions must be integers\"}" },
+    { "{\"id\": 21, \"source\": \"\", \"grid_data\": {\"width\": 0}}", "{\"id\":21,\"error\":\"invalid grid size\"}" },
+    { "{\"id\": 22, \"source\": \"\", \"grid_data\": {\"width\": 5, \"x\": 5}}",
+      "{\"id\":22,\"error\":\"robot position out of bounds\"}" },
+    { "{\"id\": 23, \"source\": \"\", \"grid_data\": {\"walls\": [[1]]}}",
+      "{\"id\":23,\"error\":\"grid cells must be arrays of [x, y]\"}" },
+    { "{\"id\": 24, \"source\": \"\", \"grid_data\": {\"painted\": [[15, 0]]}}", "{\"id\":24,\"error\":\"grid cell out of bounds\"}" },
+    { "{\"id\": 25, \"source\": \"\", \"grid_data\": {\"walls\": [[0, 0]]}}", "{\"id\":25,\"error\":\"robot position on a wall\"}" },
+    { "{\"id\": 26, \"source\": \"\", \"grid\": 1}", "{\"id\":26,\"error\":\"\\\"grid\\\" must be a string\"}" },
+    { "{\"id\": 27, \"source\": \"\", \"grid\": \"missing." GRID_EXTENSION "\"}", "{\"id\":27,\"error\":\"failed to load grid\"}" },
+    { "{\"id\": 28, \"program\": \"missing.kum\", \"grid_data\": {}}", "{\"id\":28,\"error\":\"failed to open program\"}" }
+};
+
+void writeServeTestFiles() {
+    Grid grid = makeGrid();
+    grid.width = 4;
+    grid.height = 4;
+    generateGridData(&grid);
+    setGridCell(&grid, 3, 1, GRID_CELL_WALL);
+    EXPECT(dumpGrid(&grid, SERVE_TEST_GRID, 1, 1) == EXIT_SUCCESS);
+    freeGrid(&grid);
+    const char *program = "закрасить\nнц\n    вправо\nкц\n";
+    writeTestFile(SERVE_TEST_PROGRAM, program, strlen(program));
+
+    FILE *file = fopen(SERVE_TEST_JOBS, "wb");
+    for (size_t i = 0; i < countof(m_serveJobs); i++)
+        fprintf(file, "%s\n", m_serveJobs[i].request);
+    fclose(file);
+}
+
+// Runs the server with the jobs file on stdin and the answers file on
+// stdout, then puts both back
+void runServeTest() {
+    ServeOptions options = { .limits = makeDefaultLimits(), .socketPath = NULL, .threadCount = 1, .cacheEntries = 0 };
+    fflush(stdout);
+    int savedIn = dup(STDIN_FILENO), savedOut = dup(STDOUT_FILENO);
+    int in = open(SERVE_TEST_JOBS, O_RDONLY);
+    int out = open(SERVE_TEST_ANSWERS, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(in, STDIN_FILENO);
+    dup2(out, STDOUT_FILENO);
+    close(in);
+    close(out);
+    EXPECT(runServer(&options) == EXIT_SUCCESS);
+    fflush(stdout);
+    dup2(savedIn, STDIN_FILENO);
+    dup2(savedOut, STDOUT_FILENO);
+    close(savedIn);
+    close(savedOut);
+    clearerr(stdin);
+}
+
+void checkServe() {
+    writeServeTestFiles();
+    runServeTest();
+
+    FILE *file = fopen(SERVE_TEST_ANSWERS, "rb");
+    EXPECT(file != NULL);
+    if (file == NULL)
+        return;
+    char line[1024];
+    for (size_t i = 0; i < countof(m_serveJobs); i++) {
+        if (m_serveJobs[i].answer == NULL)
+            continue;
+        if (fgets(line, sizeof(line), file) == NULL) {
+            EXPECT_STR(NULL, m_serveJobs[i].answer);
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        // Answers end with the time the job took, errors don't
+        char *time = strstr(line, ",\"time_us\":");
+        if (time != NULL) {
+            EXPECT(line[strlen(line) - 1] == '}');
+            strcpy(time, "}");
+        }
+        EXPECT_STR(line, m_serveJobs[i].answer);
+    }
+    EXPECT(fgets(line, sizeof(line), file) == NULL);
+    fclose(file);
+
+    remove(SERVE_TEST_JOBS);
+    remove(SERVE_TEST_ANSWERS);
+    remove(SERVE_TEST_GRID);
+    remove(SERVE_TEST_PROGRAM);
+}
+
+int main() {
+    checkJson();
+    checkServe();
+    return finishTest();
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef KUMIR_TEST_H
+#define KUMIR_TEST_H
+
+
+// Behaviour tests are one program each, registered with add_test. A
+// failed expectation prints where it is and what failed, the test goes
+// on, and main returns finishTest()
+static size_t m_testCount = 0;
+static size_t m_testFailures = 0;
+
+#define EXPECT(condition) do { \
+        m_testCount++; \
+        if (!(condition)) { \
+            m_testFailures++; \
+            printf("%s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+
+#define EXPECT_STR(actual, expected) do { \
+        const char *_m_actual = (actual); \
+        const char *_m_expected = (expected); \
+        m_testCount++; \
+        if (_m_actual == NULL || strcmp(_m_actual, _m_expected) != 0) { \
+            m_testFailures++; \
+            printf("%s:%d: expected \"%s\", got \"%s\"\n", __FILE__, __LINE__, _m_expected, \
+                   _m_actual == NULL ? "(null)" : _m_actual); \
+        } \
+    } while (0)
+
+#define countof(array) (sizeof(array) / sizeof((array)[0]))
+
+static inline int finishTest(void) {
+    printf("%zu expectations, %zu failed\n", m_testCount, m_testFailures);
+    return m_testFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// A file in the current directory (the build directory under ctest)
+// holding data, for the loaders that take a path
+static inline void writeTestFile(const char *filename, const void *data, size_t size) {
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        printf("Failed to write %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+
+#endif // !KUMIR_TEST_H
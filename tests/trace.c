@@ -0,0 +1,170 @@
+#include "test.h"
+#include "trace.h"
+
+// Records runs, reads them back and replays them the way kumar replay
+// does: the steps, their lines, the final field and the result have to
+// match the run, loops have to fold into repeats, and a damaged trace
+// has to end as damaged rather than as a run that called конец
+#define TRACE_TEST_FILE "trace_test." TRACE_EXTENSION
+
+typedef struct TraceTestCase {
+    const char *source;
+    int width;
+    int height;
+    int walls[4][2];
+    size_t wallCount;
+    size_t maxBytes;  // the whole file, header and grid included
+} TraceTestCase;
+
+TraceTestCase m_traceCases[] = {
+    // A long pass and a long climb, each one repeat
+    { "нц пока справа свободно\n    закрасить\n    вправо\nкц\nнц пока снизу свободно\n    вниз\nкц\n",
+      .width = 1000, .height = 600, .maxBytes = 200 },
+    // Moves, paint, переместить and a wall at the end
+    { "вправо\nзакрасить\nвниз\nвниз\nпереместить 4, 1\nнц пока слева свободно\n    если сверху свободно то\n"
+      "        закрасить\n    все\n    влево\nкц\nвлево\n",
+      .width = 8, .height = 5, .walls = { { 2, 0 }, { 5, 0 } }, .wallCount = 2, .maxBytes = 400 },
+    // A period longer than one step: right, down, left, down
+    { "нц\n    если не снизу свободно то\n        конец\n    все\n    вправо\n    вниз\n    влево\n    вниз\nкц\n",
+      .width = 4, .height = 301, .maxBytes = 200 }
+};
+
+Grid makeTraceTestGrid(const TraceTestCase *test) {
+    Grid grid = makeGrid();
+    grid.width = test->width;
+    grid.height = test->height;
+    generateGridData(&grid);
+    for (size_t i = 0; i < test->wallCount; i++)
+        setGridCell(&grid, test->walls[i][0], test->walls[i][1], GRID_CELL_WALL);
+    return grid;
+}
+
+// The lines of the steps, taken one source instruction at a time
+size_t *listStepLines(const Program *program, const Grid *start, size_t *count) {
+    Grid grid;
+    copyGrid(&grid, start);
+    Robot robot = { .posX = 0, .posY = 0 };
+    Interpreter interpreter;
+    initInterpreter(&interpreter, program, &robot, &grid);
+    interpreter.stepFused = true;
+    size_t capacity = 1024;
+    size_t *lines = nmallocT(size_t, capacity);
+    *count = 0;
+    while (true) {
+        size_t pc = interpreter.pc, steps = interpreter.steps;
+        InterpreterExitCode code = stepInterpreter(&interpreter);
+        if (interpreter.steps != steps) {
+            if (*count == capacity) {
+                capacity *= 2;
+                lines = (size_t *)realloc(lines, capacity * sizeof(size_t));
+            }
+            lines[(*count)++] = program->code[pc].line;
+        }
+        if (code != INTERPRETER_NORMAL && code != INTERPRETER_SKIP_LINE)
+            break;
+    }
+    freeInterpreter(&interpreter);
+    freeGrid(&grid);
+    return lines;
+}
+
+void checkTraceCase(const TraceTestCase *test) {
+    Program program;
+    size_t lineNum;
+    EXPECT(compileProgramSource(test->source, LANG_RU, &program, &lineNum) == INTERPRETER_NORMAL);
+    Grid start = makeTraceTestGrid(test);
+
+    Grid grid;
+    copyGrid(&grid, &start);
+    Robot robot = { .posX = 0, .posY = 0 };
+    TraceRecorder recorder;
+    EXPECT(startTraceRecorder(&recorder, TRACE_TEST_FILE, &grid, robot.posX, robot.posY) == EXIT_SUCCESS);
+    Interpreter interpreter;
+    initInterpreter(&interpreter, &program, &robot, &grid);
+    setInterpreterTrace(&interpreter, &recorder);
+    RunResult result = runInterpreter(&interpreter);
+    freeInterpreter(&interpreter);
+    EXPECT(finishTraceRecorder(&recorder, &result) == EXIT_SUCCESS);
+
+    FILE *file = fopen(TRACE_TEST_FILE, "rb");
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    fclose(file);
+    EXPECT(size <= test->maxBytes);
+
+    size_t lineCount;
+    size_t *lines = listStepLines(&program, &start, &lineCount);
+    EXPECT(lineCount == result.steps);
+
+    Grid replayed = makeGrid();
+    Robot replayRobot = { .posX = -1, .posY = -1 };
+    TraceReader reader;
+    EXPECT(openTraceReader(&reader, TRACE_TEST_FILE, &replayed, &replayRobot.posX, &replayRobot.posY) == EXIT_SUCCESS);
+    EXPECT(replayRobot.posX == 0 && replayRobot.posY == 0);
+    TraceEvent event;
+    size_t line, steps = 0;
+    bool sameLines = true;
+    while (nextTraceEvent(&reader, &event, &line)) {
+        if (event.kind <= TRACE_MOVE_RIGHT) {
+            robotGo(&replayRobot, &replayed, (Direction)event.kind);
+        } else if (event.kind == TRACE_PAINT) {
+            flipGridColor(&replayed, replayRobot.posX, replayRobot.posY);
+        } else if (event.kind == TRACE_SETPOS) {
+            replayRobot.posX += event.x;
+            replayRobot.posY += event.y;
+        }
+        if (steps >= lineCount || lines[steps] != line)
+            sameLines = false;
+        steps++;
+    }
+    EXPECT(sameLines);
+    EXPECT(!reader.damaged);
+    EXPECT(steps == result.steps);
+    EXPECT(reader.result.code == result.code && reader.result.line == result.line && reader.result.steps == result.steps);
+    EXPECT(replayRobot.posX == robot.posX && replayRobot.posY == robot.posY);
+    EXPECT(isGridPaintEqual(&replayed, &grid));
+    closeTraceReader(&reader);
+
+    free(lines);
+    freeGrid(&replayed);
+    freeGrid(&grid);
+    freeGrid(&start);
+    freeProgram(&program);
+}
+
+// Reads a damaged trace to its end
+void expectDamaged(const unsigned char *data, size_t size) {
+    writeTestFile(TRACE_TEST_FILE, data, size);
+    Grid grid = makeGrid();
+    int robotPosX, robotPosY;
+    TraceReader reader;
+    EXPECT(openTraceReader(&reader, TRACE_TEST_FILE, &grid, &robotPosX, &robotPosY) == EXIT_SUCCESS);
+    TraceEvent event;
+    size_t line;
+    while (nextTraceEvent(&reader, &event, &line));
+    EXPECT(reader.damaged);
+    EXPECT(reader.result.code == INTERPRETER_ERROR);
+    closeTraceReader(&reader);
+    freeGrid(&grid);
+}
+
+int main() {
+    for (size_t i = 0; i < countof(m_traceCases); i++)
+        checkTraceCase(&m_traceCases[i]);
+
+    // The last case ends with конец, so its trace ends with TRACE_END,
+    // FORCE_EXIT, the line and the steps (two varint bytes)
+    FILE *file = fopen(TRACE_TEST_FILE, "rb");
+    unsigned char data[512];
+    size_t size = fread(data, 1, sizeof(data), file);
+    fclose(file);
+    EXPECT(size < sizeof(data));
+    EXPECT(data[size - 4] == INTERPRETER_FORCE_EXIT);
+    expectDamaged(data, size - 1);
+    expectDamaged(data, size - 5);
+    data[size - 4] = 100;
+    expectDamaged(data, size);
+
+    remove(TRACE_TEST_FILE);
+    return finishTest();
+}